@@ -126,7 +126,7 @@ contains(DEFINES, QTOX_PLATFORM_EXT) {
 # Rules for Windows, Mac OSX, and Linux
 win32 {
     RC_FILE = windows/qtox.rc
-	LIBS += -L$$PWD/libs/lib -ltoxav -ltoxcore -ltoxencryptsave -ltoxdns -lsodium -lvpx -lpthread
+	LIBS += -L$$PWD/libs/lib -ltoxav -ltoxcore -ltoxencryptsave -ltoxdns -lsodium -lvpx -lpthread -lsqlite3
     LIBS += -L$$PWD/libs/lib -lopencv_core249 -lopencv_highgui249 -lopencv_imgproc249 -lOpenAL32 -lopus
     LIBS += -lopengl32 -lole32 -loleaut32 -luuid -lvfw32 -lws2_32 -liphlpapi -lz
 
@@ -143,7 +143,7 @@ win32 {
         ICON = img/icons/qtox.icns
         QMAKE_INFO_PLIST = osx/info.plist
         QMAKE_MACOSX_DEPLOYMENT_TARGET = 10.7
-        LIBS += -L$$PWD/libs/lib/ -ltoxcore -ltoxav -ltoxencryptsave -ltoxdns -lsodium -lvpx -lopus -framework OpenAL -lopencv_core -lopencv_highgui -mmacosx-version-min=10.7
+        LIBS += -L$$PWD/libs/lib/ -ltoxcore -ltoxav -ltoxencryptsave -ltoxdns -lsodium -lvpx -lopus -framework OpenAL -lopencv_core -lopencv_highgui -lsqlite3 -mmacosx-version-min=10.7
         contains(DEFINES, QTOX_PLATFORM_EXT) { LIBS += -framework IOKit -framework CoreFoundation }
         contains(DEFINES, QTOX_FILTER_AUDIO) { LIBS += -lfilteraudio }
     } else {
@@ -151,7 +151,7 @@ win32 {
             LIBS += -ltoxcore -ltoxav -ltoxencryptsave -ltoxdns
             LIBS += -lopencv_videoio -lopencv_imgcodecs -lopencv_highgui -lopencv_imgproc -lopencv_androidcamera
             LIBS += -llibjpeg -llibwebp -llibpng -llibtiff -llibjasper -lIlmImf -lopencv_core
-            LIBS += -lopus -lvpx -lsodium -lopenal
+            LIBS += -lopus -lvpx -lsodium -lopenal -lsqlite3
         } else {
             # If we're building a package, static link libtox[core,av] and libsodium, since they are not provided by any package
             contains(STATICPKG, YES) {
@@ -159,9 +159,9 @@ win32 {
                 INSTALLS += target
                 LIBS += -L$$PWD/libs/lib/ -lopus -lvpx -lopenal -Wl,-Bstatic -ltoxcore -ltoxav -ltoxencryptsave -ltoxdns -lsodium -lopencv_highgui -lopencv_imgproc -lopencv_core -lz -Wl,-Bdynamic
                 LIBS += -Wl,-Bstatic -ljpeg -ltiff -lpng -ljasper -lIlmImf -lIlmThread -lIex -ldc1394 -lraw1394 -lHalf -lz -llzma -ljbig
-                LIBS += -Wl,-Bdynamic -lv4l1 -lv4l2 -lavformat -lavcodec -lavutil -lswscale -lusb-1.0
+                LIBS += -Wl,-Bdynamic -lv4l1 -lv4l2 -lavformat -lavcodec -lavutil -lswscale -lusb-1.0 -lsqlite3
             } else {
-                LIBS += -L$$PWD/libs/lib/ -ltoxcore -ltoxav -ltoxencryptsave -ltoxdns -lvpx -lsodium -lopenal -lopencv_core -lopencv_highgui -lopencv_imgproc
+                LIBS += -L$$PWD/libs/lib/ -ltoxcore -ltoxav -ltoxencryptsave -ltoxdns -lvpx -lsodium -lopenal -lopencv_core -lopencv_highgui -lopencv_imgproc -lsqlite3
             }
 
             contains(DEFINES, QTOX_PLATFORM_EXT) {
@@ -177,7 +177,7 @@ win32 {
             }
 
             contains(JENKINS, YES) {
-                LIBS = ./libs/lib/libtoxav.a ./libs/lib/libvpx.a ./libs/lib/libopus.a ./libs/lib/libtoxdns.a ./libs/lib/libtoxencryptsave.a ./libs/lib/libtoxcore.a ./libs/lib/libopenal.a ./libs/lib/libsodium.a ./libs/lib/libfilteraudio.a /usr/lib/libopencv_core.so /usr/lib/libopencv_highgui.so /usr/lib/libopencv_imgproc.so -lX11 -lXss
+                LIBS = ./libs/lib/libtoxav.a ./libs/lib/libvpx.a ./libs/lib/libopus.a ./libs/lib/libtoxdns.a ./libs/lib/libtoxencryptsave.a ./libs/lib/libtoxcore.a ./libs/lib/libopenal.a ./libs/lib/libsodium.a ./libs/lib/libfilteraudio.a /usr/lib/libopencv_core.so /usr/lib/libopencv_highgui.so /usr/lib/libopencv_imgproc.so -lsqlite3 -lX11 -lXss
                 contains(ENABLE_SYSTRAY_UNITY_BACKEND, YES) {
                     LIBS += -lgobject-2.0 -lappindicator -lgtk-x11-2.0
                 }
@@ -289,6 +289,7 @@ contains(ENABLE_SYSTRAY_GTK_BACKEND, NO) {
         src/widget/croppinglabel.h \
         src/widget/maskablepixmapwidget.h \
         src/widget/videosurface.h \
+        src/widget/videorenderer.h \
         src/widget/toxuri.h \
         src/toxdns.h \
         src/widget/toxsave.h \
@@ -376,6 +377,7 @@ contains(ENABLE_SYSTRAY_GTK_BACKEND, NO) {
         src/widget/croppinglabel.cpp \
         src/widget/maskablepixmapwidget.cpp \
         src/widget/videosurface.cpp \
+        src/widget/videorenderer.cpp \
         src/widget/toxuri.cpp \
         src/toxdns.cpp \
         src/widget/toxsave.cpp \
@@ -401,6 +403,16 @@ contains(ENABLE_SYSTRAY_GTK_BACKEND, NO) {
 
 SOURCES += \
     src/audio.cpp \
+    src/audiocapture.cpp \
+    src/audiocapturebus.cpp \
+    src/audiojitterbuffer.cpp \
+    src/audiosourcequeue.cpp \
+    src/groupaudiomixer.cpp \
+    src/groupaudioqueue.cpp \
+    src/voiceactivitydetector.cpp \
+    src/latencyrecorder.cpp \
+    src/callrecorder.cpp \
+    src/callmanager.cpp \
     src/core.cpp \
     src/coreav.cpp \
     src/coreencryption.cpp \
@@ -414,15 +426,31 @@ SOURCES += \
     src/misc/db/genericddinterface.cpp \
     src/misc/db/plaindb.cpp \
     src/misc/db/encrypteddb.cpp \
+    src/misc/db/encryptedvfs.cpp \
+    src/misc/db/legacylogreader.cpp \
     src/video/camera.cpp \
     src/video/cameraworker.cpp \
     src/video/netvideosource.cpp \
+    src/video/syntheticvideosource.cpp \
+    src/video/filevideosource.cpp \
+    src/video/videoratecontroller.cpp \
     src/video/videoframe.cpp \
+    src/video/videoframeslot.cpp \
     src/widget/gui.cpp \
     src/toxme.cpp
 
 HEADERS += \
     src/audio.h \
+    src/audiocapture.h \
+    src/audiocapturebus.h \
+    src/audiojitterbuffer.h \
+    src/audiosourcequeue.h \
+    src/groupaudiomixer.h \
+    src/groupaudioqueue.h \
+    src/voiceactivitydetector.h \
+    src/latencyrecorder.h \
+    src/callrecorder.h \
+    src/callmanager.h \
     src/core.h \
     src/corestructs.h \
     src/coredefines.h \
@@ -435,9 +463,15 @@ HEADERS += \
     src/misc/db/genericddinterface.h \
     src/misc/db/plaindb.h \
     src/misc/db/encrypteddb.h \
+    src/misc/db/encryptedvfs.h \
+    src/misc/db/legacylogreader.h \
     src/video/camera.h \
     src/video/cameraworker.h \
     src/video/videoframe.h \
+    src/video/videoframeslot.h \
     src/video/videosource.h \
+    src/video/syntheticvideosource.h \
+    src/video/filevideosource.h \
+    src/video/videoratecontroller.h \
     src/widget/gui.h \
     src/toxme.h
@@ -24,23 +24,53 @@
 #define FIX_SND_PCM_PREPARE_BUG 0
 
 #include "audio.h"
+#include "audiocapture.h"
+#include "audiosourcequeue.h"
+#include "groupaudiomixer.h"
+#include "groupaudioqueue.h"
 #include "src/core.h"
 
 #include <QDebug>
 #include <QThread>
+#include <QTimer>
 #include <QMutexLocker>
+#include <QFile>
 
 #include <cassert>
 
+// Room for 320ms of 20ms frames from 4 speakers, each up to 60ms of stereo
+static const int groupAudioSlots = 64;
+static const int groupAudioSlotSamples = 2880 * 2;
+
+// Group calls' output queues are topped up twice per frame, to this many mixed frames
+static const int mixInterval = 10;
+static const int mixFrames = 2;
+
+// Alerts are 44100Hz mono 16bit PCM, indexed by Audio::Sound
+static const char* const soundFiles[Audio::SoundCount] =
+{
+    ":audio/notification.pcm",
+    // for whatever reason this plays slower/downshifted from what any other program plays the file as... but whatever
+    ":audio/ToxicIncomingCall.pcm",
+};
+static const int soundSampleRate = 44100;
+
 std::atomic<int> Audio::userCount{0};
 Audio* Audio::instance{nullptr};
 QThread* Audio::audioThread{nullptr};
+AudioCapture* Audio::captureThread{nullptr};
 QMutex* Audio::audioInLock{nullptr};
 QMutex* Audio::audioOutLock{nullptr};
+QTimer* Audio::mixTimer{nullptr};
+GroupAudioQueue* Audio::groupAudioQueue{nullptr};
+std::atomic<bool> Audio::groupAudioPending{false};
 ALCdevice* Audio::alInDev{nullptr};
 ALCdevice* Audio::alOutDev{nullptr};
 ALCcontext* Audio::alContext{nullptr};
-ALuint Audio::alMainSource{0};
+const int Audio::soundSourceCount;
+ALuint Audio::soundBuffers[Audio::SoundCount]{};
+ALuint Audio::soundSources[Audio::soundSourceCount]{};
+int Audio::nextSoundSource{0};
 float Audio::outputVolume{1.0};
 
 void audioDebugLog(QString msg)
@@ -60,7 +90,16 @@ Audio& Audio::getInstance()
         audioThread->start();
         audioInLock = new QMutex(QMutex::Recursive);
         audioOutLock = new QMutex(QMutex::Recursive);
+        groupAudioQueue = new GroupAudioQueue(groupAudioSlots, groupAudioSlotSamples);
+        mixTimer = new QTimer(instance);
+        mixTimer->setTimerType(Qt::PreciseTimer);
+        mixTimer->setInterval(mixInterval);
+        connect(mixTimer, &QTimer::timeout, instance, &Audio::mixGroupAudio);
         instance->moveToThread(audioThread);
+
+        const int framesize = av_DefaultSettings.audio_frame_duration * av_DefaultSettings.audio_sample_rate / 1000;
+        captureThread = new AudioCapture(framesize, av_DefaultSettings.audio_channels, av_DefaultSettings.audio_sample_rate);
+        captureThread->start(QThread::HighPriority);
     }
     return *instance;
 }
@@ -68,6 +107,8 @@ Audio& Audio::getInstance()
 Audio::~Audio()
 {
     qDebug() << "Deleting Audio";
+    captureThread->stop();
+    delete captureThread;
     audioThread->exit(0);
     audioThread->wait();
     if (audioThread->isRunning())
@@ -75,6 +116,7 @@ Audio::~Audio()
     delete audioThread;
     delete audioInLock;
     delete audioOutLock;
+    delete groupAudioQueue;
 }
 
 void Audio::suscribeInput()
@@ -93,6 +135,7 @@ void Audio::suscribeInput()
         audioDebugLog("starting capture");
         alcCaptureStart(alInDev);
 #endif
+        captureThread->wake();
     }
 }
 
@@ -137,12 +180,11 @@ void Audio::openInput(const QString& inDevDescr)
     else
         qDebug() << "Audio: Opening audio input "<<inDevDescr;
 
-    Core::getInstance()->resetCallSources(); // Force to regen each group call's sources
-
     // Restart the capture if necessary
     if (userCount.load() != 0 && alInDev)
     {
         alcCaptureStart(alInDev);
+        captureThread->wake();
     }
     else
     {
@@ -169,6 +211,8 @@ void Audio::openOutput(const QString& outDevDescr)
     }
     else
     {
+        if (alContext)
+            releaseSounds();
         if (alContext && alcMakeContextCurrent(nullptr) == ALC_TRUE)
             alcDestroyContext(alContext);
         if (tmp)
@@ -180,7 +224,7 @@ void Audio::openOutput(const QString& outDevDescr)
             alcCloseDevice(alOutDev);
         }
         else
-            alGenSources(1, &alMainSource);
+            loadSounds();
 
 
         qDebug() << "Audio: Opening audio output "<<outDevDescr;
@@ -211,6 +255,8 @@ void Audio::closeOutput()
 {
     audioDebugLog("Closing output");
     QMutexLocker lock(audioOutLock);
+    if (alContext)
+        releaseSounds();
     if (alContext && alcMakeContextCurrent(nullptr) == ALC_TRUE)
         alcDestroyContext(alContext);
 
@@ -227,26 +273,105 @@ void Audio::closeOutput()
     }
 }
 
-void Audio::playMono16Sound(const QByteArray& data)
+void Audio::loadSounds()
+{
+    // The resources are only read once, reopening the device just uploads them again
+    static QByteArray soundData[SoundCount];
+
+    alGenBuffers(SoundCount, soundBuffers);
+    for (int i = 0; i < SoundCount; ++i)
+    {
+        if (soundData[i].isEmpty())
+        {
+            QFile file(soundFiles[i]);
+            if (!file.open(QIODevice::ReadOnly))
+                qWarning() << "Audio: Can't load" << soundFiles[i];
+            soundData[i] = file.readAll();
+        }
+        alBufferData(soundBuffers[i], AL_FORMAT_MONO16, soundData[i].constData(), soundData[i].size(), soundSampleRate);
+    }
+
+    alGenSources(soundSourceCount, soundSources);
+    nextSoundSource = 0;
+}
+
+void Audio::releaseSounds()
+{
+    // Sources have to let go of the buffers before they can be deleted
+    alSourceStopv(soundSourceCount, soundSources);
+    alDeleteSources(soundSourceCount, soundSources);
+    alDeleteBuffers(SoundCount, soundBuffers);
+    for (ALuint& source : soundSources)
+        source = 0;
+    for (ALuint& buffer : soundBuffers)
+        buffer = 0;
+}
+
+void Audio::playSound(Sound sound)
 {
     QMutexLocker lock(audioOutLock);
-    if (!alOutDev)
+    if (!alOutDev || !soundSources[0])
         return;
 
-    ALuint buffer;
-    alGenBuffers(1, &buffer);
-    alBufferData(buffer, AL_FORMAT_MONO16, data.data(), data.size(), 44100);
-    alSourcei(alMainSource, AL_BUFFER, buffer);
-    alSourcePlay(alMainSource);
-    alDeleteBuffers(1, &buffer);
+    // Restart the sound if it's already playing, otherwise take an idle source,
+    // and only cut the oldest alert short when they're all busy
+    const ALint buffer = soundBuffers[sound];
+    int idle = -1;
+    for (int i = 0; i < soundSourceCount; ++i)
+    {
+        ALint state, current;
+        alGetSourcei(soundSources[i], AL_SOURCE_STATE, &state);
+        alGetSourcei(soundSources[i], AL_BUFFER, &current);
+        if (state == AL_PLAYING && current == buffer)
+        {
+            alSourceRewind(soundSources[i]);
+            alSourcePlay(soundSources[i]);
+            return;
+        }
+        if (state != AL_PLAYING && idle < 0)
+            idle = i;
+    }
+
+    const int index = idle >= 0 ? idle : nextSoundSource;
+    ALuint source = soundSources[index];
+    alSourceStop(source);
+    alSourcei(source, AL_BUFFER, buffer);
+    alSourcePlay(source);
+    nextSoundSource = (index + 1) % soundSourceCount;
 }
 
 void Audio::playGroupAudioQueued(Tox*,int group, int peer, const int16_t* data,
                         unsigned samples, uint8_t channels, unsigned sample_rate,void*)
 {
-    QMetaObject::invokeMethod(instance, "playGroupAudio", Qt::BlockingQueuedConnection,
-                              Q_ARG(int,group), Q_ARG(int,peer), Q_ARG(const int16_t*,data),
-                              Q_ARG(unsigned,samples), Q_ARG(uint8_t,channels), Q_ARG(unsigned,sample_rate));
+    if (!groupAudioQueue->push(group, peer, data, samples, channels, sample_rate))
+    {
+        quint64 drops = getGroupAudioDrops();
+        if (drops % 100 == 1)
+            qDebug() << "Audio: Dropped group audio frame," << drops << "so far";
+    }
+
+    // One wake up per batch, the audio thread drains everything that's there
+    if (!groupAudioPending.exchange(true))
+        QMetaObject::invokeMethod(instance, "drainGroupAudio", Qt::QueuedConnection);
+}
+
+void Audio::drainGroupAudio()
+{
+    // Clear first, so a frame pushed while we drain triggers a new wake up
+    groupAudioPending = false;
+
+    GroupAudioQueue::Frame frame;
+    while (groupAudioQueue->front(frame))
+    {
+        playGroupAudio(frame.group, frame.peer, frame.data, frame.samples, frame.channels, frame.sampleRate);
+        groupAudioQueue->pop();
+    }
+}
+
+quint64 Audio::getGroupAudioDrops()
+{
+    GroupAudioQueue::Stats stats = groupAudioQueue->getStats();
+    return stats.droppedFull + stats.droppedOversize;
 }
 
 void Audio::playGroupAudio(int group, int peer, const int16_t* data,
@@ -256,58 +381,67 @@ void Audio::playGroupAudio(int group, int peer, const int16_t* data,
 
     QMutexLocker lock(audioOutLock);
 
-    ToxGroupCall& call = Core::groupCalls[group];
-
-    if (!call.active || call.muteVol)
+    ToxGroupCall* call = Core::findGroupCall(group);
+    if (!call || !call->active || call->muteVol || !call->mixer)
         return;
 
-    if (!call.alSources.contains(peer))
-    {
-        alGenSources(1, &call.alSources[peer]);
-        alSourcef(call.alSources[peer], AL_GAIN, outputVolume);
-    }
-
-    playAudioBuffer(call.alSources[peer], data, samples, channels, sample_rate);
+    call->mixer->pushPeerAudio(peer, data, samples, channels, sample_rate);
+    if (!mixTimer->isActive())
+        mixTimer->start();
 }
 
-void Audio::playAudioBuffer(ALuint alSource, const int16_t *data, int samples, unsigned channels, int sampleRate)
+void Audio::mixGroupAudio()
 {
-    assert(channels == 1 || channels == 2);
-
     QMutexLocker lock(audioOutLock);
 
-    ALuint bufid;
-    ALint processed = 0, queued = 16;
-    alGetSourcei(alSource, AL_BUFFERS_PROCESSED, &processed);
-    alGetSourcei(alSource, AL_BUFFERS_QUEUED, &queued);
-    alSourcei(alSource, AL_LOOPING, AL_FALSE);
-
-    if (processed)
-    {
-        ALuint bufids[processed];
-        alSourceUnqueueBuffers(alSource, processed, bufids);
-        alDeleteBuffers(processed - 1, bufids + 1);
-        bufid = bufids[0];
-    }
-    else if (queued < 16)
-    {
-        alGenBuffers(1, &bufid);
-    }
-    else
+    // Joining and leaving calls from other threads would insert in the hash under us
+    QMutexLocker callsLock(&Core::groupCallsLock);
+    bool anyActive = false;
+    for (ToxGroupCall& call : Core::groupCalls)
     {
-        qDebug() << "Audio: Dropped frame";
-        return;
+        if (!call.active || !call.mixer)
+            continue;
+        anyActive = true;
+
+        GroupAudioMixer& mixer = *call.mixer;
+        AudioSourceQueue& output = *call.alOutput;
+        output.setGain(call.muteVol ? 0.f : outputVolume);
+
+        int16_t buf[mixer.getFrameSize() * mixer.getChannels()];
+        int pending = output.pending();
+        while (pending < mixFrames && mixer.mix(buf))
+        {
+            output.queue(buf, mixer.getFrameSize(), mixer.getChannels(), mixer.getSampleRate());
+            pending++;
+        }
     }
 
-    alBufferData(bufid, (channels == 1) ? AL_FORMAT_MONO16 : AL_FORMAT_STEREO16, data,
-                    samples * 2 * channels, sampleRate);
-    alSourceQueueBuffers(alSource, 1, &bufid);
+    // playGroupAudio restarts us
+    if (!anyActive)
+        mixTimer->stop();
+}
+
+void Audio::releaseGroupAudio(int group)
+{
+    QMutexLocker lock(audioOutLock);
+    ToxGroupCall& call = Core::getGroupCall(group);
+    delete call.mixer;
+    call.mixer = nullptr;
+    delete call.alOutput;
+    call.alOutput = nullptr;
+}
+
+void Audio::playAudioBuffer(AudioSourceQueue& queue, const int16_t *data, int samples, unsigned channels, int sampleRate)
+{
+    QMutexLocker lock(audioOutLock);
+    queue.queue(data, samples, channels, sampleRate);
+}
 
-    ALint state;
-    alGetSourcei(alSource, AL_SOURCE_STATE, &state);
-    alSourcef(alSource, AL_GAIN, outputVolume);
-    if (state != AL_PLAYING)
-        alSourcePlay(alSource);
+int Audio::setOutputGain(AudioSourceQueue& queue, float gain)
+{
+    QMutexLocker lock(audioOutLock);
+    queue.setGain(gain);
+    return queue.pending();
 }
 
 bool Audio::isInputReady()
@@ -320,18 +454,21 @@ bool Audio::isOutputClosed()
     return (alOutDev);
 }
 
-bool Audio::tryCaptureSamples(uint8_t* buf, int framesize)
+int Audio::captureFrame(int16_t* buf, int framesize)
 {
     QMutexLocker lock(audioInLock);
 
+    if (!alInDev)
+        return -1;
+
     ALint samples=0;
     alcGetIntegerv(Audio::alInDev, ALC_CAPTURE_SAMPLES, sizeof(samples), &samples);
     if (samples < framesize)
-        return false;
+        return framesize - samples;
 
     memset(buf, 0, framesize * 2 * av_DefaultSettings.audio_channels); // Avoid uninitialized values (Valgrind)
     alcCaptureSamples(Audio::alInDev, buf, framesize);
-    return true;
+    return 0;
 }
 
 #ifdef QTOX_FILTER_AUDIO
@@ -37,12 +37,23 @@ class QThread;
 class QMutex;
 struct Tox;
 class AudioFilterer;
+class AudioCapture;
+class AudioSourceQueue;
+class GroupAudioQueue;
 
 class Audio : QObject
 {
     Q_OBJECT
 
 public:
+    /// Alerts preloaded in the output device whenever it is opened
+    enum Sound
+    {
+        NewMessageSound,
+        IncomingCallSound,
+        SoundCount
+    };
+
     static Audio& getInstance(); ///< Returns the singleton's instance. Will construct on first call.
 
     static void suscribeInput(); ///< Call when you need to capture sound from the open input device.
@@ -57,10 +68,13 @@ public:
     static bool isInputReady(); ///< Returns true if the input device is open and suscribed to
     static bool isOutputClosed(); ///< Returns true if the output device is open
 
-    static void playMono16Sound(const QByteArray& data); ///< Play a 44100Hz mono 16bit PCM sound
-    static bool tryCaptureSamples(uint8_t* buf, int framesize); ///< Does nothing and return false on failure
+    static void playSound(Sound sound); ///< Plays a preloaded alert, overlapping the others
+
+    /// Reads a frame if the device has one, for the capture thread only
+    /// Returns 0 on success, the number of samples still missing, or -1 if the input is closed
+    static int captureFrame(int16_t* buf, int framesize);
 
-    /// May be called from any thread, will always queue a call to playGroupAudio
+    /// May be called from any thread, copies the frame for playGroupAudio and returns right away
     /// The first and last argument are ignored, but allow direct compatibility with toxcore
     static void playGroupAudioQueued(Tox*, int group, int peer, const int16_t* data,
                         unsigned samples, uint8_t channels, unsigned sample_rate, void*);
@@ -77,20 +91,41 @@ public slots:
 
 public:
     static QThread* audioThread;
+    static AudioCapture* captureThread; ///< Publishes the captured frames to every call, see Core::sendCallAudio
     static ALCcontext* alContext;
-    static ALuint alMainSource;
     static float outputVolume;
 
+    /// Streams a frame of received audio, used by calls and group calls alike
+    static void playAudioBuffer(AudioSourceQueue& queue, const int16_t *data, int samples, unsigned channels, int sampleRate);
+    static int setOutputGain(AudioSourceQueue& queue, float gain); ///< Returns the buffers the queue still has to play
+    static void releaseGroupAudio(int group); ///< Frees a group call's mixer and source, once the call was left
+
+    static quint64 getGroupAudioDrops(); ///< Received group call frames we had no room for
+
+private slots:
+    void drainGroupAudio(); ///< Plays everything playGroupAudioQueued handed over
+    void mixGroupAudio(); ///< Keeps each group call's output fed from its mixer
+
 private:
     explicit Audio()=default;
     ~Audio();
-    static void playAudioBuffer(ALuint alSource, const int16_t *data, int samples, unsigned channels, int sampleRate);
+
+    static void loadSounds(); ///< Uploads the alerts to the current context, with the output lock held
+    static void releaseSounds(); ///< Call before the current context goes away
 
 private:
     static Audio* instance;
     static std::atomic<int> userCount;
     static ALCdevice* alOutDev, *alInDev;
     static QMutex* audioInLock, *audioOutLock;
+    static QTimer* mixTimer;
+    static GroupAudioQueue* groupAudioQueue;
+    static std::atomic<bool> groupAudioPending;
+
+    static const int soundSourceCount = 4; ///< Alerts that may play at once
+    static ALuint soundBuffers[SoundCount];
+    static ALuint soundSources[soundSourceCount];
+    static int nextSoundSource; ///< Stolen when every source is busy, the one that started playing first
 };
 
 #endif // AUDIO_H
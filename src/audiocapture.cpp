@@ -0,0 +1,93 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "audiocapture.h"
+#include "audio.h"
+#include "latencyrecorder.h"
+
+#include <QMutexLocker>
+
+// Room for 200ms of 20ms frames before we start dropping
+static const int RING_FRAMES = 10;
+
+AudioCapture::AudioCapture(int frameSize, int channels, int sampleRate)
+    : frameSize(frameSize), channels(channels), sampleRate(sampleRate),
+      bus(RING_FRAMES, frameSize, channels, frameSize * 1000 / sampleRate)
+{
+    setObjectName("qTox Audio Capture");
+}
+
+AudioSubscriber* AudioCapture::subscribe(std::function<void()> notifier)
+{
+    return bus.subscribe(notifier);
+}
+
+void AudioCapture::unsubscribe(AudioSubscriber* sub)
+{
+    bus.unsubscribe(sub);
+}
+
+int AudioCapture::getFrameSize() const
+{
+    return bus.getFrameSize();
+}
+
+void AudioCapture::wake()
+{
+    QMutexLocker lock(&idleMutex);
+    idleCond.wakeAll();
+}
+
+void AudioCapture::stop()
+{
+    requestInterruption();
+    wake();
+    wait();
+}
+
+void AudioCapture::run()
+{
+    while (!isInterruptionRequested())
+    {
+        {
+            QMutexLocker lock(&idleMutex);
+            while (!isInterruptionRequested() && !Audio::isInputReady())
+                idleCond.wait(&idleMutex);
+        }
+        if (isInterruptionRequested())
+            break;
+
+        // Overruns are counted by the bus against the subscribers that lag behind
+        int16_t* slot = bus.beginWrite();
+
+        int missing = Audio::captureFrame(slot, frameSize);
+        if (missing < 0)
+        {
+            // The device went away, isInputReady() will tell us when to resume
+            msleep(5);
+            continue;
+        }
+
+        if (missing > 0)
+        {
+            // Sleep until the device should have a whole frame
+            msleep(qMax(1, missing * 1000 / sampleRate));
+            continue;
+        }
+
+        bus.endWrite(LatencyRecorder::now());
+    }
+}
@@ -0,0 +1,58 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef AUDIOCAPTURE_H
+#define AUDIOCAPTURE_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include "audiocapturebus.h"
+
+/**
+ * Reads whole frames from the open input device on its own thread
+ * and publishes them on a bus every call reads at its own pace. It sleeps until
+ * the device should have a full frame, and idles while nobody is suscribed to the input.
+ **/
+
+class AudioCapture : public QThread
+{
+    Q_OBJECT
+public:
+    AudioCapture(int frameSize, int channels, int sampleRate);
+
+    /// The notifier runs on the capture thread, queue the actual work elsewhere
+    AudioSubscriber* subscribe(std::function<void()> notifier);
+    void unsubscribe(AudioSubscriber* sub);
+    int getFrameSize() const; ///< Samples per channel in a frame
+
+    void wake(); ///< Call after the input device or its suscribers changed
+    void stop(); ///< Blocks until the thread exited
+
+protected:
+    virtual void run();
+
+private:
+    const int frameSize;
+    const int channels;
+    const int sampleRate;
+    AudioCaptureBus bus;
+
+    QMutex idleMutex;
+    QWaitCondition idleCond;
+};
+
+#endif // AUDIOCAPTURE_H
@@ -0,0 +1,193 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "audiocapturebus.h"
+#include "audio.h"
+
+#include <QDebug>
+#include <QMutexLocker>
+#include <QThread>
+
+#ifdef QTOX_FILTER_AUDIO
+#include "audiofilterer.h"
+#endif
+
+AudioSubscriber::AudioSubscriber(AudioCaptureBus* bus, std::function<void()> notifier, uint64_t start)
+    : bus{bus}, notifier{notifier}, readSeq{start}, peekedSeq{start}, notifyPending{false},
+      overruns{0}, underruns{0}, lastTimestamp{-1}
+#ifdef QTOX_FILTER_AUDIO
+      , filterer{nullptr}, filteredSeq{0}
+#endif
+{
+}
+
+AudioSubscriber::~AudioSubscriber()
+{
+#ifdef QTOX_FILTER_AUDIO
+    delete filterer;
+#endif
+}
+
+const int16_t* AudioSubscriber::peek()
+{
+    // Clear first, so a frame published while we drain triggers a new notification
+    notifyPending = false;
+
+    const uint64_t r = readSeq.load(std::memory_order_acquire);
+    if (r == bus->writeSeq.load(std::memory_order_acquire))
+        return nullptr;
+
+    peekedSeq = r;
+    const int samples = bus->frameSize * bus->channels;
+    const int16_t* frame = bus->storage.constData() + (r % bus->slots) * samples;
+
+#ifdef QTOX_FILTER_AUDIO
+    if (filterer)
+    {
+        // The bus is shared, filter a private copy once per frame
+        if (filteredSeq != r + 1)
+        {
+            filtered.resize(samples);
+            memcpy(filtered.data(), frame, samples * sizeof(int16_t));
+            Audio::getEchoesToFilter(filterer, bus->frameSize);
+            filterer->filterAudio(filtered.data(), bus->frameSize);
+            filteredSeq = r + 1;
+        }
+        return filtered.constData();
+    }
+#endif
+
+    return frame;
+}
+
+void AudioSubscriber::pop()
+{
+    uint64_t r = peekedSeq;
+    const qint64 timestamp = bus->timestamps[r % bus->slots];
+
+    // The capture thread stalled for more than a frame, we had nothing to send in between
+    if (lastTimestamp >= 0 && timestamp - lastTimestamp > bus->frameDurationMs * 1500)
+        underruns++;
+    lastTimestamp = timestamp;
+
+    // Fails if the producer skipped us past this frame meanwhile, we're already further
+    readSeq.compare_exchange_strong(r, r + 1, std::memory_order_acq_rel);
+}
+
+qint64 AudioSubscriber::frameTimestamp() const
+{
+    return bus->timestamps[peekedSeq % bus->slots];
+}
+
+#ifdef QTOX_FILTER_AUDIO
+void AudioSubscriber::setFilterer(AudioFilterer* filterer)
+{
+    delete this->filterer;
+    this->filterer = filterer;
+    filteredSeq = 0;
+}
+#endif
+
+quint64 AudioSubscriber::getOverruns() const
+{
+    return overruns;
+}
+
+quint64 AudioSubscriber::getUnderruns() const
+{
+    return underruns;
+}
+
+AudioCaptureBus::AudioCaptureBus(int frames, int frameSize, int channels, int frameDurationMs)
+    : frames{frames}, slots{frames + 1}, frameSize{frameSize}, channels{channels}, frameDurationMs{frameDurationMs},
+      storage(slots * frameSize * channels), timestamps(slots), writeSeq{0},
+      subscribers{std::make_shared<SubscriberList>()}
+{
+}
+
+AudioCaptureBus::~AudioCaptureBus()
+{
+    for (AudioSubscriber* sub : *subscribers)
+        delete sub;
+}
+
+AudioSubscriber* AudioCaptureBus::subscribe(std::function<void()> notifier)
+{
+    QMutexLocker lock(&subscribersLock);
+    AudioSubscriber* sub = new AudioSubscriber(this, notifier, writeSeq.load(std::memory_order_acquire));
+    std::shared_ptr<SubscriberList> list = std::make_shared<SubscriberList>(*std::atomic_load(&subscribers));
+    list->append(sub);
+    std::atomic_store(&subscribers, std::shared_ptr<const SubscriberList>(list));
+    return sub;
+}
+
+void AudioCaptureBus::unsubscribe(AudioSubscriber* sub)
+{
+    std::shared_ptr<const SubscriberList> old;
+    {
+        QMutexLocker lock(&subscribersLock);
+        old = std::atomic_load(&subscribers);
+        std::shared_ptr<SubscriberList> list = std::make_shared<SubscriberList>(*old);
+        list->removeOne(sub);
+        std::atomic_store(&subscribers, std::shared_ptr<const SubscriberList>(list));
+    }
+
+    // The producer may still be going through the old list, it lets go of it within a frame
+    while (old.use_count() > 1)
+        QThread::yieldCurrentThread();
+    std::atomic_thread_fence(std::memory_order_acquire);
+    delete sub;
+}
+
+int AudioCaptureBus::getFrameSize() const
+{
+    return frameSize;
+}
+
+int16_t* AudioCaptureBus::beginWrite()
+{
+    const uint64_t w = writeSeq.load(std::memory_order_relaxed);
+
+    // Whoever is a whole ring behind loses its oldest frame, so the next write can't reach what it reads
+    const std::shared_ptr<const SubscriberList> subs = std::atomic_load(&subscribers);
+    for (AudioSubscriber* sub : *subs)
+    {
+        uint64_t r = sub->readSeq.load(std::memory_order_acquire);
+        while (w - r >= static_cast<uint64_t>(frames))
+        {
+            if (sub->readSeq.compare_exchange_weak(r, w - frames + 1, std::memory_order_acq_rel))
+            {
+                if (!(sub->overruns++ % 50))
+                    qDebug() << "AudioCaptureBus: Subscriber too slow, skipped a frame";
+                break;
+            }
+        }
+    }
+
+    return storage.data() + (w % slots) * frameSize * channels;
+}
+
+void AudioCaptureBus::endWrite(qint64 timestamp)
+{
+    const uint64_t w = writeSeq.load(std::memory_order_relaxed);
+    timestamps[w % slots] = timestamp;
+    writeSeq.store(w + 1, std::memory_order_release);
+
+    const std::shared_ptr<const SubscriberList> subs = std::atomic_load(&subscribers);
+    for (AudioSubscriber* sub : *subs)
+        if (!sub->notifyPending.exchange(true))
+            sub->notifier();
+}
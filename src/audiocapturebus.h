@@ -0,0 +1,116 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef AUDIOCAPTUREBUS_H
+#define AUDIOCAPTUREBUS_H
+
+#include <QVector>
+#include <QList>
+#include <QMutex>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+class AudioCaptureBus;
+#ifdef QTOX_FILTER_AUDIO
+class AudioFilterer;
+#endif
+
+/**
+ * A call's view of the capture bus. Every subscriber sees every captured frame,
+ * in place in the bus, through its own read cursor.
+ * peek() and pop() must only be used from one thread at a time, and a frame a frame's duration at most.
+ **/
+
+class AudioSubscriber
+{
+public:
+    const int16_t* peek(); ///< Next frame, after this subscriber's filter if it has one, or nullptr
+    void pop();
+    qint64 frameTimestamp() const; ///< When the frame peek() last returned was captured, in LatencyRecorder::now() time
+
+#ifdef QTOX_FILTER_AUDIO
+    void setFilterer(AudioFilterer* filterer); ///< Takes ownership, nullptr to disable filtering
+#endif
+
+    quint64 getOverruns() const; ///< Frames this subscriber was skipped past because it fell a whole bus behind
+    quint64 getUnderruns() const; ///< Gaps of more than one frame in the captured input
+
+private:
+    friend class AudioCaptureBus;
+    AudioSubscriber(AudioCaptureBus* bus, std::function<void()> notifier, uint64_t start);
+    ~AudioSubscriber();
+
+    AudioCaptureBus* bus;
+    std::function<void()> notifier;
+    std::atomic<uint64_t> readSeq; ///< Advanced by the producer past the frames a lagging subscriber loses
+    uint64_t peekedSeq; ///< The frame peek() returned
+    std::atomic<bool> notifyPending;
+    std::atomic<quint64> overruns, underruns;
+    qint64 lastTimestamp;
+
+#ifdef QTOX_FILTER_AUDIO
+    AudioFilterer* filterer;
+    QVector<int16_t> filtered;
+    uint64_t filteredSeq; ///< readSeq+1 of the frame in filtered, 0 if none
+#endif
+};
+
+/**
+ * Single producer, multiple consumer broadcast ring of fixed-size audio frames.
+ * The producer never blocks: a subscriber a whole ring behind skips its oldest frame,
+ * counted as an overrun for it alone, the others still get every frame.
+ * The ring has a spare slot, so the frame a lagging subscriber is reading is only
+ * overwritten a frame's duration after it was skipped.
+ * Subscribers are notified once per batch, after they drained their cursor.
+ * The producer goes through a snapshot of the subscribers, it doesn't wait for
+ * subscribe() and unsubscribe().
+ **/
+
+class AudioCaptureBus
+{
+public:
+    AudioCaptureBus(int frames, int frameSize, int channels, int frameDurationMs);
+    ~AudioCaptureBus();
+
+    /// The notifier is called from the producer thread when frames become available
+    AudioSubscriber* subscribe(std::function<void()> notifier);
+    void unsubscribe(AudioSubscriber* sub); ///< Deletes the subscriber
+
+    int getFrameSize() const; ///< Samples per channel in a frame
+
+    int16_t* beginWrite(); ///< Producer side, never nullptr
+    void endWrite(qint64 timestamp); ///< timestamp in µs
+
+private:
+    friend class AudioSubscriber;
+
+    const int frames;
+    const int slots; ///< frames plus the spare
+    const int frameSize;
+    const int channels;
+    const int frameDurationMs;
+    QVector<int16_t> storage;
+    QVector<qint64> timestamps;
+    std::atomic<uint64_t> writeSeq;
+
+    typedef QList<AudioSubscriber*> SubscriberList;
+    QMutex subscribersLock; ///< Serializes subscribe() and unsubscribe(), the producer never takes it
+    std::shared_ptr<const SubscriberList> subscribers; ///< Replaced as a whole, only through std::atomic_load/atomic_store
+};
+
+#endif // AUDIOCAPTUREBUS_H
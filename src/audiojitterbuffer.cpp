@@ -0,0 +1,195 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "audiojitterbuffer.h"
+#include "latencyrecorder.h"
+
+#include <QMutexLocker>
+#include <cmath>
+#include <cstring>
+
+// Gain of each consecutive concealed frame, out of 256
+static const int concealGain[] = {192, 128, 64};
+
+const int AudioJitterBuffer::maxDepth;
+const int AudioJitterBuffer::maxConcealed;
+const int AudioJitterBuffer::excessPopsToDrop;
+const int AudioJitterBuffer::pauseFrames;
+
+AudioJitterBuffer::AudioJitterBuffer()
+{
+    reset();
+}
+
+void AudioJitterBuffer::reset()
+{
+    QMutexLocker lock(&mutex);
+    head = 0;
+    count = 0;
+    targetDepth = 1;
+    jitter = 0;
+    lastArrival = -1;
+    lastFrameMs = 20;
+
+    out.samples = 0;
+    buffering = true;
+    concealRun = 0;
+    excessPops = 0;
+    outputDepth = 0;
+
+    stats = Stats();
+    stats.targetDepth = targetDepth;
+}
+
+void AudioJitterBuffer::push(const int16_t* data, int samples, unsigned channels, int sampleRate)
+{
+    if (!samples || !channels || channels > 2 || sampleRate <= 0)
+        return;
+
+    QMutexLocker lock(&mutex);
+    stats.received++;
+
+    // Without sequence numbers from toxav, arrival times are all we can go by.
+    // The peer's VAD sends nothing while they're silent, so a long gap is the
+    // start of a new talkspurt and tells us nothing about the link
+    const qint64 now = LatencyRecorder::now();
+    if (lastArrival >= 0)
+    {
+        const float gap = (now - lastArrival) / 1000.f;
+        if (gap <= pauseFrames * lastFrameMs)
+            jitter += (std::fabs(gap - lastFrameMs) - jitter) / 16.f;
+    }
+    lastArrival = now;
+
+    if (count == maxDepth)
+    {
+        head = (head + 1) % maxDepth;
+        count--;
+        stats.dropped++;
+    }
+
+    Frame& frame = frames[(head + count) % maxDepth];
+    frame.data.resize(samples * channels);
+    memcpy(frame.data.data(), data, samples * channels * sizeof(int16_t));
+    frame.samples = samples;
+    frame.channels = channels;
+    frame.sampleRate = sampleRate;
+    frame.arrival = now;
+    count++;
+
+    lastFrameMs = frameMs(frame);
+    updateTarget(lastFrameMs);
+}
+
+const int16_t* AudioJitterBuffer::pop(int& samples, unsigned& channels, int& sampleRate, qint64* arrival)
+{
+    QMutexLocker lock(&mutex);
+
+    if (buffering)
+    {
+        if (count < targetDepth)
+            return nullptr;
+        buffering = false;
+    }
+
+    if (!count)
+    {
+        if (!out.samples || concealRun >= maxConcealed)
+        {
+            // The gap is too long to hide, wait for the target depth again
+            buffering = true;
+            out.samples = 0;
+            concealRun = 0;
+            return nullptr;
+        }
+
+        const int gain = concealGain[concealRun++];
+        for (int16_t& sample : out.data)
+            sample = sample * gain / 256;
+
+        stats.concealed++;
+        if (arrival)
+            *arrival = 0;
+        samples = out.samples;
+        channels = out.channels;
+        sampleRate = out.sampleRate;
+        return out.data.constData();
+    }
+
+    concealRun = 0;
+
+    // Trim a standing excess, a transient burst drains by itself
+    if (count > targetDepth + 1)
+    {
+        if (++excessPops >= excessPopsToDrop)
+        {
+            excessPops = 0;
+            head = (head + 1) % maxDepth;
+            count--;
+            stats.dropped++;
+        }
+    }
+    else
+    {
+        excessPops = 0;
+    }
+
+    // Swap rather than copy, the ring slot gets out's old storage to reuse
+    Frame& frame = frames[head];
+    head = (head + 1) % maxDepth;
+    count--;
+    out.data.swap(frame.data);
+    out.samples = frame.samples;
+    out.channels = frame.channels;
+    out.sampleRate = frame.sampleRate;
+
+    stats.played++;
+    if (arrival)
+        *arrival = frame.arrival;
+    samples = out.samples;
+    channels = out.channels;
+    sampleRate = out.sampleRate;
+    return out.data.constData();
+}
+
+void AudioJitterBuffer::setOutputDepth(int frames)
+{
+    QMutexLocker lock(&mutex);
+    outputDepth = frames;
+}
+
+AudioJitterBuffer::Stats AudioJitterBuffer::getStats() const
+{
+    QMutexLocker lock(&mutex);
+    Stats s = stats;
+    s.depth = count;
+    s.targetDepth = targetDepth;
+    s.jitter = qRound(jitter);
+    s.latency = (count + outputDepth) * lastFrameMs;
+    return s;
+}
+
+void AudioJitterBuffer::updateTarget(int frameMs)
+{
+    // Enough frames to ride out twice the typical deviation, plus the one being played
+    int target = 1 + static_cast<int>(std::ceil(2.f * jitter / frameMs));
+    targetDepth = qBound(1, target, maxDepth / 2);
+}
+
+int AudioJitterBuffer::frameMs(const Frame& frame)
+{
+    return qMax(1, frame.samples * 1000 / frame.sampleRate);
+}
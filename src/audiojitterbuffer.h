@@ -0,0 +1,99 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef AUDIOJITTERBUFFER_H
+#define AUDIOJITTERBUFFER_H
+
+#include <QVector>
+#include <QMutex>
+#include <cstdint>
+
+/**
+ * Holds a call's received audio between the decoder and the output device.
+ * Frames are pushed as they arrive and popped whenever the output needs one,
+ * so playout is paced by the sound card. The target depth follows the measured
+ * inter-arrival jitter: on a good link only a frame or two wait here.
+ * Short gaps are concealed by fading the last frame out, a standing excess
+ * over the target is trimmed by dropping frames.
+ * push() may be called from any thread, the rest from the playout thread.
+ **/
+
+class AudioJitterBuffer
+{
+public:
+    struct Stats
+    {
+        int depth = 0; ///< Frames waiting to be played
+        int targetDepth = 0;
+        int jitter = 0; ///< Smoothed inter-arrival jitter, in ms
+        int latency = 0; ///< How long a frame arriving now waits before being heard, in ms
+        quint64 received = 0;
+        quint64 played = 0;
+        quint64 concealed = 0; ///< Frames made up because none arrived in time
+        quint64 dropped = 0; ///< Frames thrown away because too many were waiting
+    };
+
+    AudioJitterBuffer();
+
+    void reset(); ///< Call when a call starts
+
+    void push(const int16_t* data, int samples, unsigned channels, int sampleRate);
+
+    /// Next frame to play, valid until the next pop, or nullptr if we should play nothing
+    /// arrival is set to when it was pushed, in LatencyRecorder::now() time, or 0 for made up frames
+    const int16_t* pop(int& samples, unsigned& channels, int& sampleRate, qint64* arrival = nullptr);
+    void setOutputDepth(int frames); ///< Frames already queued in the output, for the latency estimate
+
+    Stats getStats() const;
+
+private:
+    struct Frame
+    {
+        QVector<int16_t> data;
+        int samples = 0;
+        unsigned channels = 0;
+        int sampleRate = 0;
+        qint64 arrival = 0;
+    };
+
+    void updateTarget(int frameMs);
+    static int frameMs(const Frame& frame);
+
+private:
+    static const int maxDepth = 16;
+    static const int maxConcealed = 3; ///< Consecutive made up frames before we go silent and rebuffer
+    static const int excessPopsToDrop = 25; ///< Pops above the target before we drop a frame
+    static const int pauseFrames = 4; ///< An arrival gap this many frames long is a pause in speech, not jitter
+
+    mutable QMutex mutex;
+    Frame frames[maxDepth];
+    int head, count;
+    int targetDepth;
+    float jitter;
+    qint64 lastArrival; ///< In µs, -1 before the first frame
+    int lastFrameMs;
+
+    // Playout side
+    Frame out;
+    bool buffering;
+    int concealRun;
+    int excessPops;
+    int outputDepth;
+
+    Stats stats;
+};
+
+#endif // AUDIOJITTERBUFFER_H
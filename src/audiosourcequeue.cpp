@@ -0,0 +1,137 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "audiosourcequeue.h"
+
+#include <QDebug>
+
+const int AudioSourceQueue::bufferCount;
+
+AudioSourceQueue::AudioSourceQueue()
+    : initialized{false}, source{0}, freeCount{0}, gain{1.f}
+{
+}
+
+AudioSourceQueue::~AudioSourceQueue()
+{
+    release();
+}
+
+bool AudioSourceQueue::init()
+{
+    alGetError();
+    alGenSources(1, &source);
+    if (alGetError() != AL_NO_ERROR)
+    {
+        qWarning() << "AudioSourceQueue: Can't create a source";
+        return false;
+    }
+
+    alGenBuffers(bufferCount, buffers);
+    if (alGetError() != AL_NO_ERROR)
+    {
+        qWarning() << "AudioSourceQueue: Can't create buffers";
+        alDeleteSources(1, &source);
+        return false;
+    }
+
+    for (int i = 0; i < bufferCount; ++i)
+        freeBuffers[i] = buffers[i];
+    freeCount = bufferCount;
+
+    alSourcei(source, AL_LOOPING, AL_FALSE);
+    alSourcef(source, AL_GAIN, gain);
+    initialized = true;
+    return true;
+}
+
+void AudioSourceQueue::release()
+{
+    if (!initialized)
+        return;
+
+    alSourceStop(source);
+    alSourcei(source, AL_BUFFER, 0);
+    alDeleteSources(1, &source);
+    alDeleteBuffers(bufferCount, buffers);
+    initialized = false;
+}
+
+void AudioSourceQueue::forget()
+{
+    initialized = false;
+}
+
+void AudioSourceQueue::reclaim()
+{
+    ALint processed = 0;
+    alGetSourcei(source, AL_BUFFERS_PROCESSED, &processed);
+    if (processed <= 0)
+        return;
+
+    alSourceUnqueueBuffers(source, processed, freeBuffers + freeCount);
+    freeCount += processed;
+}
+
+int AudioSourceQueue::pending()
+{
+    if (!initialized)
+        return 0;
+
+    reclaim();
+    return bufferCount - freeCount;
+}
+
+bool AudioSourceQueue::queue(const int16_t* data, int samples, unsigned channels, int sampleRate)
+{
+    if (!channels || channels > 2)
+    {
+        qWarning() << "AudioSourceQueue: Trying to play on" << channels << "channels! Giving up.";
+        return false;
+    }
+
+    if (!initialized && !init())
+        return false;
+
+    reclaim();
+    if (!freeCount)
+    {
+        qDebug() << "AudioSourceQueue: Dropped audio frame";
+        return false;
+    }
+
+    // A source with nothing left to play has stopped, or never started
+    const bool stopped = freeCount == bufferCount;
+
+    ALuint bufid = freeBuffers[--freeCount];
+    alBufferData(bufid, (channels == 1) ? AL_FORMAT_MONO16 : AL_FORMAT_STEREO16, data,
+                 samples * 2 * channels, sampleRate);
+    alSourceQueueBuffers(source, 1, &bufid);
+
+    if (stopped)
+        alSourcePlay(source);
+    return true;
+}
+
+void AudioSourceQueue::setGain(float gain)
+{
+    if (gain == this->gain)
+        return;
+
+    this->gain = gain;
+    if (initialized)
+        alSourcef(source, AL_GAIN, gain);
+}
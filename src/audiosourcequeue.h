@@ -0,0 +1,64 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef AUDIOSOURCEQUEUE_H
+#define AUDIOSOURCEQUEUE_H
+
+#include <cstdint>
+
+#if defined(__APPLE__) && defined(__MACH__)
+ #include <OpenAL/al.h>
+#else
+ #include <AL/al.h>
+#endif
+
+/**
+ * An OpenAL source streamed through a fixed set of buffers.
+ * The buffers are generated once, on first use, and only ever recycled
+ * from the processed end of the queue back onto its tail.
+ * The source state and gain are tracked here instead of asked from the driver.
+ * Not thread safe, the Audio output lock must be held around it.
+ **/
+
+class AudioSourceQueue
+{
+public:
+    static const int bufferCount = 16;
+
+    AudioSourceQueue();
+    ~AudioSourceQueue();
+
+    bool queue(const int16_t* data, int samples, unsigned channels, int sampleRate); ///< False if the frame was dropped
+    int pending(); ///< Buffers queued and not played yet
+    void setGain(float gain);
+
+    void forget(); ///< The AL objects died with their context, make new ones on next use
+
+private:
+    bool init();
+    void reclaim();
+    void release();
+
+private:
+    bool initialized;
+    ALuint source;
+    ALuint buffers[bufferCount];
+    ALuint freeBuffers[bufferCount];
+    int freeCount;
+    float gain;
+};
+
+#endif // AUDIOSOURCEQUEUE_H
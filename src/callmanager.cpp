@@ -0,0 +1,240 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "callmanager.h"
+
+#include <QThread>
+#include <QTimer>
+#include <QEvent>
+#include <QCoreApplication>
+#include <QMutexLocker>
+#include <QSemaphore>
+#include <QDebug>
+
+#include <memory>
+
+const int CallManager::maxWorkers;
+
+static const QEvent::Type workEventType = static_cast<QEvent::Type>(QEvent::registerEventType());
+
+/// Carries a function to a CallWorker
+class WorkEvent : public QEvent
+{
+public:
+    WorkEvent(std::function<void()> work)
+        : QEvent(workEventType), work{work}
+    {
+    }
+
+    std::function<void()> work;
+};
+
+/// Lives on a worker thread and runs the work posted to it
+class CallWorker : public QObject
+{
+public:
+    void post(std::function<void()> work)
+    {
+        QCoreApplication::postEvent(this, new WorkEvent(work));
+    }
+
+protected:
+    virtual bool event(QEvent* event)
+    {
+        if (event->type() != workEventType)
+            return QObject::event(event);
+
+        static_cast<WorkEvent*>(event)->work();
+        return true;
+    }
+};
+
+CallManager::CallManager()
+{
+    for (int i = 0; i < TOXAV_MAX_CALLS; ++i)
+    {
+        calls[i] = nullptr;
+        callWorker[i] = -1;
+    }
+
+    const int count = qBound(1, QThread::idealThreadCount(), maxWorkers);
+    for (int i = 0; i < count; ++i)
+    {
+        QThread* thread = new QThread();
+        thread->setObjectName(QString("qTox Call Worker %1").arg(i));
+        CallWorker* worker = new CallWorker();
+        worker->moveToThread(thread);
+        thread->start();
+
+        threads.append(thread);
+        workers.append(worker);
+        workerLoad.append(0);
+    }
+}
+
+CallManager::~CallManager()
+{
+    // The timers live on the workers, they have to be deleted there
+    for (int i = 0; i < TOXAV_MAX_CALLS; ++i)
+    {
+        if (ToxCall* call = calls[i])
+        {
+            workers[callWorker[i]]->post([call]()
+            {
+                delete call->sendVideoTimer;
+                delete call->playAudioTimer;
+                call->sendVideoTimer = call->playAudioTimer = nullptr;
+            });
+        }
+    }
+
+    // Quitting from the worker itself lets everything posted before run first
+    for (int i = 0; i < threads.size(); ++i)
+    {
+        workers[i]->post([](){QThread::currentThread()->quit();});
+        threads[i]->wait();
+        delete workers[i];
+        delete threads[i];
+    }
+
+    for (ToxCall* call : calls)
+        delete call;
+}
+
+ToxCall& CallManager::get(int callId)
+{
+    QMutexLocker lock(&mutex);
+    if (!calls[callId])
+    {
+        calls[callId] = new ToxCall();
+        calls[callId]->callId = callId;
+        callWorker[callId] = leastLoadedWorker();
+    }
+    return *calls[callId];
+}
+
+int CallManager::leastLoadedWorker() const
+{
+    int worker = 0;
+    for (int i = 1; i < workers.size(); ++i)
+        if (workerLoad[i] < workerLoad[worker])
+            worker = i;
+    return worker;
+}
+
+ToxCall* CallManager::find(int callId)
+{
+    QMutexLocker lock(&mutex);
+    return calls[callId];
+}
+
+void CallManager::setActive(int callId, bool active)
+{
+    ToxCall& call = get(callId);
+
+    QMutexLocker lock(&mutex);
+    if (call.active == active)
+        return;
+
+    if (active)
+    {
+        // Ringing calls don't count, so the load is only known now
+        const int from = callWorker[callId];
+        const int to = leastLoadedWorker();
+        if (to != from)
+        {
+            // The call's timers belong to the old worker, and what was posted there runs
+            // before anything posted to the new one
+            std::shared_ptr<QSemaphore> moved = std::make_shared<QSemaphore>();
+            ToxCall* movedCall = &call;
+            workers[from]->post([movedCall, moved]()
+            {
+                delete movedCall->sendVideoTimer;
+                delete movedCall->playAudioTimer;
+                movedCall->sendVideoTimer = movedCall->playAudioTimer = nullptr;
+                moved->release();
+            });
+            workers[to]->post([moved](){moved->acquire();});
+            callWorker[callId] = to;
+        }
+
+        activeCalls.append(callId);
+        workerLoad[to]++;
+    }
+    else
+    {
+        activeCalls.removeOne(callId);
+        workerLoad[callWorker[callId]]--;
+    }
+    call.active = active;
+}
+
+bool CallManager::anyActive() const
+{
+    QMutexLocker lock(&mutex);
+    return !activeCalls.isEmpty();
+}
+
+QList<int> CallManager::getActiveCalls() const
+{
+    QMutexLocker lock(&mutex);
+    return activeCalls;
+}
+
+void CallManager::post(int callId, std::function<void()> work)
+{
+    get(callId);
+
+    QMutexLocker lock(&mutex);
+    workers[callWorker[callId]]->post(work);
+}
+
+void CallManager::wait(int callId)
+{
+    get(callId);
+
+    QMutexLocker lock(&mutex);
+    QThread* thread = threads[callWorker[callId]];
+    if (QThread::currentThread() == thread)
+        return;
+
+    QSemaphore done;
+    workers[callWorker[callId]]->post([&done](){done.release();});
+    lock.unlock();
+    done.acquire();
+}
+
+void CallManager::runSync(int callId, std::function<void()> work)
+{
+    get(callId);
+
+    QMutexLocker lock(&mutex);
+    if (QThread::currentThread() == threads[callWorker[callId]])
+    {
+        lock.unlock();
+        work();
+        return;
+    }
+
+    QSemaphore done;
+    workers[callWorker[callId]]->post([&]()
+    {
+        work();
+        done.release();
+    });
+    lock.unlock();
+    done.acquire();
+}
@@ -0,0 +1,74 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef CALLMANAGER_H
+#define CALLMANAGER_H
+
+#include "coreav.h"
+#include "coredefines.h"
+#include <QMutex>
+#include <QList>
+#include <QVector>
+#include <functional>
+
+class QThread;
+class CallWorker;
+
+/**
+ * Owns the state of 1:1 calls and the threads their media work runs on.
+ * A call's state is allocated the first time its index is used, and reused by later calls.
+ * Each call runs on one of a few worker threads, one per core up to maxWorkers.
+ * When it becomes active it moves to the worker with the fewest active calls and stays there until it ends,
+ * its timers are recreated on the new worker. Simultaneous calls encode and play out
+ * in parallel, while the work of a single call always runs in order.
+ * Thread safe.
+ **/
+
+class CallManager
+{
+public:
+    static const int maxWorkers = 4;
+
+    CallManager();
+    ~CallManager(); ///< Stops the workers and frees the calls
+
+    ToxCall& get(int callId); ///< Allocates the call's state on first use
+    ToxCall* find(int callId); ///< nullptr if the call's state was never allocated
+
+    void setActive(int callId, bool active); ///< Keeps the index of active calls, picks the worker of a call starting
+    bool anyActive() const;
+    QList<int> getActiveCalls() const;
+
+    /// Runs work on the call's worker thread, after the work posted before it.
+    /// QObjects created there, like timers, live on that thread too.
+    void post(int callId, std::function<void()> work);
+    void wait(int callId); ///< Returns once the work posted so far for the call has run
+    void runSync(int callId, std::function<void()> work); ///< Posts work and waits for it, runs it right away on the worker itself
+
+private:
+    int leastLoadedWorker() const; ///< Call with mutex locked
+
+private:
+    mutable QMutex mutex;
+    ToxCall* calls[TOXAV_MAX_CALLS];
+    int callWorker[TOXAV_MAX_CALLS]; ///< Index of the worker each allocated call runs on
+    QList<int> activeCalls;
+    QVector<QThread*> threads;
+    QVector<CallWorker*> workers;
+    QVector<int> workerLoad; ///< Active calls pinned to each worker
+};
+
+#endif // CALLMANAGER_H
@@ -0,0 +1,284 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "callrecorder.h"
+#include "latencyrecorder.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QStandardPaths>
+#include <QMutexLocker>
+#include <QDebug>
+#include <QtEndian>
+
+// Ogg pages hold up to 255 lacing values, we also cut them every second of audio
+static const int maxPagePackets = 50;
+
+// Header type flags of an Ogg page
+static const int oggBos = 0x02;
+static const int oggEos = 0x04;
+
+// Samples decoders drop at the start, the usual encoder lookahead. Granule positions count them too
+static const int opusPreSkip = 312;
+
+static QVector<quint32> makeOggCrcTable()
+{
+    QVector<quint32> table(256);
+    for (quint32 i = 0; i < 256; ++i)
+    {
+        quint32 r = i << 24;
+        for (int j = 0; j < 8; ++j)
+            r = (r & 0x80000000) ? (r << 1) ^ 0x04c11db7 : r << 1;
+        table[i] = r;
+    }
+    return table;
+}
+
+static quint32 oggCrc(const QByteArray& data)
+{
+    static const QVector<quint32> table = makeOggCrcTable();
+
+    quint32 crc = 0;
+    for (char c : data)
+        crc = (crc << 8) ^ table[((crc >> 24) ^ uint8_t(c)) & 0xff];
+    return crc;
+}
+
+template <typename T>
+static void appendLE(QByteArray& data, T value)
+{
+    char bytes[sizeof(T)];
+    qToLittleEndian(value, reinterpret_cast<uchar*>(bytes));
+    data.append(bytes, sizeof(T));
+}
+
+CallRecorder::CallRecorder(const QString& basePath, int audioChannels, int audioSampleRate)
+    : basePath{basePath}, audioChannels{audioChannels}, audioSampleRate{audioSampleRate},
+      startTime{LatencyRecorder::now()}, exiting{false},
+      granule{0}, pagePackets{0}, pageSeq{0}, oggSerial{static_cast<quint32>(startTime)}, videoFrames{0}
+{
+    setObjectName("qTox Call Recorder");
+}
+
+CallRecorder::~CallRecorder()
+{
+    stop();
+}
+
+QString CallRecorder::recordingsDir()
+{
+    return QDir(QStandardPaths::writableLocation(QStandardPaths::MoviesLocation)).filePath("qTox");
+}
+
+void CallRecorder::writeAudio(const uint8_t* packet, int size, int samples)
+{
+    Packet p{false, QByteArray(reinterpret_cast<const char*>(packet), size), samples, QSize()};
+
+    QMutexLocker lock(&mutex);
+    queue.append(p);
+    wakeCond.wakeOne();
+}
+
+void CallRecorder::writeVideo(const uint8_t* frame, int size, QSize resolution)
+{
+    Packet p{true, QByteArray(reinterpret_cast<const char*>(frame), size),
+             (LatencyRecorder::now() - startTime) / 1000, resolution};
+
+    QMutexLocker lock(&mutex);
+    queue.append(p);
+    wakeCond.wakeOne();
+}
+
+void CallRecorder::stop()
+{
+    {
+        QMutexLocker lock(&mutex);
+        exiting = true;
+        wakeCond.wakeOne();
+    }
+    wait();
+}
+
+void CallRecorder::run()
+{
+    QDir().mkpath(QFileInfo(basePath).path());
+    audioFile.setFileName(basePath + ".opus");
+    if (audioFile.open(QIODevice::WriteOnly))
+        writeOpusHeaders();
+    else
+        qWarning() << "CallRecorder: Can't write to" << audioFile.fileName();
+
+    QList<Packet> packets;
+    forever
+    {
+        bool last;
+        {
+            QMutexLocker lock(&mutex);
+            while (queue.isEmpty() && !exiting)
+                wakeCond.wait(&mutex);
+            packets.swap(queue);
+            last = exiting;
+        }
+
+        for (const Packet& packet : packets)
+        {
+            if (packet.video)
+                writeVideoPacket(packet);
+            else
+                writeAudioPacket(packet);
+        }
+        packets.clear();
+
+        if (last)
+            break;
+    }
+
+    finish();
+}
+
+void CallRecorder::writeOpusHeaders()
+{
+    // RFC 7845, each header gets a page of its own
+    pageData = "OpusHead";
+    pageData.append(char(1)); // version
+    pageData.append(char(audioChannels));
+    appendLE<quint16>(pageData, opusPreSkip);
+    appendLE<quint32>(pageData, audioSampleRate);
+    appendLE<quint16>(pageData, 0); // output gain
+    pageData.append(char(0)); // mono or stereo mapping
+    pageLacing = {uint8_t(pageData.size())};
+    writeOggPage(oggBos);
+
+    const QByteArray vendor = "qTox";
+    pageData = "OpusTags";
+    appendLE<quint32>(pageData, vendor.size());
+    pageData.append(vendor);
+    appendLE<quint32>(pageData, 0); // no comments
+    pageLacing = {uint8_t(pageData.size())};
+    writeOggPage(0);
+
+    // The header pages have a granule position of 0, the audio starts after the pre-skip
+    granule = opusPreSkip;
+}
+
+void CallRecorder::writeAudioPacket(const Packet& packet)
+{
+    if (!audioFile.isOpen())
+        return;
+
+    QByteArray data = packet.data;
+    if (data.isEmpty())
+    {
+        // Nothing was encoded for this frame. A TOC byte with an empty CELT frame of the same
+        // duration keeps the timeline, decoders conceal it as silence
+        const int frameMs10 = packet.time * 10000 / audioSampleRate; // In tenths of ms
+        int config = 28;
+        for (int ms10 = 25; ms10 < frameMs10 && config < 31; ms10 *= 2)
+            config++;
+        data.append(char(config << 3 | (audioChannels == 2 ? 0x04 : 0)));
+    }
+
+    int size = data.size();
+    if (pageLacing.size() + size / 255 + 1 > 255)
+        writeOggPage(0);
+
+    for (; size >= 255; size -= 255)
+        pageLacing.append(255);
+    pageLacing.append(size);
+    pageData.append(data);
+    granule += packet.time;
+
+    if (++pagePackets >= maxPagePackets)
+        writeOggPage(0);
+}
+
+void CallRecorder::writeOggPage(int flags)
+{
+    QByteArray page = "OggS";
+    page.append(char(0)); // version
+    page.append(char(flags));
+    appendLE<qint64>(page, (flags & oggBos) ? 0 : granule);
+    appendLE<quint32>(page, oggSerial);
+    appendLE<quint32>(page, pageSeq++);
+    appendLE<quint32>(page, 0); // CRC, computed over the page with this field zeroed
+    page.append(char(pageLacing.size()));
+    page.append(reinterpret_cast<const char*>(pageLacing.constData()), pageLacing.size());
+    page.append(pageData);
+
+    const quint32 crc = oggCrc(page);
+    qToLittleEndian(crc, reinterpret_cast<uchar*>(page.data()) + 22);
+
+    if (audioFile.write(page) != page.size())
+        qWarning() << "CallRecorder: Failed to write to" << audioFile.fileName();
+
+    pageData.clear();
+    pageLacing.clear();
+    pagePackets = 0;
+}
+
+void CallRecorder::writeVideoPacket(const Packet& packet)
+{
+    if (!videoFile.isOpen())
+    {
+        videoFile.setFileName(basePath + ".ivf");
+        if (!videoFile.open(QIODevice::WriteOnly))
+        {
+            qWarning() << "CallRecorder: Can't write to" << videoFile.fileName();
+            return;
+        }
+
+        // The header's resolution is the first frame's, VP8 key frames carry their own
+        QByteArray header = "DKIF";
+        appendLE<quint16>(header, 0); // version
+        appendLE<quint16>(header, 32); // header size
+        header.append("VP80");
+        appendLE<quint16>(header, packet.resolution.width());
+        appendLE<quint16>(header, packet.resolution.height());
+        appendLE<quint32>(header, 1000); // timestamps in ms
+        appendLE<quint32>(header, 1);
+        appendLE<quint32>(header, 0); // frame count, filled in by finish()
+        appendLE<quint32>(header, 0);
+        videoFile.write(header);
+    }
+
+    QByteArray frameHeader;
+    appendLE<quint32>(frameHeader, packet.data.size());
+    appendLE<quint64>(frameHeader, packet.time);
+    videoFile.write(frameHeader);
+    videoFile.write(packet.data);
+    videoFrames++;
+}
+
+void CallRecorder::finish()
+{
+    if (audioFile.isOpen())
+    {
+        writeOggPage(oggEos);
+        audioFile.close();
+    }
+
+    if (videoFile.isOpen())
+    {
+        QByteArray count;
+        appendLE<quint32>(count, videoFrames);
+        videoFile.seek(24);
+        videoFile.write(count);
+        videoFile.close();
+    }
+
+    qDebug() << "CallRecorder: Saved" << basePath << "with" << qMax<qint64>(0, granule - opusPreSkip) / audioSampleRate << "s of audio and"
+             << videoFrames << "video frames";
+}
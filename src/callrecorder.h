@@ -0,0 +1,89 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef CALLRECORDER_H
+#define CALLRECORDER_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QFile>
+#include <QSize>
+#include <QVector>
+#include <cstdint>
+
+/**
+ * Saves a call's outgoing streams exactly as toxav encoded them, so recording
+ * costs a copy and sequential writes, never a second encoder.
+ * Opus packets go to an Ogg Opus file, VP8 frames to an IVF file.
+ * The write functions only queue, the files are written on the recorder's own thread.
+ **/
+
+class CallRecorder : public QThread
+{
+    Q_OBJECT
+public:
+    /// Files are named basePath.opus and basePath.ivf, the latter only once a video frame arrives
+    CallRecorder(const QString& basePath, int audioChannels, int audioSampleRate);
+    ~CallRecorder();
+
+    static QString recordingsDir(); ///< Where calls are recorded when the setting is on
+
+    void writeAudio(const uint8_t* packet, int size, int samples); ///< A size of 0 records a frame we didn't send
+    void writeVideo(const uint8_t* frame, int size, QSize resolution);
+    void stop(); ///< Writes what is queued, finalizes the files and blocks until the thread exited
+
+protected:
+    virtual void run();
+
+private:
+    struct Packet
+    {
+        bool video;
+        QByteArray data;
+        qint64 time; ///< Samples in the frame for audio, ms since the recording started for video
+        QSize resolution;
+    };
+
+    void writeAudioPacket(const Packet& packet);
+    void writeVideoPacket(const Packet& packet);
+    void writeOggPage(int flags);
+    void writeOpusHeaders();
+    void finish();
+
+private:
+    const QString basePath;
+    const int audioChannels;
+    const int audioSampleRate;
+    qint64 startTime; ///< LatencyRecorder::now() when the recording started, in µs
+
+    QMutex mutex;
+    QWaitCondition wakeCond;
+    QList<Packet> queue;
+    bool exiting;
+
+    // Writer thread only
+    QFile audioFile, videoFile;
+    QByteArray pageData;
+    QVector<uint8_t> pageLacing;
+    qint64 granule; ///< Audio samples written so far, plus the pre-skip
+    int pagePackets;
+    quint32 pageSeq;
+    quint32 oggSerial;
+    quint32 videoFrames;
+};
+
+#endif // CALLRECORDER_H
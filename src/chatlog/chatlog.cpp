@@ -422,12 +422,47 @@ void ChatLog::insertChatlineOnTop(const QList<ChatLine::Ptr>& newLines)
         combLines.push_back(l);
     }
 
+    bool laidOut = !lines.isEmpty() && !workerTimer->isActive();
+    qreal oldTop = laidOut ? lines.first()->sceneBoundingRect().top() : 0.0;
+
     lines = combLines;
 
+    // the selection moves with its lines
+    if(selectionMode != None)
+    {
+        selClickedRow += newLines.size();
+        selFirstRow += newLines.size();
+        selLastRow += newLines.size();
+    }
+
     scene->setItemIndexMethod(oldIndexMeth);
 
-    // redo layout
-    startResizeWorker();
+    if(!laidOut)
+    {
+        // redo layout
+        startResizeWorker();
+        return;
+    }
+
+    // only lay out the new lines, the old ones just move down
+    // and the view with them, so that older history can be inserted page by page
+    layout(0, newLines.size() - 1, useableWidth());
+    qreal deltaY = lines[newLines.size() - 1]->sceneBoundingRect().bottom() + lineSpacing - oldTop;
+    reposition(newLines.size(), lines.size() - 1, deltaY);
+
+    updateSceneRect();
+    verticalScrollBar()->setValue(verticalScrollBar()->value() + qRound(deltaY));
+
+    checkVisibility();
+    updateTypingNotification();
+    updateMultiSelectionRect();
+    checkNearTop();
+}
+
+void ChatLog::checkNearTop()
+{
+    if(!workerTimer->isActive() && verticalScrollBar()->value() < verticalScrollBar()->pageStep())
+        emit nearTop();
 }
 
 bool ChatLog::stickToBottom() const
@@ -650,6 +685,9 @@ void ChatLog::scrollContentsBy(int dx, int dy)
 {
     QGraphicsView::scrollContentsBy(dx, dy);
     checkVisibility();
+
+    if(dy > 0)
+        checkNearTop();
 }
 
 void ChatLog::resizeEvent(QResizeEvent* ev)
@@ -784,6 +822,8 @@ void ChatLog::onWorkerTimeout()
 
         // hidden during busy screen
         verticalScrollBar()->show();
+
+        checkNearTop();
     }
 }
 
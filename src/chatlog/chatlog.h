@@ -61,6 +61,7 @@ public:
 
 signals:
     void selectionChanged();
+    void nearTop(); ///< Less than a screen of lines above the view, time to insert older ones
 
 protected:
     QRectF calculateSceneRect() const;
@@ -78,6 +79,7 @@ protected:
     void checkVisibility();
     void scrollToBottom();
     void startResizeWorker();
+    void checkNearTop();
 
     virtual void mouseDoubleClickEvent(QMouseEvent* ev);
     virtual void mousePressEvent(QMouseEvent* ev);
@@ -22,6 +22,7 @@
 #include "widget/gui.h"
 #include "historykeeper.h"
 #include "src/audio.h"
+#include "src/callmanager.h"
 
 #include <tox/tox.h>
 
@@ -46,11 +47,12 @@ const QString Core::TOX_EXT = ".tox";
 QList<ToxFile> Core::fileSendQueue;
 QList<ToxFile> Core::fileRecvQueue;
 QHash<int, ToxGroupCall> Core::groupCalls;
+QMutex Core::groupCallsLock;
 QThread* Core::coreThread{nullptr};
 
 #define MAX_GROUP_MESSAGE_LEN 1024
 
-Core::Core(Camera* cam, QThread *CoreThread, QString loadPath) :
+Core::Core(VideoSource* cam, QThread *CoreThread, QString loadPath) :
     tox(nullptr), camera(cam), loadPath(loadPath), ready{false}
 {
     qDebug() << "Core: loading Tox from" << loadPath;
@@ -59,8 +61,6 @@ Core::Core(Camera* cam, QThread *CoreThread, QString loadPath) :
 
     Audio::getInstance();
 
-    videobuf = new uint8_t[videobufsize];
-
     for (int i = 0; i < ptCounter; i++)
         pwsaltedkeys[i] = nullptr;
 
@@ -71,16 +71,7 @@ Core::Core(Camera* cam, QThread *CoreThread, QString loadPath) :
     connect(&Settings::getInstance(), &Settings::dhtServerListChanged, this, &Core::process);
     connect(this, SIGNAL(fileTransferFinished(ToxFile)), this, SLOT(onFileTransferFinished(ToxFile)));
 
-    for (int i=0; i<TOXAV_MAX_CALLS;i++)
-    {
-        calls[i].active = false;
-        calls[i].alSource = 0;
-        calls[i].sendAudioTimer = new QTimer();
-        calls[i].sendVideoTimer = new QTimer();
-        calls[i].sendAudioTimer->moveToThread(coreThread);
-        calls[i].sendVideoTimer->moveToThread(coreThread);
-        connect(calls[i].sendVideoTimer, &QTimer::timeout, [this,i](){sendCallVideo(i);});
-    }
+    callManager = new CallManager();
 
     // OpenAL init
     QString outDevDescr = Settings::getInstance().getOutDev();
@@ -116,13 +107,11 @@ Core::~Core()
         coreThread->wait(500);
     }
 
-    deadifyTox();
+    // The call workers use toxav until they stop
+    delete callManager;
+    callManager = nullptr;
 
-    if (videobuf)
-    {
-        delete[] videobuf;
-        videobuf=nullptr;
-    }
+    deadifyTox();
 
     Audio::closeInput();
     Audio::closeOutput();
@@ -1046,7 +1035,8 @@ void Core::removeGroup(int groupId, bool fake)
         return;
     tox_del_groupchat(tox, groupId);
 
-    if (groupCalls[groupId].active)
+    ToxGroupCall* call = findGroupCall(groupId);
+    if (call && call->active)
         leaveGroupCall(groupId);
 }
 
@@ -1301,6 +1291,8 @@ void Core::switchConfiguration(const QString& profile)
 
     ready = false;
     GUI::setEnabled(false);
+    // The history's last writes still need its key
+    HistoryKeeper::resetInstance();
     clearPassword(ptMain);
     clearPassword(ptHistory);
 
@@ -1731,18 +1723,14 @@ void Core::setNospam(uint32_t nospam)
 
 void Core::resetCallSources()
 {
-    for (ToxGroupCall& call : groupCalls)
-        call.alSources.clear();
-
-    for (ToxCall& call : calls)
     {
-        if (call.active && call.alSource)
-        {
-            ALuint tmp = call.alSource;
-            call.alSource = 0;
-            alDeleteSources(1, &tmp);
-
-            alGenSources(1, &call.alSource);
-        }
+        QMutexLocker lock(&groupCallsLock);
+        for (ToxGroupCall& call : groupCalls)
+            if (call.alOutput)
+                call.alOutput->forget();
     }
+
+    for (int i = 0; i < TOXAV_MAX_CALLS; ++i)
+        if (ToxCall* call = callManager->find(i))
+            call->alOutput.forget();
 }
@@ -28,14 +28,11 @@
 #include "coredefines.h"
 
 template <typename T> class QList;
-class Camera;
 class QTimer;
 class QString;
 class CString;
 class VideoSource;
-#ifdef QTOX_FILTER_AUDIO
-class AudioFilterer;
-#endif
+class CallManager;
 
 class Core : public QObject
 {
@@ -43,7 +40,7 @@ class Core : public QObject
 public:
     enum PasswordType {ptMain = 0, ptHistory, ptCounter};
 
-    explicit Core(Camera* cam, QThread* coreThread, QString initialLoadPath);
+    explicit Core(VideoSource* cam, QThread* coreThread, QString initialLoadPath);
     static Core* getInstance(); ///< Returns the global widget's Core instance
     ~Core();
 
@@ -75,6 +72,8 @@ public:
     QPair<QByteArray, QByteArray> getKeypair() const; ///< Returns our public and private keys
 
     VideoSource* getVideoSourceFromCall(int callNumber); ///< Get a call's video source
+    static ToxCallStats getCallStats(int callId); ///< Snapshot of a call's statistics, taken on its worker, waits for the work queued before
+    static LatencyRecorder* getCallLatency(int callId); ///< Lives as long as Core, reset when the call starts
 
     bool anyActiveCalls(); ///< true is any calls are currently active (note: a call about to start is not yet active)
     bool isPasswordSet(PasswordType passtype);
@@ -138,12 +137,20 @@ public slots:
     static void enableGroupCallVol(int groupId);
     static bool isGroupCallMicEnabled(int groupId);
     static bool isGroupCallVolEnabled(int groupId);
+    static void removeGroupCallPeer(int groupId, int peerId); ///< The peers after it are renumbered, their audio, gain and mute start over
+    static void setGroupCallPeerGain(int groupId, int peerId, float gain); ///< 1.0 is unchanged
+    static float getGroupCallPeerGain(int groupId, int peerId);
+    static void setGroupCallPeerMuted(int groupId, int peerId, bool muted);
+    static bool isGroupCallPeerMuted(int groupId, int peerId);
+    static QHash<int, float> getGroupCallPeerLevels(int groupId); ///< Maps peer IDs to how loud they currently are, from 0 to 1
+    static bool isGroupCallSelfSpeaking(int groupId);
 
     void setPassword(QString& password, PasswordType passtype, uint8_t* salt = nullptr);
     void useOtherPassword(PasswordType type);
     void clearPassword(PasswordType passtype);
     QByteArray encryptData(const QByteArray& data, PasswordType passtype);
     QByteArray decryptData(const QByteArray& data, PasswordType passtype);
+    QByteArray getPasswordKey(PasswordType passtype); ///< A copy of the derived key, empty without a password
 
 signals:
     void connected();
@@ -220,6 +227,7 @@ signals:
     void avMediaChange(int friendId, int callIndex, bool videoEnabled);
     void avCallFailed(int friendId);
     void avRejected(int friendId, int callIndex);
+    void avSelfSpeaking(int friendId, int callIndex, bool speaking); ///< Our voice activity detector opened or closed
 
     void videoFrameReceived(vpx_image* frame);
 
@@ -256,15 +264,15 @@ private:
     static void onAvPeerTimeout(void* toxav, int32_t call_index, void* core);
     static void onAvMediaChange(void *toxav, int32_t call_index, void* core);
 
-    static void sendGroupCallAudio(int groupId, ToxAv* toxav);
-
     static void prepareCall(int friendId, int callId, ToxAv *toxav, bool videoEnabled);
+    static ToxGroupCall& getGroupCall(int groupId); ///< Creates the call's state on first use
+    static ToxGroupCall* findGroupCall(int groupId); ///< nullptr if the group never had a call
     static void cleanupCall(int callId);
     static void playCallAudio(void *toxav, int32_t callId, const int16_t *data, uint16_t samples, void *user_data); // Callback
-    static void sendCallAudio(int callId, ToxAv* toxav);
-    static void playAudioBuffer(ALuint alSource, const int16_t *data, int samples, unsigned channels, int sampleRate);
     static void playCallVideo(void *toxav, int32_t callId, const vpx_image_t* img, void *user_data);
-    void sendCallVideo(int callId);
+    void sendCallVideo(int callId); ///< On the call's worker, encodes the latest camera frame
+    void playCallAudioOutput(int callId); ///< On the call's worker
+    void sendCallAudio(int callId); ///< On the call's worker, encodes the frames the capture bus has for this call
 
     bool checkConnection();
 
@@ -283,21 +291,24 @@ private:
 
 private slots:
      void onFileTransferFinished(ToxFile file);
+     void sendCallAudioPacket(int callId, QByteArray packet, qint64 encoded); ///< Sends what a worker encoded, toxcore is not thread safe
+     void sendCallVideoFrame(int callId, QByteArray frame, QSize resolution, qint64 encodeUs, qint64 encoded);
+     void sendGroupCallAudio(int groupId);
+     void startGroupCallInput(int groupId); ///< Subscribes the group call to the capture bus, on the core thread
+     void stopGroupCallInput(int groupId);
 
 private:
     Tox* tox;
     ToxAv* toxav;
     QTimer *toxTimer, *fileTimer; //, *saveTimer;
-    Camera* camera;
+    VideoSource* camera; ///< Our local video source, the Camera unless Settings selects another one
     QString loadPath; // meaningless after start() is called
     QList<DhtServer> dhtServerList;
     int dhtServerId;
     static QList<ToxFile> fileSendQueue, fileRecvQueue;
-    static ToxCall calls[TOXAV_MAX_CALLS];
-#ifdef QTOX_FILTER_AUDIO
-    static AudioFilterer * filterer[TOXAV_MAX_CALLS];
-#endif
+    static CallManager* callManager;
     static QHash<int, ToxGroupCall> groupCalls; // Maps group IDs to ToxGroupCalls
+    static QMutex groupCallsLock; ///< Guards the hash itself, a call stays where it is once created
     QMutex fileSendMutex, messageSendMutex;
     bool ready;
 
@@ -313,9 +324,6 @@ private:
     void saveCurrentInformation();
     QString loadOldInformation();
 
-    static const int videobufsize;
-    static uint8_t* videobuf;
-
     static QThread *coreThread;
 
     friend class Audio; ///< Audio can access our calls directly to reduce latency
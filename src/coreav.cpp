@@ -15,76 +15,116 @@
 */
 
 #include "core.h"
-#include "video/camera.h"
+#include "video/videosource.h"
 #include "audio.h"
+#include "audiocapture.h"
+#include "groupaudiomixer.h"
+#include "callrecorder.h"
+#include "callmanager.h"
 #ifdef QTOX_FILTER_AUDIO
 #include "audiofilterer.h"
 #endif
 #include "misc/settings.h"
 #include <QDebug>
 #include <QTimer>
+#include <QElapsedTimer>
+#include <QDateTime>
+#include <QDir>
+#include <QRegExp>
 
-ToxCall Core::calls[TOXAV_MAX_CALLS];
-#ifdef QTOX_FILTER_AUDIO
-AudioFilterer * Core::filterer[TOXAV_MAX_CALLS] {nullptr};
-#endif
-const int Core::videobufsize{TOXAV_MAX_VIDEO_WIDTH * TOXAV_MAX_VIDEO_HEIGHT * 4};
-uint8_t* Core::videobuf;
+CallManager* Core::callManager{nullptr};
+
+// Look at each call's output queue twice per frame
+static const int playAudioInterval = 10;
+// Frames kept queued in OpenAL, the jitter buffer holds the rest
+static const int playAudioOutputFrames = 2;
 
 bool Core::anyActiveCalls()
 {
-    for (auto& call : calls)
-        if (call.active)
-            return true;
-    return false;
+    return callManager->anyActive();
 }
 
 void Core::prepareCall(int friendId, int callId, ToxAv* toxav, bool videoEnabled)
 {
     qDebug() << QString("Core: preparing call %1").arg(callId);
-    calls[callId].callId = callId;
-    calls[callId].friendId = friendId;
-    calls[callId].muteMic = false;
-    calls[callId].muteVol = false;
+    ToxCall& call = callManager->get(callId);
+    call.callId = callId;
+    call.friendId = friendId;
+    call.muteMic = false;
+    call.muteVol = false;
     // the following three lines are also now redundant from startCall, but are
     // necessary there for outbound and here for inbound
-    calls[callId].codecSettings = av_DefaultSettings;
-    calls[callId].codecSettings.max_video_width = TOXAV_MAX_VIDEO_WIDTH;
-    calls[callId].codecSettings.max_video_height = TOXAV_MAX_VIDEO_HEIGHT;
-    calls[callId].videoEnabled = videoEnabled;
+    call.codecSettings = av_DefaultSettings;
+    call.codecSettings.max_video_width = TOXAV_MAX_VIDEO_WIDTH;
+    call.codecSettings.max_video_height = TOXAV_MAX_VIDEO_HEIGHT;
+    call.videoEnabled = videoEnabled;
+    call.videoRate.reset(call.codecSettings.video_bitrate);
+    call.videoBuffer.resize(TOXAV_MAX_VIDEO_WIDTH * TOXAV_MAX_VIDEO_HEIGHT * 4);
     int r = toxav_prepare_transmission(toxav, callId, videoEnabled);
     if (r < 0)
         qWarning() << QString("Error starting call %1: toxav_prepare_transmission failed with %2").arg(callId).arg(r);
 
     // Audio
     Audio::suscribeInput();
-
-    // Go
-    calls[callId].active = true;
-    calls[callId].sendAudioTimer->setInterval(5);
-    calls[callId].sendAudioTimer->setSingleShot(true);
-    connect(calls[callId].sendAudioTimer, &QTimer::timeout, [=](){sendCallAudio(callId,toxav);});
-    calls[callId].sendAudioTimer->start();
-    calls[callId].sendVideoTimer->setInterval(50);
-    calls[callId].sendVideoTimer->setSingleShot(true);
-    if (calls[callId].videoEnabled)
+    call.audioInput = Audio::captureThread->subscribe([callId]()
     {
-        calls[callId].sendVideoTimer->start();
-        Camera::getInstance()->subscribe();
-    }
+        callManager->post(callId, [callId](){Core::getInstance()->sendCallAudio(callId);});
+    });
 
 #ifdef QTOX_FILTER_AUDIO
     if (Settings::getInstance().getFilterAudio())
     {
-        Core::filterer[callId] = new AudioFilterer();
-        filterer[callId]->startFilter(48000);
+        AudioFilterer* filterer = new AudioFilterer();
+        filterer->startFilter(48000);
+        call.audioInput->setFilterer(filterer);
     }
-    else
+#endif
+
+    call.audioOutput.reset();
+    const Settings& s = Settings::getInstance();
+    call.vad.reset(s.getSuppressSilence(), s.getVadThreshold(), s.getVadHangover(),
+                   av_DefaultSettings.audio_frame_duration);
+    call.latency.reset();
+
+    if (s.getRecordCalls())
     {
-        delete filterer[callId];
-        filterer[callId] = nullptr;
+        // Keep the friend's name readable but safe in a file name
+        QString name = Core::getInstance()->getFriendUsername(friendId);
+        name.replace(QRegExp("[^\\w\\- ]"), "_");
+        QString base = QDir(CallRecorder::recordingsDir()).filePath(
+                    QDateTime::currentDateTime().toString("yyyy-MM-dd hh-mm-ss ") + name);
+        call.recorder = new CallRecorder(base, av_DefaultSettings.audio_channels,
+                                         av_DefaultSettings.audio_sample_rate);
+        call.recorder->start();
     }
-#endif
+
+    // Go
+    callManager->setActive(callId, true);
+    if (call.videoEnabled)
+        Core::getInstance()->camera->subscribe();
+
+    // The timers live on the call's worker, so does everything they trigger
+    callManager->post(callId, [callId]()
+    {
+        ToxCall& call = callManager->get(callId);
+        if (!call.playAudioTimer)
+        {
+            call.playAudioTimer = new QTimer();
+            call.playAudioTimer->setTimerType(Qt::PreciseTimer);
+            call.playAudioTimer->setInterval(playAudioInterval);
+            QObject::connect(call.playAudioTimer, &QTimer::timeout,
+                             [callId](){Core::getInstance()->playCallAudioOutput(callId);});
+            call.sendVideoTimer = new QTimer();
+            call.sendVideoTimer->setSingleShot(true);
+            QObject::connect(call.sendVideoTimer, &QTimer::timeout,
+                             [callId](){Core::getInstance()->sendCallVideo(callId);});
+        }
+
+        call.playAudioTimer->start();
+        call.sendVideoTimer->setInterval(call.videoRate.frameInterval());
+        if (call.videoEnabled)
+            call.sendVideoTimer->start();
+    });
 }
 
 void Core::onAvMediaChange(void* toxav, int32_t callId, void* core)
@@ -99,18 +139,30 @@ void Core::onAvMediaChange(void* toxav, int32_t callId, void* core)
 
     qDebug() << "Core: Received media change from friend "<<friendId;
 
+    // Settings changes that keep the call type don't touch the camera or the video view
+    if ((settings.call_type == av_TypeVideo) == callManager->get(callId).videoEnabled)
+        return;
+
     if (settings.call_type == av_TypeAudio)
     {
-        calls[callId].videoEnabled = false;
-        calls[callId].sendVideoTimer->stop();
-        Camera::getInstance()->unsubscribe();
+        callManager->get(callId).videoEnabled = false;
+        callManager->post(callId, [callId]()
+        {
+            if (QTimer* timer = callManager->get(callId).sendVideoTimer)
+                timer->stop();
+        });
+        Core::getInstance()->camera->unsubscribe();
         emit ((Core*)core)->avMediaChange(friendId, callId, false);
     }
     else
     {
-        Camera::getInstance()->subscribe();
-        calls[callId].videoEnabled = true;
-        calls[callId].sendVideoTimer->start();
+        Core::getInstance()->camera->subscribe();
+        callManager->get(callId).videoEnabled = true;
+        callManager->post(callId, [callId]()
+        {
+            if (QTimer* timer = callManager->get(callId).sendVideoTimer)
+                timer->start();
+        });
         emit ((Core*)core)->avMediaChange(friendId, callId, true);
     }
     return;
@@ -155,14 +207,14 @@ void Core::answerCall(int callId)
 void Core::hangupCall(int callId)
 {
     qDebug() << QString("Core: hanging up call %1").arg(callId);
-    calls[callId].active = false;
+    callManager->setActive(callId, false);
     toxav_hangup(toxav, callId);
 }
 
 void Core::rejectCall(int callId)
 {
     qDebug() << QString("Core: rejecting call %1").arg(callId);
-    calls[callId].active = false;
+    callManager->setActive(callId, false);
     toxav_reject(toxav, callId, nullptr);
 }
 
@@ -178,7 +230,7 @@ void Core::startCall(int friendId, bool video)
         cSettings.call_type = av_TypeVideo;
         if (toxav_call(toxav, &callId, friendId, &cSettings, TOXAV_RINGING_TIME) == 0)
         {
-            calls[callId].videoEnabled=true;
+            callManager->get(callId).videoEnabled=true;
         }
         else
         {
@@ -193,7 +245,7 @@ void Core::startCall(int friendId, bool video)
         cSettings.call_type = av_TypeAudio;
         if (toxav_call(toxav, &callId, friendId, &cSettings, TOXAV_RINGING_TIME) == 0)
         {
-            calls[callId].videoEnabled=false;
+            callManager->get(callId).videoEnabled=false;
         }
         else
         {
@@ -207,19 +259,36 @@ void Core::startCall(int friendId, bool video)
 void Core::cancelCall(int callId, int friendId)
 {
     qDebug() << QString("Core: Cancelling call with %1").arg(friendId);
-    calls[callId].active = false;
+    callManager->setActive(callId, false);
     toxav_cancel(toxav, callId, friendId, nullptr);
 }
 
 void Core::cleanupCall(int callId)
 {
     qDebug() << QString("Core: cleaning up call %1").arg(callId);
-    calls[callId].active = false;
-    disconnect(calls[callId].sendAudioTimer,0,0,0);
-    calls[callId].sendAudioTimer->stop();
-    calls[callId].sendVideoTimer->stop();
-    if (calls[callId].videoEnabled)
-        Camera::getInstance()->unsubscribe();
+    ToxCall& call = callManager->get(callId);
+    callManager->setActive(callId, false);
+    if (call.videoEnabled)
+        Core::getInstance()->camera->unsubscribe();
+
+    // The worker may be encoding for this call, let it finish before toxav frees the codecs
+    callManager->post(callId, [callId]()
+    {
+        ToxCall& call = callManager->get(callId);
+        if (call.sendVideoTimer)
+        {
+            call.sendVideoTimer->stop();
+            call.playAudioTimer->stop();
+        }
+        if (call.audioInput)
+        {
+            Audio::captureThread->unsubscribe(call.audioInput);
+            call.audioInput = nullptr;
+        }
+        delete call.recorder; // Finalizes the files
+        call.recorder = nullptr;
+    });
+    callManager->wait(callId);
     Audio::unsuscribeInput();
     toxav_kill_transmission(Core::getInstance()->toxav, callId);
 }
@@ -228,91 +297,164 @@ void Core::playCallAudio(void* toxav, int32_t callId, const int16_t *data, uint1
 {
     Q_UNUSED(user_data);
 
-    if (!calls[callId].active)
+    if (!callManager->get(callId).active)
         return;
 
-    if (!calls[callId].alSource)
-        alGenSources(1, &calls[callId].alSource);
-
     ToxAvCSettings dest;
     if (toxav_get_peer_csettings((ToxAv*)toxav, callId, 0, &dest) == 0)
-        playAudioBuffer(calls[callId].alSource, data, samples, dest.audio_channels, dest.audio_sample_rate);
+        callManager->get(callId).audioOutput.push(data, samples, dest.audio_channels, dest.audio_sample_rate);
 }
 
-void Core::sendCallAudio(int callId, ToxAv* toxav)
+void Core::playCallAudioOutput(int callId)
 {
-    if (!calls[callId].active)
+    if (!callManager->get(callId).active)
         return;
 
-    if (calls[callId].muteMic || !Audio::isInputReady())
+    AudioSourceQueue& output = callManager->get(callId).alOutput;
+    int pending = Audio::setOutputGain(output, callManager->get(callId).muteVol ? 0.f : Audio::outputVolume);
+
+    // The sound card paces the playout, we only keep its queue short and never empty
+    AudioJitterBuffer& jitter = callManager->get(callId).audioOutput;
+    LatencyRecorder& latency = callManager->get(callId).latency;
+    int samples, sampleRate;
+    unsigned channels;
+    qint64 arrival;
+    while (pending < playAudioOutputFrames)
     {
-        calls[callId].sendAudioTimer->start();
-        return;
+        const int16_t* frame = jitter.pop(samples, channels, sampleRate, &arrival);
+        if (!frame)
+            break;
+        latency.recordSince(LatencyRecorder::AudioJitter, arrival);
+        // Everything queued before this frame has to be heard first
+        latency.record(LatencyRecorder::AudioPlayout, qint64(pending) * samples * 1000000 / sampleRate);
+        Audio::playAudioBuffer(output, frame, samples, channels, sampleRate);
+        pending++;
     }
+    jitter.setOutputDepth(pending);
+}
+
+void Core::sendCallAudio(int callId)
+{
+    ToxCall& call = callManager->get(callId);
+    AudioSubscriber* input = call.audioInput;
+    if (!input)
+        return;
 
-    const int framesize = (calls[callId].codecSettings.audio_frame_duration * calls[callId].codecSettings.audio_sample_rate) / 1000 * av_DefaultSettings.audio_channels;
+    const int framesize = Audio::captureThread->getFrameSize();
     const int bufsize = framesize * 2 * av_DefaultSettings.audio_channels;
-    uint8_t buf[bufsize];
+    uint8_t dest[bufsize];
+    VoiceActivityDetector& vad = call.vad;
+    LatencyRecorder& latency = call.latency;
+    CallRecorder* recorder = call.recorder;
+    const bool wasSpeaking = vad.isSpeaking();
 
-    if (Audio::tryCaptureSamples(buf, framesize))
+    // Always drain, a muted call must not hold back the bus
+    while (const int16_t* frame = input->peek())
     {
-#ifdef QTOX_FILTER_AUDIO
-        if (filterer[callId])
+        if (!call.active)
         {
-            // is a null op #ifndef ALC_LOOPBACK_CAPTURE_SAMPLES
-            Audio::getEchoesToFilter(filterer[callId], framesize);
-
-            filterer[callId]->filterAudio((int16_t*) buf, framesize);
+            input->pop();
+            continue;
         }
-#endif
 
-        uint8_t dest[bufsize];
-        int r;
-        if ((r = toxav_prepare_audio_frame(toxav, callId, dest, framesize*2, (int16_t*)buf, framesize)) < 0)
+        if (call.muteMic || !vad.process(frame, framesize * av_DefaultSettings.audio_channels))
         {
-            qDebug() << "Core: toxav_prepare_audio_frame error";
-            calls[callId].sendAudioTimer->start();
-            return;
+            if (recorder)
+                recorder->writeAudio(nullptr, 0, framesize);
         }
-
-        if ((r = toxav_send_audio(toxav, callId, dest, r)) < 0)
+        else
         {
-            qDebug() << "Core: toxav_send_audio error";
+            qint64 t = LatencyRecorder::now();
+            latency.recordSince(LatencyRecorder::AudioCapture, input->frameTimestamp());
+
+            int r;
+            if ((r = toxav_prepare_audio_frame(toxav, callId, dest, framesize*2, frame, framesize)) < 0)
+            {
+                qDebug() << "Core: toxav_prepare_audio_frame error";
+            }
+            else
+            {
+                latency.recordSince(LatencyRecorder::AudioEncode, t);
+                if (recorder)
+                    recorder->writeAudio(dest, r, framesize);
+
+                QMetaObject::invokeMethod(this, "sendCallAudioPacket", Qt::QueuedConnection, Q_ARG(int, callId),
+                                          Q_ARG(QByteArray, QByteArray((char*)dest, r)),
+                                          Q_ARG(qint64, LatencyRecorder::now()));
+            }
         }
+        input->pop();
     }
-    calls[callId].sendAudioTimer->start();
+
+    if (vad.isSpeaking() != wasSpeaking)
+        emit avSelfSpeaking(call.friendId, callId, vad.isSpeaking());
+}
+
+void Core::sendCallAudioPacket(int callId, QByteArray packet, qint64 encoded)
+{
+    if (!callManager->get(callId).active)
+        return;
+
+    if (toxav_send_audio(toxav, callId, (uint8_t*)packet.data(), packet.size()) < 0)
+        qDebug() << "Core: toxav_send_audio error";
+    else
+        callManager->get(callId).latency.recordSince(LatencyRecorder::AudioSend, encoded);
 }
 
 void Core::playCallVideo(void*, int32_t callId, const vpx_image_t* img, void *user_data)
 {
     Q_UNUSED(user_data);
 
-    if (!calls[callId].active || !calls[callId].videoEnabled)
+    if (!callManager->get(callId).active || !callManager->get(callId).videoEnabled)
         return;
 
-    calls[callId].videoSource.pushVPXFrame(img);
+    // toxav decoded the frame already, we can only time what follows
+    const qint64 received = LatencyRecorder::now();
+    callManager->get(callId).videoSource.pushVPXFrame(img, received);
+    callManager->get(callId).latency.recordSince(LatencyRecorder::VideoUnpack, received);
 }
 
 void Core::sendCallVideo(int callId)
 {
-    if (!calls[callId].active || !calls[callId].videoEnabled)
+    ToxCall& call = callManager->get(callId);
+    if (!call.active || !call.videoEnabled)
         return;
 
-    vpx_image frame = camera->getLastFrame().createVpxImage();
+    VideoRateController& rate = call.videoRate;
+    LatencyRecorder& latency = call.latency;
+
+    QElapsedTimer encodeTimer;
+    encodeTimer.start();
+
+    VideoFrame source = camera->getLastFrame();
+    latency.recordSince(LatencyRecorder::VideoCapture, source.timestamp);
+    vpx_image frame = source.downscaled(rate.targetResolution(source.resolution)).createVpxImage();
     if (frame.w && frame.h)
     {
+        const qint64 convertUs = encodeTimer.nsecsElapsed() / 1000;
+        latency.record(LatencyRecorder::VideoConvert, convertUs);
+
+        uint8_t* videobuf = (uint8_t*)call.videoBuffer.data();
         int result;
-        if ((result = toxav_prepare_video_frame(toxav, callId, videobuf, videobufsize, &frame)) < 0)
+        if ((result = toxav_prepare_video_frame(toxav, callId, videobuf, call.videoBuffer.size(), &frame)) < 0)
         {
             qDebug() << QString("Core: toxav_prepare_video_frame: error %1").arg(result);
             vpx_img_free(&frame);
-            calls[callId].sendVideoTimer->start();
+            call.sendVideoTimer->start();
             return;
         }
 
-        if ((result = toxav_send_video(toxav, callId, (uint8_t*)videobuf, result)) < 0)
-            qDebug() << QString("Core: toxav_send_video error: %1").arg(result);
+        const qint64 encodeUs = encodeTimer.nsecsElapsed() / 1000;
+        latency.record(LatencyRecorder::VideoEncode, encodeUs - convertUs);
+
+        const QSize resolution(frame.d_w, frame.d_h);
+        if (call.recorder)
+            call.recorder->writeVideo(videobuf, result, resolution);
 
+        QMetaObject::invokeMethod(this, "sendCallVideoFrame", Qt::QueuedConnection, Q_ARG(int, callId),
+                                  Q_ARG(QByteArray, QByteArray((char*)videobuf, result)),
+                                  Q_ARG(QSize, resolution), Q_ARG(qint64, encodeUs),
+                                  Q_ARG(qint64, LatencyRecorder::now()));
         vpx_img_free(&frame);
     }
     else
@@ -320,23 +462,45 @@ void Core::sendCallVideo(int callId)
         qDebug("Core::sendCallVideo: Invalid frame (bad camera ?)");
     }
 
-    calls[callId].sendVideoTimer->start();
+    call.sendVideoTimer->setInterval(rate.frameInterval());
+    call.sendVideoTimer->start();
+}
+
+void Core::sendCallVideoFrame(int callId, QByteArray frame, QSize resolution, qint64 encodeUs, qint64 encoded)
+{
+    ToxCall& call = callManager->get(callId);
+    if (!call.active || !call.videoEnabled)
+        return;
+
+    VideoRateController& rate = call.videoRate;
+    bool failed = false;
+    int result;
+    if ((result = toxav_send_video(toxav, callId, (uint8_t*)frame.data(), frame.size())) < 0)
+    {
+        qDebug() << QString("Core: toxav_send_video error: %1").arg(result);
+        failed = true;
+    }
+    else
+    {
+        call.latency.recordSince(LatencyRecorder::VideoSend, encoded);
+    }
+
+    rate.frameSent(resolution, encodeUs, frame.size(), failed);
 }
 
 void Core::micMuteToggle(int callId)
 {
-    if (calls[callId].active)
+    if (callManager->get(callId).active)
     {
-        calls[callId].muteMic = !calls[callId].muteMic;
+        callManager->get(callId).muteMic = !callManager->get(callId).muteMic.load();
     }
 }
 
 void Core::volMuteToggle(int callId)
 {
-    if (calls[callId].active)
+    if (callManager->get(callId).active)
     {
-        calls[callId].muteVol = !calls[callId].muteVol;
-        alSourcef(calls[callId].alSource, AL_GAIN, calls[callId].muteVol ? 0.f : 1.f);
+        callManager->get(callId).muteVol = !callManager->get(callId).muteVol.load(); // Applied by playCallAudioOutput
     }
 }
 
@@ -352,16 +516,7 @@ void Core::onAvCancel(void* _toxav, int32_t callId, void* core)
     }
     qDebug() << QString("Core: AV cancel from %1").arg(friendId);
 
-    calls[callId].active = false;
-
-#ifdef QTOX_FILTER_AUDIO
-    if (filterer[callId])
-    {
-        filterer[callId]->closeFilter();
-        delete filterer[callId];
-        filterer[callId] = nullptr;
-    }
-#endif
+    callManager->setActive(callId, false);
 
     emit static_cast<Core*>(core)->avCancel(friendId, callId);
 }
@@ -409,7 +564,7 @@ void Core::onAvRinging(void* _toxav, int32_t call_index, void* core)
         return;
     }
 
-    if (calls[call_index].videoEnabled)
+    if (callManager->get(call_index).videoEnabled)
     {
         qDebug() << QString("Core: AV ringing with %1 with video").arg(friendId);
         emit static_cast<Core*>(core)->avRinging(friendId, call_index, true);
@@ -527,148 +682,221 @@ void Core::onAvStart(void* _toxav, int32_t call_index, void* core)
 }
 
 // This function's logic was shamelessly stolen from uTox
-void Core::playAudioBuffer(ALuint alSource, const int16_t *data, int samples, unsigned channels, int sampleRate)
+VideoSource *Core::getVideoSourceFromCall(int callNumber)
 {
-    if (!channels || channels > 2)
-    {
-        qWarning() << "Core::playAudioBuffer: trying to play on "<<channels<<" channels! Giving up.";
-        return;
-    }
-
-    ALuint bufid;
-    ALint processed = 0, queued = 16;
-    alGetSourcei(alSource, AL_BUFFERS_PROCESSED, &processed);
-    alGetSourcei(alSource, AL_BUFFERS_QUEUED, &queued);
-    alSourcei(alSource, AL_LOOPING, AL_FALSE);
-
-    if (processed)
-    {
-        ALuint bufids[processed];
-        alSourceUnqueueBuffers(alSource, processed, bufids);
-        alDeleteBuffers(processed - 1, bufids + 1);
-        bufid = bufids[0];
-    }
-    else if (queued < 32)
-    {
-        alGenBuffers(1, &bufid);
-    }
-    else
-    {
-        qDebug() << "Core: Dropped audio frame";
-        return;
-    }
-
-    alBufferData(bufid, (channels == 1) ? AL_FORMAT_MONO16 : AL_FORMAT_STEREO16, data,
-                    samples * 2 * channels, sampleRate);
-    alSourceQueueBuffers(alSource, 1, &bufid);
+    return &callManager->get(callNumber).videoSource;
+}
 
-    ALint state;
-    alGetSourcei(alSource, AL_SOURCE_STATE, &state);
-    alSourcef(alSource, AL_GAIN, Audio::outputVolume);
-    if (state != AL_PLAYING)
-    {
-        alSourcePlay(alSource);
-        //qDebug() << "Core: Starting audio source " << (int)alSource;
-    }
+LatencyRecorder* Core::getCallLatency(int callId)
+{
+    return &callManager->get(callId).latency;
 }
 
-VideoSource *Core::getVideoSourceFromCall(int callNumber)
+ToxCallStats Core::getCallStats(int callId)
 {
-    return &calls[callNumber].videoSource;
+    ToxCallStats stats;
+    if (callId < 0 || callId >= TOXAV_MAX_CALLS || !callManager->find(callId))
+        return stats;
+
+    // The worker owns the call's media state, audioInput is deleted there when the call ends
+    callManager->runSync(callId, [&stats, callId]()
+    {
+        ToxCall& call = callManager->get(callId);
+        stats.video = call.videoRate.getStats();
+        stats.audio = call.audioOutput.getStats();
+        stats.vad = call.vad.getStats();
+        if (AudioSubscriber* input = call.audioInput)
+        {
+            stats.audioInputOverruns = input->getOverruns();
+            stats.audioInputUnderruns = input->getUnderruns();
+        }
+    });
+    return stats;
 }
 
 void Core::joinGroupCall(int groupId)
 {
     qDebug() << QString("Core: Joining group call %1").arg(groupId);
-    groupCalls[groupId].groupId = groupId;
-    groupCalls[groupId].muteMic = false;
-    groupCalls[groupId].muteVol = false;
+    ToxGroupCall& call = getGroupCall(groupId);
+    call.groupId = groupId;
+    call.muteMic = false;
+    call.muteVol = false;
     // the following three lines are also now redundant from startCall, but are
     // necessary there for outbound and here for inbound
-    groupCalls[groupId].codecSettings = av_DefaultSettings;
-    groupCalls[groupId].codecSettings.max_video_width = TOXAV_MAX_VIDEO_WIDTH;
-    groupCalls[groupId].codecSettings.max_video_height = TOXAV_MAX_VIDEO_HEIGHT;
+    call.codecSettings = av_DefaultSettings;
+    call.codecSettings.max_video_width = TOXAV_MAX_VIDEO_WIDTH;
+    call.codecSettings.max_video_height = TOXAV_MAX_VIDEO_HEIGHT;
 
     // Audio
+    if (!call.mixer)
+    {
+        const int framesize = av_DefaultSettings.audio_frame_duration * av_DefaultSettings.audio_sample_rate / 1000;
+        call.mixer = new GroupAudioMixer(framesize, av_DefaultSettings.audio_channels,
+                                         av_DefaultSettings.audio_sample_rate);
+        call.alOutput = new AudioSourceQueue();
+    }
+
     Audio::suscribeInput();
+    QMetaObject::invokeMethod(Core::getInstance(), "startGroupCallInput", Qt::QueuedConnection, Q_ARG(int, groupId));
 
     // Go
-    Core* core = Core::getInstance();
-    ToxAv* toxav = core->toxav;
-
-    groupCalls[groupId].sendAudioTimer = new QTimer();
-    groupCalls[groupId].active = true;
-    groupCalls[groupId].sendAudioTimer->setInterval(5);
-    groupCalls[groupId].sendAudioTimer->setSingleShot(true);
-    connect(groupCalls[groupId].sendAudioTimer, &QTimer::timeout, [=](){sendGroupCallAudio(groupId,toxav);});
-    groupCalls[groupId].sendAudioTimer->start();
+    call.active = true;
 }
 
 void Core::leaveGroupCall(int groupId)
 {
     qDebug() << QString("Core: Leaving group call %1").arg(groupId);
-    groupCalls[groupId].active = false;
-    disconnect(groupCalls[groupId].sendAudioTimer,0,0,0);
-    groupCalls[groupId].sendAudioTimer->stop();
-    groupCalls[groupId].alSources.clear();
+    getGroupCall(groupId).active = false;
+    Audio::releaseGroupAudio(groupId);
+    QMetaObject::invokeMethod(Core::getInstance(), "stopGroupCallInput", Qt::QueuedConnection, Q_ARG(int, groupId));
     Audio::unsuscribeInput();
-    delete groupCalls[groupId].sendAudioTimer;
 }
 
-void Core::sendGroupCallAudio(int groupId, ToxAv* toxav)
+void Core::startGroupCallInput(int groupId)
 {
-    if (!groupCalls[groupId].active)
-        return;
+    ToxGroupCall& call = getGroupCall(groupId);
+    if (!call.vad)
+        call.vad = new VoiceActivityDetector();
+    const Settings& s = Settings::getInstance();
+    call.vad->reset(s.getSuppressSilence(), s.getVadThreshold(), s.getVadHangover(),
+                    av_DefaultSettings.audio_frame_duration);
+    call.selfSpeaking = false;
 
-    if (groupCalls[groupId].muteMic || !Audio::isInputReady())
+    if (!call.audioInput)
     {
-        groupCalls[groupId].sendAudioTimer->start();
-        return;
+        call.audioInput = Audio::captureThread->subscribe([groupId]()
+        {
+            QMetaObject::invokeMethod(Core::getInstance(), "sendGroupCallAudio", Qt::QueuedConnection, Q_ARG(int, groupId));
+        });
     }
+}
 
-    const int framesize = (groupCalls[groupId].codecSettings.audio_frame_duration * groupCalls[groupId].codecSettings.audio_sample_rate) / 1000 * av_DefaultSettings.audio_channels;
-    const int bufsize = framesize * 2 * av_DefaultSettings.audio_channels;
-    uint8_t buf[bufsize];
+void Core::stopGroupCallInput(int groupId)
+{
+    ToxGroupCall& call = getGroupCall(groupId);
+    if (call.active)
+        return; // Joined again in the meantime
+
+    if (call.audioInput)
+    {
+        Audio::captureThread->unsubscribe(call.audioInput);
+        call.audioInput = nullptr;
+    }
+    delete call.vad;
+    call.vad = nullptr;
+    call.selfSpeaking = false;
+}
 
-    if (Audio::tryCaptureSamples(buf, framesize))
+void Core::sendGroupCallAudio(int groupId)
+{
+    ToxGroupCall* it = findGroupCall(groupId);
+    if (!it || !it->audioInput)
+        return;
+
+    const int framesize = Audio::captureThread->getFrameSize();
+    while (const int16_t* frame = it->audioInput->peek())
     {
-        if (toxav_group_send_audio(toxav_get_tox(toxav), groupId, (int16_t*)buf,
-                framesize, av_DefaultSettings.audio_channels, av_DefaultSettings.audio_sample_rate) < 0)
+        if (it->active && !it->muteMic
+                && it->vad->process(frame, framesize * av_DefaultSettings.audio_channels))
         {
-            qDebug() << "Core: toxav_group_send_audio error";
-            groupCalls[groupId].sendAudioTimer->start();
-            return;
+            if (toxav_group_send_audio(toxav_get_tox(toxav), groupId, frame,
+                    framesize, av_DefaultSettings.audio_channels, av_DefaultSettings.audio_sample_rate) < 0)
+            {
+                qDebug() << "Core: toxav_group_send_audio error";
+            }
         }
+        it->audioInput->pop();
     }
-    groupCalls[groupId].sendAudioTimer->start();
+    it->selfSpeaking = it->vad->isSpeaking();
 }
 
 void Core::disableGroupCallMic(int groupId)
 {
-    groupCalls[groupId].muteMic = true;
+    getGroupCall(groupId).muteMic = true;
 }
 
 void Core::disableGroupCallVol(int groupId)
 {
-    groupCalls[groupId].muteVol = true;
+    getGroupCall(groupId).muteVol = true;
 }
 
 void Core::enableGroupCallMic(int groupId)
 {
-    groupCalls[groupId].muteMic = false;
+    getGroupCall(groupId).muteMic = false;
 }
 
 void Core::enableGroupCallVol(int groupId)
 {
-    groupCalls[groupId].muteVol = false;
+    getGroupCall(groupId).muteVol = false;
 }
 
 bool Core::isGroupCallMicEnabled(int groupId)
 {
-    return !groupCalls[groupId].muteMic;
+    return !getGroupCall(groupId).muteMic;
 }
 
 bool Core::isGroupCallVolEnabled(int groupId)
 {
-    return !groupCalls[groupId].muteVol;
+    return !getGroupCall(groupId).muteVol;
+}
+
+void Core::removeGroupCallPeer(int groupId, int peerId)
+{
+    // Toxcore moves the peers that follow into the gap, whatever they had buffered isn't theirs anymore
+    ToxGroupCall* call = findGroupCall(groupId);
+    if (call && call->mixer)
+        call->mixer->removePeersFrom(peerId);
+}
+
+void Core::setGroupCallPeerGain(int groupId, int peerId, float gain)
+{
+    ToxGroupCall* call = findGroupCall(groupId);
+    if (call && call->mixer)
+        call->mixer->setPeerGain(peerId, gain);
+}
+
+float Core::getGroupCallPeerGain(int groupId, int peerId)
+{
+    ToxGroupCall* call = findGroupCall(groupId);
+    return call && call->mixer ? call->mixer->getPeerGain(peerId) : 1.f;
+}
+
+void Core::setGroupCallPeerMuted(int groupId, int peerId, bool muted)
+{
+    ToxGroupCall* call = findGroupCall(groupId);
+    if (call && call->mixer)
+        call->mixer->setPeerMuted(peerId, muted);
+}
+
+bool Core::isGroupCallPeerMuted(int groupId, int peerId)
+{
+    ToxGroupCall* call = findGroupCall(groupId);
+    return call && call->mixer && call->mixer->isPeerMuted(peerId);
+}
+
+bool Core::isGroupCallSelfSpeaking(int groupId)
+{
+    ToxGroupCall* call = findGroupCall(groupId);
+    return call && call->selfSpeaking;
+}
+
+QHash<int, float> Core::getGroupCallPeerLevels(int groupId)
+{
+    ToxGroupCall* call = findGroupCall(groupId);
+    if (call && call->mixer)
+        return call->mixer->getPeerLevels();
+    return QHash<int, float>();
+}
+
+ToxGroupCall& Core::getGroupCall(int groupId)
+{
+    QMutexLocker lock(&groupCallsLock);
+    return groupCalls[groupId];
+}
+
+ToxGroupCall* Core::findGroupCall(int groupId)
+{
+    QMutexLocker lock(&groupCallsLock);
+    auto it = groupCalls.find(groupId);
+    return it == groupCalls.end() ? nullptr : &it.value();
 }
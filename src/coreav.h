@@ -4,6 +4,12 @@
 #include <QHash>
 #include <tox/toxav.h>
 #include "video/netvideosource.h"
+#include "video/videoratecontroller.h"
+#include "audiojitterbuffer.h"
+#include "audiosourcequeue.h"
+#include "voiceactivitydetector.h"
+#include "latencyrecorder.h"
+#include <atomic>
 
 #if defined(__APPLE__) && defined(__MACH__)
  #include <OpenAL/al.h>
@@ -14,30 +20,55 @@
 #endif
 
 class QTimer;
+class AudioSubscriber;
+class GroupAudioMixer;
+class CallRecorder;
 
 struct ToxCall
 {
     ToxAvCSettings codecSettings;
-    QTimer *sendAudioTimer, *sendVideoTimer;
-    int callId;
-    int friendId;
-    bool videoEnabled;
-    bool active;
-    bool muteMic;
-    bool muteVol;
-    ALuint alSource;
+    QTimer *sendVideoTimer = nullptr; ///< Created and used on the call's worker thread
+    QTimer *playAudioTimer = nullptr;
+    int callId = -1;
+    int friendId = -1;
+    // Set on the GUI and core threads, read by the call's worker
+    std::atomic<bool> videoEnabled{false};
+    std::atomic<bool> active{false}; ///< Set through CallManager::setActive to keep its index, read from any thread
+    std::atomic<bool> muteMic{false};
+    std::atomic<bool> muteVol{false};
+    AudioSourceQueue alOutput;
     NetVideoSource videoSource;
+    VideoRateController videoRate;
+    AudioSubscriber* audioInput = nullptr; ///< Our cursor on the capture bus while the call runs
+    AudioJitterBuffer audioOutput; ///< Received audio waiting for the output device
+    VoiceActivityDetector vad; ///< Decides which captured frames are worth sending
+    LatencyRecorder latency; ///< Time spent in each stage of the media pipeline, both ways
+    CallRecorder* recorder = nullptr; ///< Owned, set while the call is recorded
+    QByteArray videoBuffer; ///< Encoded video frames are written here
+};
+
+/// Snapshot of a call's media statistics, see Core::getCallStats
+struct ToxCallStats
+{
+    VideoRateController::Stats video; ///< Outgoing video and the decisions of the rate controller
+    AudioJitterBuffer::Stats audio; ///< Received audio
+    VoiceActivityDetector::Stats vad; ///< Sent audio
+    quint64 audioInputOverruns = 0; ///< Captured frames this call missed because it fell behind
+    quint64 audioInputUnderruns = 0; ///< Gaps in the captured audio this call had to send
 };
 
 struct ToxGroupCall
 {
     ToxAvCSettings codecSettings;
-    QTimer *sendAudioTimer;
     int groupId;
     bool active = false;
     bool muteMic;
     bool muteVol;
-    QHash<int, ALuint> alSources;
+    GroupAudioMixer* mixer = nullptr; ///< Owned, sums the peers' audio
+    AudioSourceQueue* alOutput = nullptr; ///< Owned, plays the mix
+    AudioSubscriber* audioInput = nullptr;
+    VoiceActivityDetector* vad = nullptr; ///< Owned, only used from the core thread
+    bool selfSpeaking = false;
 };
 
 #endif // COREAV_H
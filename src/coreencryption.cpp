@@ -131,6 +131,13 @@ QByteArray Core::decryptData(const QByteArray& data, PasswordType passtype)
     return QByteArray(reinterpret_cast<char*>(decrypted), sz);
 }
 
+QByteArray Core::getPasswordKey(PasswordType passtype)
+{
+    if (!pwsaltedkeys[passtype])
+        return QByteArray();
+    return QByteArray(reinterpret_cast<const char*>(pwsaltedkeys[passtype]), tox_pass_key_length());
+}
+
 bool Core::isPasswordSet(PasswordType passtype)
 {
     if (pwsaltedkeys[passtype])
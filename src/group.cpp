@@ -150,6 +150,11 @@ QStringList Group::getPeerList() const
     return peerNames;
 }
 
+QMap<int, QString> Group::getPeers() const
+{
+    return peers;
+}
+
 void Group::setEventFlag(int f)
 {
     hasNewMessages = f;
@@ -182,3 +187,15 @@ QString Group::resolveToxID(const ToxID &id) const
 
     return QString();
 }
+
+QString Group::getIdentity() const
+{
+    return identity;
+}
+
+void Group::setIdentity(const QByteArray &invite)
+{
+    // The invite is the inviter's group number followed by the group's identifier
+    if (invite.size() > 2)
+        identity = invite.mid(2).toHex().toUpper();
+}
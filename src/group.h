@@ -39,6 +39,7 @@ public:
     int getPeersCount() const;
     void regeneratePeerList();
     QStringList getPeerList() const;
+    QMap<int, QString> getPeers() const; ///< Maps peer numbers to names
 
     GroupChatForm *getChatForm();
     GroupWidget *getGroupWidget();
@@ -59,11 +60,17 @@ public:
 
     QString resolveToxID(const ToxID &id) const;
 
+    /// The group's history is kept under its identity. Groups we join take the identifier of their invite,
+    /// the ones we create have none, toxcore doesn't tell theirs, so they keep no history
+    QString getIdentity() const;
+    void setIdentity(const QByteArray &invite);
+
 private:
     GroupWidget* widget;
     GroupChatForm* chatForm;
     QMap<int, QString> peers;
     QMap<QString, QString> toxids;
+    QString identity;
     int hasNewMessages, userWasMentioned;
     int groupId;
     int nPeers;
@@ -0,0 +1,225 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "groupaudiomixer.h"
+
+#include <QDebug>
+#include <QMutexLocker>
+#include <cstring>
+#include <cstdlib>
+
+#if defined(__SSE2__)
+ #include <emmintrin.h>
+#elif defined(__ARM_NEON)
+ #include <arm_neon.h>
+#endif
+
+// Mixed levels decay by this much per frame, so a speaker stays lit between words
+static const float levelDecay = 0.85f;
+
+const int GroupAudioMixer::unityGain;
+const int GroupAudioMixer::primeFrames;
+const int GroupAudioMixer::maxFrames;
+
+GroupAudioMixer::GroupAudioMixer(int frameSize, unsigned channels, int sampleRate)
+    : frameSize{frameSize}, channels{channels}, sampleRate{sampleRate},
+      scratch(frameSize * channels)
+{
+}
+
+int GroupAudioMixer::getFrameSize() const
+{
+    return frameSize;
+}
+
+unsigned GroupAudioMixer::getChannels() const
+{
+    return channels;
+}
+
+int GroupAudioMixer::getSampleRate() const
+{
+    return sampleRate;
+}
+
+void GroupAudioMixer::pushPeerAudio(int peer, const int16_t* data, int samples, unsigned srcChannels, int srcRate)
+{
+    if (srcRate != sampleRate || !srcChannels || srcChannels > 2)
+    {
+        static bool warned = false;
+        if (!warned)
+            qWarning() << "GroupAudioMixer: Can't mix" << srcChannels << "channels at" << srcRate << "Hz";
+        warned = true;
+        return;
+    }
+
+    QMutexLocker lock(&mutex);
+    Peer& p = peers[peer];
+
+    const int capacity = maxFrames * frameSize * channels;
+    if (p.fifo.size() != capacity)
+        p.fifo.resize(capacity);
+
+    // Drop the oldest samples rather than grow, the peer's clock runs faster than ours
+    const int incoming = qMin(samples * static_cast<int>(channels), capacity);
+    if (p.fill + incoming > capacity)
+    {
+        const int excess = p.fill + incoming - capacity;
+        memmove(p.fifo.data(), p.fifo.data() + excess, (p.fill - excess) * sizeof(int16_t));
+        p.fill -= excess;
+    }
+
+    int16_t* dst = p.fifo.data() + p.fill;
+    const int frames = incoming / channels;
+    if (srcChannels == channels)
+    {
+        memcpy(dst, data, incoming * sizeof(int16_t));
+    }
+    else if (srcChannels == 1)
+    {
+        for (int i = 0; i < frames; ++i)
+            dst[2 * i] = dst[2 * i + 1] = data[i];
+    }
+    else
+    {
+        for (int i = 0; i < frames; ++i)
+            dst[i] = (data[2 * i] + data[2 * i + 1]) / 2;
+    }
+    p.fill += incoming;
+
+    if (p.fill >= primeFrames * frameSize * static_cast<int>(channels))
+        p.primed = true;
+}
+
+bool GroupAudioMixer::mix(int16_t* out)
+{
+    const int frameSamples = frameSize * channels;
+    bool mixed = false;
+
+    QMutexLocker lock(&mutex);
+    for (Peer& p : peers)
+    {
+        if (!p.primed)
+        {
+            p.level *= levelDecay;
+            continue;
+        }
+
+        if (!mixed)
+        {
+            memset(out, 0, frameSamples * sizeof(int16_t));
+            mixed = true;
+        }
+
+        const int n = qMin(p.fill, frameSamples);
+        const int16_t* src = p.fifo.constData();
+
+        int peak = 0;
+        for (int i = 0; i < n; ++i)
+            peak = qMax(peak, std::abs(static_cast<int>(src[i])));
+        p.level = qMax(peak / 32768.f, p.level * levelDecay);
+
+        if (!p.muted && p.gain)
+        {
+            if (p.gain != unityGain)
+            {
+                applyGain(scratch.data(), src, n, p.gain);
+                src = scratch.constData();
+            }
+            addSaturated(out, src, n);
+        }
+
+        p.fill -= n;
+        memmove(p.fifo.data(), p.fifo.data() + n, p.fill * sizeof(int16_t));
+
+        // Ran dry, wait for a couple of frames again instead of mixing every scrap
+        if (!p.fill)
+            p.primed = false;
+    }
+
+    return mixed;
+}
+
+void GroupAudioMixer::removePeersFrom(int peer)
+{
+    QMutexLocker lock(&mutex);
+    for (auto it = peers.begin(); it != peers.end();)
+    {
+        if (it.key() >= peer)
+            it = peers.erase(it);
+        else
+            ++it;
+    }
+}
+
+void GroupAudioMixer::setPeerGain(int peer, float gain)
+{
+    QMutexLocker lock(&mutex);
+    peers[peer].gain = qBound(0, static_cast<int>(gain * unityGain + 0.5f), 8 * unityGain - 1);
+}
+
+float GroupAudioMixer::getPeerGain(int peer) const
+{
+    QMutexLocker lock(&mutex);
+    auto it = peers.constFind(peer);
+    return it == peers.constEnd() ? 1.f : static_cast<float>(it->gain) / unityGain;
+}
+
+void GroupAudioMixer::setPeerMuted(int peer, bool muted)
+{
+    QMutexLocker lock(&mutex);
+    peers[peer].muted = muted;
+}
+
+bool GroupAudioMixer::isPeerMuted(int peer) const
+{
+    QMutexLocker lock(&mutex);
+    auto it = peers.constFind(peer);
+    return it != peers.constEnd() && it->muted;
+}
+
+QHash<int, float> GroupAudioMixer::getPeerLevels() const
+{
+    QMutexLocker lock(&mutex);
+    QHash<int, float> levels;
+    for (auto it = peers.constBegin(); it != peers.constEnd(); ++it)
+        levels[it.key()] = it->level;
+    return levels;
+}
+
+void GroupAudioMixer::applyGain(int16_t* dst, const int16_t* src, int count, int gain)
+{
+    for (int i = 0; i < count; ++i)
+        dst[i] = qBound(-32768, (src[i] * gain) >> 12, 32767);
+}
+
+void GroupAudioMixer::addSaturated(int16_t* dst, const int16_t* src, int count)
+{
+    int i = 0;
+#if defined(__SSE2__)
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_adds_epi16(a, b));
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 8 <= count; i += 8)
+        vst1q_s16(dst + i, vqaddq_s16(vld1q_s16(dst + i), vld1q_s16(src + i)));
+#endif
+    for (; i < count; ++i)
+        dst[i] = qBound(-32768, dst[i] + src[i], 32767);
+}
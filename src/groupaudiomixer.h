@@ -0,0 +1,83 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef GROUPAUDIOMIXER_H
+#define GROUPAUDIOMIXER_H
+
+#include <QHash>
+#include <QVector>
+#include <QMutex>
+#include <cstdint>
+
+/**
+ * Sums the received audio of every peer of a group call into a single stream.
+ * Peers are buffered separately and mixed with saturation, one output frame
+ * at a time, after their own gain and mute. Each peer's level is tracked
+ * for active speaker display.
+ * Doesn't touch OpenAL, so it can be driven by anything, see tools/qtox-bench-mixer.
+ * Thread safe.
+ **/
+
+class GroupAudioMixer
+{
+public:
+    GroupAudioMixer(int frameSize, unsigned channels, int sampleRate);
+
+    int getFrameSize() const; ///< Samples per channel in a mixed frame
+    unsigned getChannels() const;
+    int getSampleRate() const;
+
+    void pushPeerAudio(int peer, const int16_t* data, int samples, unsigned channels, int sampleRate);
+    bool mix(int16_t* out); ///< Writes the next frame, returns false and writes nothing if no peer is ready
+    void removePeersFrom(int peer); ///< Forgets the peer and every peer numbered after it, with their gain and mute
+
+    void setPeerGain(int peer, float gain); ///< 1.0 is unchanged
+    float getPeerGain(int peer) const;
+    void setPeerMuted(int peer, bool muted);
+    bool isPeerMuted(int peer) const;
+    QHash<int, float> getPeerLevels() const; ///< Decaying peak level of each peer, from 0 to 1
+
+    /// dst[i] += src[i] with saturation, vectorized where the CPU allows
+    static void addSaturated(int16_t* dst, const int16_t* src, int count);
+
+private:
+    struct Peer
+    {
+        QVector<int16_t> fifo; ///< Interleaved in the mixer's format
+        int fill = 0; ///< Samples in fifo, counting every channel
+        bool primed = false;
+        int gain = unityGain;
+        bool muted = false;
+        float level = 0;
+    };
+
+    static void applyGain(int16_t* dst, const int16_t* src, int count, int gain);
+
+private:
+    static const int unityGain = 1 << 12; ///< Peer gains are in 4.12 fixed point
+    static const int primeFrames = 2; ///< A peer is mixed once it has this many frames
+    static const int maxFrames = 8; ///< Older samples are dropped beyond this
+
+    const int frameSize;
+    const unsigned channels;
+    const int sampleRate;
+
+    mutable QMutex mutex;
+    QHash<int, Peer> peers;
+    QVector<int16_t> scratch;
+};
+
+#endif // GROUPAUDIOMIXER_H
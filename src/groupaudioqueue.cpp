@@ -0,0 +1,112 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "groupaudioqueue.h"
+
+#include <cstring>
+
+GroupAudioQueue::GroupAudioQueue(int slots, int slotSamples)
+    : slotCount{slots}, slotSamples{slotSamples}, mask(slots - 1),
+      storage(slots * slotSamples), enqueuePos{0}, dequeuePos{0},
+      queued{0}, droppedFull{0}, droppedOversize{0}
+{
+    Q_ASSERT(slots && !(slots & (slots - 1)));
+
+    this->slots = new Slot[slots];
+    for (int i = 0; i < slots; ++i)
+    {
+        this->slots[i].seq.store(i, std::memory_order_relaxed);
+        this->slots[i].buffer = storage.data() + i * slotSamples;
+        this->slots[i].frame.data = this->slots[i].buffer;
+    }
+}
+
+GroupAudioQueue::~GroupAudioQueue()
+{
+    delete[] slots;
+}
+
+bool GroupAudioQueue::push(int group, int peer, const int16_t* data, unsigned samples, uint8_t channels, unsigned sampleRate)
+{
+    const unsigned total = samples * channels;
+    if (total > static_cast<unsigned>(slotSamples))
+    {
+        droppedOversize++;
+        return false;
+    }
+
+    // Claim a slot, see Dmitry Vyukov's bounded MPMC queue
+    Slot* slot;
+    uint64_t pos = enqueuePos.load(std::memory_order_relaxed);
+    for (;;)
+    {
+        slot = &slots[pos & mask];
+        const uint64_t seq = slot->seq.load(std::memory_order_acquire);
+        const int64_t diff = static_cast<int64_t>(seq - pos);
+        if (diff == 0)
+        {
+            if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        }
+        else if (diff < 0)
+        {
+            droppedFull++;
+            return false;
+        }
+        else
+        {
+            pos = enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+
+    Frame& frame = slot->frame;
+    memcpy(slot->buffer, data, total * sizeof(int16_t));
+    frame.group = group;
+    frame.peer = peer;
+    frame.samples = samples;
+    frame.channels = channels;
+    frame.sampleRate = sampleRate;
+
+    slot->seq.store(pos + 1, std::memory_order_release);
+    queued++;
+    return true;
+}
+
+bool GroupAudioQueue::front(Frame& frame)
+{
+    Slot& slot = slots[dequeuePos & mask];
+    if (slot.seq.load(std::memory_order_acquire) != dequeuePos + 1)
+        return false;
+
+    frame = slot.frame;
+    return true;
+}
+
+void GroupAudioQueue::pop()
+{
+    Slot& slot = slots[dequeuePos & mask];
+    slot.seq.store(dequeuePos + slotCount, std::memory_order_release);
+    dequeuePos++;
+}
+
+GroupAudioQueue::Stats GroupAudioQueue::getStats() const
+{
+    Stats stats;
+    stats.queued = queued;
+    stats.droppedFull = droppedFull;
+    stats.droppedOversize = droppedOversize;
+    return stats;
+}
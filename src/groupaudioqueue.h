@@ -0,0 +1,83 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef GROUPAUDIOQUEUE_H
+#define GROUPAUDIOQUEUE_H
+
+#include <QVector>
+#include <atomic>
+#include <cstdint>
+
+/**
+ * Hands group call audio from toxcore to the audio thread without ever blocking.
+ * A bounded multiple producer, single consumer queue whose slots each own a
+ * preallocated sample buffer: producers claim a slot, copy their frame in and
+ * publish it, the consumer reads it in place and gives the slot back.
+ * When every slot is taken the new frame is dropped, frames bigger than a slot
+ * are dropped too, both are counted.
+ **/
+
+class GroupAudioQueue
+{
+public:
+    struct Frame
+    {
+        int group;
+        int peer;
+        const int16_t* data;
+        unsigned samples;
+        uint8_t channels;
+        unsigned sampleRate;
+    };
+
+    struct Stats
+    {
+        quint64 queued = 0;
+        quint64 droppedFull = 0; ///< The audio thread was too far behind
+        quint64 droppedOversize = 0; ///< Frames that don't fit in a slot
+    };
+
+    GroupAudioQueue(int slots, int slotSamples); ///< slots must be a power of two
+    ~GroupAudioQueue();
+
+    /// Any thread, returns false if the frame was dropped
+    bool push(int group, int peer, const int16_t* data, unsigned samples, uint8_t channels, unsigned sampleRate);
+
+    bool front(Frame& frame); ///< Consumer side, false if empty. The data stays valid until pop()
+    void pop();
+
+    Stats getStats() const;
+
+private:
+    struct Slot
+    {
+        std::atomic<uint64_t> seq; ///< Position this slot is ready to be written at, or that plus one once written
+        int16_t* buffer;
+        Frame frame;
+    };
+
+    const int slotCount;
+    const int slotSamples;
+    const uint64_t mask;
+    Slot* slots;
+    QVector<int16_t> storage;
+    std::atomic<uint64_t> enqueuePos;
+    uint64_t dequeuePos;
+
+    std::atomic<quint64> queued, droppedFull, droppedOversize;
+};
+
+#endif // GROUPAUDIOQUEUE_H
@@ -17,6 +17,7 @@
 #include "historykeeper.h"
 #include "misc/settings.h"
 #include "core.h"
+#include "widget/gui.h"
 
 #include <QSqlError>
 #include <QFile>
@@ -25,44 +26,138 @@
 #include <QVariant>
 #include <QDebug>
 #include <QTemporaryFile>
+#include <QThread>
+#include <QEvent>
+#include <QCoreApplication>
+#include <QSemaphore>
+#include <QMutexLocker>
+#include <QPointer>
 
 #include "misc/db/plaindb.h"
 #include "misc/db/encrypteddb.h"
 
 static HistoryKeeper *historyInstance = nullptr;
 
+/// The migration at index i brings a database from schema version i to i + 1, in one transaction.
+/// The version is kept in the user_version pragma, append new migrations at the end.
+static const QList<QList<QString>> schemaMigrations =
+{
+    // 1: the tables of databases from before versioning
+    {
+        "CREATE TABLE IF NOT EXISTS history (id INTEGER PRIMARY KEY AUTOINCREMENT, timestamp INTEGER NOT NULL, "
+        "chat_id INTEGER NOT NULL, sender INTEGER NOT NULL, message TEXT NOT NULL);",
+        "CREATE TABLE IF NOT EXISTS aliases (id INTEGER PRIMARY KEY AUTOINCREMENT, user_id TEXT UNIQUE NOT NULL);",
+        "CREATE TABLE IF NOT EXISTS chats (id INTEGER PRIMARY KEY AUTOINCREMENT, name TEXT UNIQUE NOT NULL, ctype INTEGER NOT NULL);",
+        "CREATE TABLE IF NOT EXISTS sent_status (id INTEGER PRIMARY KEY AUTOINCREMENT, status INTEGER NOT NULL DEFAULT 0);",
+    },
+    // 2: the sent status moves into history, a chat's messages are looked up by time in an index.
+    // Messages without a sent status were sent.
+    {
+        "ALTER TABLE history ADD COLUMN status INTEGER NOT NULL DEFAULT 1;",
+        "UPDATE history SET status = 0 WHERE id IN (SELECT id FROM sent_status WHERE status = 0);",
+        "DROP TABLE sent_status;",
+        "CREATE INDEX history_chat_timestamp ON history (chat_id, timestamp);",
+    },
+    // 3: was the full text index, which SQLite may not have, see createFtsIndex
+    {
+    },
+};
+
+/// Full text index of the messages, kept in step by triggers. The chat is indexed as a word too,
+/// so a search only ranks the chat's matches, prefixes of 2 and 3 characters are indexed for search as you type
+static const QList<QString> ftsTable =
+{
+    "CREATE VIRTUAL TABLE history_fts USING fts5(message, chat_id, content='history', content_rowid='id', prefix='2 3');",
+    "INSERT INTO history_fts (history_fts, rank) VALUES ('rank', 'bm25(1.0, 0.0)');",
+};
+
+static const QList<QString> ftsTriggers =
+{
+    "CREATE TRIGGER history_fts_insert AFTER INSERT ON history BEGIN "
+    "INSERT INTO history_fts (rowid, message, chat_id) VALUES (new.id, new.message, new.chat_id); END;",
+    "CREATE TRIGGER history_fts_delete AFTER DELETE ON history BEGIN "
+    "INSERT INTO history_fts (history_fts, rowid, message, chat_id) VALUES ('delete', old.id, old.message, old.chat_id); END;",
+    "CREATE TRIGGER history_fts_update AFTER UPDATE OF message, chat_id ON history BEGIN "
+    "INSERT INTO history_fts (history_fts, rowid, message, chat_id) VALUES ('delete', old.id, old.message, old.chat_id); "
+    "INSERT INTO history_fts (rowid, message, chat_id) VALUES (new.id, new.message, new.chat_id); END;",
+    "INSERT INTO history_fts (history_fts) VALUES ('rebuild');",
+};
+
+static const QEvent::Type historyWorkEventType = static_cast<QEvent::Type>(QEvent::registerEventType());
+
+/// Carries a function to the HistoryWorker
+class HistoryWorkEvent : public QEvent
+{
+public:
+    HistoryWorkEvent(std::function<void()> work)
+        : QEvent(historyWorkEventType), work{work}
+    {
+    }
+
+    std::function<void()> work;
+};
+
+/// Lives on the database thread and runs the work posted to it
+class HistoryWorker : public QObject
+{
+public:
+    void post(std::function<void()> work)
+    {
+        QCoreApplication::postEvent(this, new HistoryWorkEvent(work));
+    }
+
+protected:
+    virtual bool event(QEvent* event)
+    {
+        if (event->type() != historyWorkEventType)
+            return QObject::event(event);
+
+        static_cast<HistoryWorkEvent*>(event)->work();
+        return true;
+    }
+};
+
 HistoryKeeper *HistoryKeeper::getInstance()
 {
     if (historyInstance == nullptr)
     {
+        // The tables are created by migrateSchema
         QList<QString> initLst;
-        initLst.push_back(QString("CREATE TABLE IF NOT EXISTS history (id INTEGER PRIMARY KEY AUTOINCREMENT, timestamp INTEGER NOT NULL, ") +
-                          QString("chat_id INTEGER NOT NULL, sender INTEGER NOT NULL, message TEXT NOT NULL);"));
-        initLst.push_back(QString("CREATE TABLE IF NOT EXISTS aliases (id INTEGER PRIMARY KEY AUTOINCREMENT, user_id TEXT UNIQUE NOT NULL);"));
-        initLst.push_back(QString("CREATE TABLE IF NOT EXISTS chats (id INTEGER PRIMARY KEY AUTOINCREMENT, name TEXT UNIQUE NOT NULL, ctype INTEGER NOT NULL);"));
-        initLst.push_back(QString("CREATE TABLE IF NOT EXISTS sent_status (id INTEGER PRIMARY KEY AUTOINCREMENT, status INTEGER NOT NULL DEFAULT 0);"));
 
         QString path(":memory:");
-        GenericDdInterface *dbIntf;
+        bool encrypted = false;
+        QByteArray key;
 
         if (Settings::getInstance().getEnableLogging())
         {
-            bool encrypted = Settings::getInstance().getEncryptLogs();
+            encrypted = Settings::getInstance().getEncryptLogs();
+            path = getHistoryPath();
+        }
+        if (encrypted)
+            key = Core::getInstance()->getPasswordKey(Core::ptHistory);
 
+        // The connection belongs to the thread that opens it, the constructor waits for it
+        bool unavailable = false;
+        auto openDb = [=, &unavailable]() -> GenericDdInterface*
+        {
             if (encrypted)
             {
-                path = getHistoryPath();
-                dbIntf = new EncryptedDb(path, initLst);
-
-                historyInstance = new HistoryKeeper(dbIntf);
-                return historyInstance;
-            } else {
-                path = getHistoryPath();
+                EncryptedDb* encryptedDb = new EncryptedDb(path, key, initLst);
+                unavailable = !encryptedDb->isOpen();
+                return encryptedDb;
             }
-        }
 
-        dbIntf = new PlainDb(path, initLst);
-        historyInstance = new HistoryKeeper(dbIntf);
+            return new PlainDb(path, initLst);
+        };
+
+        historyInstance = new HistoryKeeper(openDb, Settings::getInstance().getDbSyncType());
+
+        if (unavailable)
+            GUI::showWarning(QObject::tr("Encrypted chat history"),
+                             QObject::tr("The encrypted chat history can't be opened, it was left as it is.\nHistory will not be saved in this session!"));
+        else if (historyInstance->notMigrated)
+            GUI::showWarning(QObject::tr("Chat history"),
+                             QObject::tr("The chat history can't be updated for this version of qTox, it was left as it is.\nHistory will not be saved in this session!"));
     }
 
     return historyInstance;
@@ -79,16 +174,38 @@ bool HistoryKeeper::checkPassword(int encrypted)
     return true;
 }
 
-HistoryKeeper::HistoryKeeper(GenericDdInterface *db_) :
-    db(db_)
+HistoryKeeper::HistoryKeeper(std::function<GenericDdInterface*()> openDb, Db::syncType sType) :
+    db(nullptr), ftsIndex(false), notMigrated(false), writesSinceCompaction(0), messageID(0)
+{
+    dbThread = new QThread();
+    dbThread->setObjectName("qTox History");
+    worker = new HistoryWorker();
+    worker->moveToThread(dbThread);
+    dbThread->start();
+
+    guiWorker = new HistoryWorker();
+    guiWorker->moveToThread(QCoreApplication::instance()->thread());
+
+    runSync([=]()
+    {
+        db = openDb();
+        init(sType);
+    });
+
+    // Can take a while on a big file, the GUI doesn't wait for it
+    post([this](){compact();});
+}
+
+void HistoryKeeper::init(Db::syncType sType)
 {
     /*
      DB format
      chats:
       * name -> id map
        id      -- auto-incrementing number
-       name    -- chat's name (for user to user conversation it is opposite user public key)
-       ctype   -- chat type, reserved for group chats
+       name    -- chat's name (for user to user conversation it is opposite user public key,
+                  for group chats the group's identity)
+       ctype   -- chat type
 
      alisases:
       * user_id -> id map
@@ -101,160 +218,418 @@ HistoryKeeper::HistoryKeeper(GenericDdInterface *db_) :
        chat_id      -- current chat ID (resolves from chats table)
        sender       -- sender's ID (resolves from aliases table)
        message
+       status       -- 0 until the message was sent
     */
 
-    // for old tables:
-    QSqlQuery ans = db->exec("select seq from sqlite_sequence where name=\"history\";");
-    if (ans.first())
+    if (!migrateSchema())
     {
-        int idMax = ans.value(0).toInt();
-        QSqlQuery ret = db->exec("select seq from sqlite_sequence where name=\"sent_status\";");
-        int idCur = 0;
-        if (ret.first())
-        {
-            idCur = ret.value(0).toInt();
-        }
-
-        if (idCur != idMax)
-        {
-            QString cmd = QString("INSERT INTO sent_status (id, status) VALUES (%1, 1);").arg(idMax);
-            db->exec(cmd);
-        }
+        // Writing the old tables with the new statements would only fail or corrupt them
+        qWarning() << "HistoryKeeper: Keeping the history in memory, the file is left as it is";
+        notMigrated = true;
+        delete db;
+        db = new PlainDb(":memory:", QList<QString>());
+        migrateSchema();
     }
+    createFtsIndex();
 
     updateChatsID();
     updateAliases();
 
-    setSyncType(Settings::getInstance().getDbSyncType());
+    db->setSyncType(sType);
 
-    messageID = 0;
     QSqlQuery sqlAnswer = db->exec("select seq from sqlite_sequence where name=\"history\";");
     if (sqlAnswer.first())
         messageID = sqlAnswer.value(0).toLongLong();
 }
 
-HistoryKeeper::~HistoryKeeper()
+bool HistoryKeeper::migrateSchema()
 {
-    delete db;
+    QSqlQuery ans = db->exec("PRAGMA user_version;");
+    int version = ans.first() ? ans.value(0).toInt() : 0;
+    ans.finish();
+
+    for (; version < schemaMigrations.size(); ++version)
+    {
+        qDebug() << "HistoryKeeper: Migrating the schema from version" << version;
+
+        db->exec("BEGIN TRANSACTION;");
+        for (const QString &cmd : schemaMigrations[version])
+        {
+            QSqlError error = db->exec(cmd).lastError();
+            if (error.isValid())
+            {
+                qWarning() << "HistoryKeeper: Schema migration" << version + 1 << "failed:" << error.text();
+                db->exec("ROLLBACK TRANSACTION;");
+                return false;
+            }
+        }
+        db->exec(QString("PRAGMA user_version = %1;").arg(version + 1));
+        db->exec("COMMIT TRANSACTION;");
+    }
+    return true;
 }
 
-qint64 HistoryKeeper::addChatEntry(const QString& chat, const QString& message, const QString& sender, const QDateTime &dt, bool isSent)
+void HistoryKeeper::createFtsIndex()
 {
-    QList<QString> cmds = generateAddChatEntryCmd(chat, message, sender, dt, isSent);
+    // Tried in the temporary schema, the file isn't touched
+    ftsIndex = !db->exec("CREATE VIRTUAL TABLE temp.fts_probe USING fts5(x);").lastError().isValid();
+    if (ftsIndex)
+        db->exec("DROP TABLE temp.fts_probe;");
+
+    QSqlQuery ans = db->exec("SELECT count(*) FROM sqlite_master WHERE name = 'history_fts';");
+    const bool hasTable = ans.first() && ans.value(0).toInt() > 0;
+    ans.finish();
+    ans = db->exec("SELECT count(*) FROM sqlite_master WHERE type = 'trigger' AND name LIKE 'history_fts_%';");
+    const bool hasTriggers = ans.first() && ans.value(0).toInt() > 0;
+    ans.finish();
+
+    if (!ftsIndex)
+    {
+        // Without the module the triggers would fail every write, the index is rebuilt once it's back
+        qWarning() << "HistoryKeeper: SQLite has no FTS5, searching the history scans the chat";
+        if (hasTriggers)
+        {
+            db->exec("DROP TRIGGER IF EXISTS history_fts_insert;");
+            db->exec("DROP TRIGGER IF EXISTS history_fts_delete;");
+            db->exec("DROP TRIGGER IF EXISTS history_fts_update;");
+        }
+        return;
+    }
+    if (hasTable && hasTriggers)
+        return;
 
+    qDebug() << "HistoryKeeper: Building the full text index";
+    QList<QString> cmds = hasTable ? ftsTriggers : ftsTable + ftsTriggers;
     db->exec("BEGIN TRANSACTION;");
-    for (auto &it : cmds)
-        db->exec(it);
+    for (const QString &cmd : cmds)
+    {
+        QSqlError error = db->exec(cmd).lastError();
+        if (error.isValid())
+        {
+            qWarning() << "HistoryKeeper: Can't build the full text index:" << error.text();
+            db->exec("ROLLBACK TRANSACTION;");
+            ftsIndex = false;
+            return;
+        }
+    }
     db->exec("COMMIT TRANSACTION;");
+}
 
-    messageID++;
-    return messageID;
+HistoryKeeper::~HistoryKeeper()
+{
+    // The database's timers live on its thread, it has to be closed there.
+    // The thread quits in the same work, what's posted after it never runs against the closed database
+    worker->post([this]()
+    {
+        writeQueued();
+        delete db;
+        db = nullptr;
+        QThread::currentThread()->quit();
+    });
+    dbThread->wait();
+    delete worker;
+    delete dbThread;
+
+    // The callbacks already queued on the GUI thread still run first
+    guiWorker->deleteLater();
 }
 
-QList<HistoryKeeper::HistMessage> HistoryKeeper::getChatHistory(HistoryKeeper::ChatType ct, const QString &chat,
-                                                                const QDateTime &time_from, const QDateTime &time_to)
+void HistoryKeeper::post(std::function<void()> work)
 {
-    QList<HistMessage> res;
+    worker->post(work);
+}
 
-    qint64 time64_from = time_from.toMSecsSinceEpoch();
-    qint64 time64_to = time_to.toMSecsSinceEpoch();
+void HistoryKeeper::runSync(std::function<void()> work)
+{
+    if (QThread::currentThread() == dbThread)
+    {
+        work();
+        return;
+    }
 
-    int chat_id = getChatID(chat, ct).first;
+    QSemaphore done;
+    worker->post([&]()
+    {
+        work();
+        done.release();
+    });
+    done.acquire();
+}
 
-    QSqlQuery dbAnswer;
-    if (ct == ctSingle)
+void HistoryKeeper::queueWrite(Write write)
+{
+    // Only the first write queued since the last batch has to wake the thread
+    if (queue.isEmpty())
+        post([this](){writeQueued();});
+    queue.append(write);
+}
+
+void HistoryKeeper::writeQueued()
+{
+    QList<Write> writes;
     {
-        dbAnswer = db->exec(QString("SELECT history.id, timestamp, user_id, message, status FROM history LEFT JOIN sent_status ON history.id = sent_status.id ") +
-                            QString("INNER JOIN aliases ON history.sender = aliases.id AND timestamp BETWEEN %1 AND %2 AND chat_id = %3;")
-                            .arg(time64_from).arg(time64_to).arg(chat_id));
-    } else {
-        // no groupchats yet
+        QMutexLocker lock(&queueMutex);
+        writes.swap(queue);
     }
+    if (writes.isEmpty())
+        return;
 
-    while (dbAnswer.next())
+    QList<GenericDdInterface::Statement> statements;
+    for (const Write &write : writes)
+        statements += write();
+    db->write(statements);
+
+    // Posted, so the reads already waiting go first
+    writesSinceCompaction += writes.size();
+    if (writesSinceCompaction >= compactionWrites)
     {
-        qint64 id = dbAnswer.value(0).toLongLong();
-        qint64 timeInt = dbAnswer.value(1).toLongLong();
-        QString sender = dbAnswer.value(2).toString();
-        QString message = unWrapMessage(dbAnswer.value(3).toString());
-        bool isSent = true;
-        if (!dbAnswer.value(4).isNull())
-            isSent = dbAnswer.value(4).toBool();
+        writesSinceCompaction = 0;
+        post([this](){compact();});
+    }
+}
 
-        QDateTime time = QDateTime::fromMSecsSinceEpoch(timeInt);
+void HistoryKeeper::compact()
+{
+    writeQueued();
+    db->compactIfNeeded();
+}
 
-        res.push_back(HistMessage(id, "", sender, message, time, isSent));
-    }
+qint64 HistoryKeeper::addChatEntry(const QString& chat, const QString& message, const QString& sender, const QDateTime &dt, bool isSent)
+{
+    QMutexLocker lock(&queueMutex);
+    qint64 id = ++messageID;
+    queueWrite([=]()
+    {
+        return generateAddChatEntryCmd(id, ctSingle, chat, message, sender, dt, isSent);
+    });
 
-    return res;
+    return id;
 }
 
-QList<HistoryKeeper::HistMessage> HistoryKeeper::exportMessages()
+qint64 HistoryKeeper::addGroupChatEntry(const QString &chat, const QString &message, const QString &sender, const QDateTime &dt)
 {
-    QSqlQuery dbAnswer;
-    dbAnswer = db->exec(QString("SELECT history.id, timestamp, user_id, message, status, name FROM history LEFT JOIN sent_status ON history.id = sent_status.id ") +
-                        QString("INNER JOIN aliases ON history.sender = aliases.id INNER JOIN chats ON history.chat_id = chats.id;"));
+    // Busy groups add hundreds of messages a second, they only wait for the queue's mutex
+    QMutexLocker lock(&queueMutex);
+    qint64 id = ++messageID;
+    queueWrite([=]()
+    {
+        return generateAddChatEntryCmd(id, ctGroup, chat, message, sender, dt, true);
+    });
 
-    QList<HistMessage> res;
+    return id;
+}
 
-    while (dbAnswer.next())
+void HistoryKeeper::getChatHistoryPage(ChatType ct, const QString &chat, qint64 beforeTime, qint64 beforeId, int count,
+                                       QObject *receiver, std::function<void(QList<HistMessage>)> callback)
+{
+    QPointer<QObject> guard(receiver);
+    post([=]()
     {
-        qint64 id = dbAnswer.value(0).toLongLong();
-        qint64 timeInt = dbAnswer.value(1).toLongLong();
-        QString sender = dbAnswer.value(2).toString();
-        QString message = unWrapMessage(dbAnswer.value(3).toString());
-        bool isSent = true;
-        if (!dbAnswer.value(4).isNull())
-            isSent = dbAnswer.value(4).toBool();
-        QString chat = dbAnswer.value(5).toString();
-        QDateTime time = QDateTime::fromMSecsSinceEpoch(timeInt);
-
-        res.push_back(HistMessage(id, chat, sender, message, time, isSent));
-    }
+        writeQueued();
 
-    return res;
+        QList<HistMessage> res;
+        int chat_id = getChatID(chat, ct).first;
+
+        // Keyset paging walks history_chat_timestamp backwards from the key, whose rowid breaks ties,
+        // so a page costs the same however far back it is
+        QSqlQuery dbAnswer = db->exec(QString("SELECT history.id, timestamp, user_id, message, status FROM history INNER JOIN aliases ON history.sender = aliases.id ") +
+                                      QString("WHERE chat_id = ? AND (timestamp, history.id) < (?, ?) ORDER BY timestamp DESC, history.id DESC LIMIT ?;"),
+                                      {chat_id, beforeTime, beforeId, count});
+
+        while (dbAnswer.next())
+        {
+            qint64 id = dbAnswer.value(0).toLongLong();
+            qint64 timeInt = dbAnswer.value(1).toLongLong();
+            QString sender = dbAnswer.value(2).toString();
+            QString message = dbAnswer.value(3).toString();
+            bool isSent = dbAnswer.value(4).toBool();
+
+            QDateTime time = QDateTime::fromMSecsSinceEpoch(timeInt);
+
+            res.push_front(HistMessage(id, "", sender, message, time, isSent));
+        }
+
+        guiWorker->post([=]()
+        {
+            if (guard)
+                callback(res);
+        });
+    });
 }
 
-void HistoryKeeper::importMessages(const QList<HistoryKeeper::HistMessage> &lst)
+void HistoryKeeper::getUndeliveredMessages(const QString &chat, const QDateTime &since,
+                                           QObject *receiver, std::function<void(QList<HistMessage>)> callback)
 {
-    db->exec("BEGIN TRANSACTION;");
-    for (const HistMessage &msg : lst)
+    QPointer<QObject> guard(receiver);
+    post([=]()
     {
-        QList<QString> cmds = generateAddChatEntryCmd(msg.chat, msg.message, msg.sender, msg.timestamp, msg.isSent);
-        for (auto &it : cmds)
-            db->exec(it);
+        writeQueued();
 
-        messageID++;
-    }
-    db->exec("COMMIT TRANSACTION;");
+        QList<HistMessage> res;
+        int chat_id = getChatID(chat, ctSingle).first;
+
+        // Walks the chat's part of history_chat_timestamp from since, only the status is checked on each row
+        QSqlQuery dbAnswer = db->exec(QString("SELECT history.id, timestamp, user_id, message FROM history INNER JOIN aliases ON history.sender = aliases.id ") +
+                                      QString("WHERE chat_id = ? AND timestamp >= ? AND status = 0 ORDER BY timestamp, history.id;"),
+                                      {chat_id, since.toMSecsSinceEpoch()});
+
+        while (dbAnswer.next())
+        {
+            qint64 id = dbAnswer.value(0).toLongLong();
+            qint64 timeInt = dbAnswer.value(1).toLongLong();
+            QString sender = dbAnswer.value(2).toString();
+            QString message = dbAnswer.value(3).toString();
+
+            QDateTime time = QDateTime::fromMSecsSinceEpoch(timeInt);
+
+            res.push_back(HistMessage(id, "", sender, message, time, false));
+        }
+
+        guiWorker->post([=]()
+        {
+            if (guard)
+                callback(res);
+        });
+    });
 }
 
-QList<QString> HistoryKeeper::generateAddChatEntryCmd(const QString& chat, const QString& message, const QString& sender, const QDateTime &dt, bool isSent)
+void HistoryKeeper::searchChatHistory(ChatType ct, const QString &chat, const QString &phrase, int count,
+                                      QObject *receiver, std::function<void(QList<HistMessage>)> callback)
 {
-    QList<QString> cmds;
+    QPointer<QObject> guard(receiver);
+    post([=]()
+    {
+        writeQueued();
 
-    int chat_id = getChatID(chat, ctSingle).first;
-    int sender_id = getAliasID(sender);
+        QList<HistMessage> res;
+        int chat_id = getChatID(chat, ct).first;
+
+        QSqlQuery dbAnswer;
+        if (ftsIndex)
+        {
+            // Ranking costs a lookup per match, a common word can match most of a chat
+            dbAnswer = db->exec(QString("SELECT history.id, timestamp, user_id, message, status FROM ") +
+                                QString("(SELECT rowid, rank FROM history_fts WHERE history_fts MATCH ? ORDER BY rowid DESC LIMIT ?) AS hits ") +
+                                QString("INNER JOIN history ON history.id = hits.rowid INNER JOIN aliases ON history.sender = aliases.id ORDER BY hits.rank LIMIT ?;"),
+                                {toFtsQuery(chat_id, phrase), searchWindow, count});
+        }
+        else
+        {
+            // Latest first, each word anywhere in the message
+            QStringList words = phrase.simplified().split(' ', QString::SkipEmptyParts);
+            QString query("SELECT history.id, timestamp, user_id, message, status FROM history INNER JOIN aliases ON history.sender = aliases.id WHERE chat_id = ?");
+            QVariantList values{chat_id};
+            for (QString &word : words)
+            {
+                query += " AND message LIKE ? ESCAPE '\\'";
+                values << "%" + word.replace("\\", "\\\\").replace("%", "\\%").replace("_", "\\_") + "%";
+            }
+            values << count;
+            dbAnswer = db->exec(query + " ORDER BY timestamp DESC, history.id DESC LIMIT ?;", values);
+        }
 
-    cmds.push_back(QString("INSERT INTO history (timestamp, chat_id, sender, message) VALUES (%1, %2, %3, '%4');")
-                   .arg(dt.toMSecsSinceEpoch()).arg(chat_id).arg(sender_id).arg(wrapMessage(message)));
-    cmds.push_back(QString("INSERT INTO sent_status (status) VALUES (%1);").arg(isSent));
+        while (dbAnswer.next())
+        {
+            qint64 id = dbAnswer.value(0).toLongLong();
+            qint64 timeInt = dbAnswer.value(1).toLongLong();
+            QString sender = dbAnswer.value(2).toString();
+            QString message = dbAnswer.value(3).toString();
+            bool isSent = dbAnswer.value(4).toBool();
 
-    return cmds;
+            QDateTime time = QDateTime::fromMSecsSinceEpoch(timeInt);
+
+            res.push_back(HistMessage(id, "", sender, message, time, isSent));
+        }
+
+        guiWorker->post([=]()
+        {
+            if (guard)
+                callback(res);
+        });
+    });
+}
+
+QString HistoryKeeper::toFtsQuery(int chat_id, const QString &phrase)
+{
+    // Every word is quoted, what the user typed is never taken as FTS syntax
+    QStringList words = phrase.simplified().split(' ', QString::SkipEmptyParts);
+    // A single character would match too many words
+    bool prefix = !words.isEmpty() && words.last().length() > 1;
+    for (QString &word : words)
+        word = "\"" + word.replace("\"", "\"\"") + "\"";
+
+    if (prefix)
+        words.last() += "*";
+
+    return QString("chat_id : \"%1\" AND message : (%2)").arg(chat_id).arg(words.join(' '));
 }
 
-QString HistoryKeeper::wrapMessage(const QString &str)
+QList<HistoryKeeper::HistMessage> HistoryKeeper::exportMessages()
 {
-    QString wrappedMessage(str);
-    wrappedMessage.replace("'", "''");
-    return wrappedMessage;
+    QList<HistMessage> res;
+
+    runSync([&]()
+    {
+        writeQueued();
+
+        QSqlQuery dbAnswer;
+        dbAnswer = db->exec(QString("SELECT history.id, timestamp, user_id, message, status, name, ctype FROM history ") +
+                            QString("INNER JOIN aliases ON history.sender = aliases.id INNER JOIN chats ON history.chat_id = chats.id;"));
+
+        while (dbAnswer.next())
+        {
+            qint64 id = dbAnswer.value(0).toLongLong();
+            qint64 timeInt = dbAnswer.value(1).toLongLong();
+            QString sender = dbAnswer.value(2).toString();
+            QString message = dbAnswer.value(3).toString();
+            bool isSent = dbAnswer.value(4).toBool();
+            QString chat = dbAnswer.value(5).toString();
+            ChatType ctype = convertToChatType(dbAnswer.value(6).toInt());
+            QDateTime time = QDateTime::fromMSecsSinceEpoch(timeInt);
+
+            res.push_back(HistMessage(id, chat, sender, message, time, isSent, ctype));
+        }
+    });
+
+    return res;
 }
 
-QString HistoryKeeper::unWrapMessage(const QString &str)
+void HistoryKeeper::importMessages(const QList<HistoryKeeper::HistMessage> &lst)
 {
-    QString unWrappedMessage(str);
-    unWrappedMessage.replace("''", "'");
-    return unWrappedMessage;
+    runSync([&]()
+    {
+        writeQueued();
+        db->commit();
+
+        qint64 id;
+        {
+            QMutexLocker lock(&queueMutex);
+            id = messageID;
+            messageID += lst.size();
+        }
+
+        db->exec("BEGIN TRANSACTION;");
+        for (const HistMessage &msg : lst)
+        {
+            for (const GenericDdInterface::Statement &it : generateAddChatEntryCmd(++id, msg.ctype, msg.chat, msg.message, msg.sender, msg.timestamp, msg.isSent))
+                db->exec(it.query, it.values);
+        }
+        db->exec("COMMIT TRANSACTION;");
+    });
+}
+
+QList<GenericDdInterface::Statement> HistoryKeeper::generateAddChatEntryCmd(qint64 id, ChatType ct, const QString& chat, const QString& message, const QString& sender, const QDateTime &dt, bool isSent)
+{
+    QList<GenericDdInterface::Statement> cmds;
+
+    int chat_id = getChatID(chat, ct).first;
+    int sender_id = getAliasID(sender);
+
+    // The id was already handed out, so the rows take it explicitly
+    cmds.push_back({"INSERT INTO history (id, timestamp, chat_id, sender, message, status) VALUES (?, ?, ?, ?, ?, ?);",
+                    {id, dt.toMSecsSinceEpoch(), chat_id, sender_id, message, isSent}});
+
+    return cmds;
 }
 
 void HistoryKeeper::updateChatsID()
@@ -292,10 +667,16 @@ QPair<int, HistoryKeeper::ChatType> HistoryKeeper::getChatID(const QString &id_s
     if (it != chats.end())
         return it.value();
 
-    db->exec(QString("INSERT INTO chats (name, ctype) VALUES ('%1', '%2');").arg(id_str).arg(ct));
-    updateChatsID();
+    QSqlQuery ans = db->exec("INSERT INTO chats (name, ctype) VALUES (?, ?);", {id_str, ct});
+    const QVariant id = ans.lastInsertId();
+    if (!id.isValid())
+    {
+        updateChatsID();
+        return chats.value(id_str, {-1, ct});
+    }
 
-    return getChatID(id_str, ct);
+    chats[id_str] = {id.toInt(), ct};
+    return chats[id_str];
 }
 
 int HistoryKeeper::getAliasID(const QString &id_str)
@@ -304,10 +685,16 @@ int HistoryKeeper::getAliasID(const QString &id_str)
     if (it != aliases.end())
         return it.value();
 
-    db->exec(QString("INSERT INTO aliases (user_id) VALUES ('%1');").arg(id_str));
-    updateAliases();
+    QSqlQuery ans = db->exec("INSERT INTO aliases (user_id) VALUES (?);", {id_str});
+    const QVariant id = ans.lastInsertId();
+    if (!id.isValid())
+    {
+        updateAliases();
+        return aliases.value(id_str, -1);
+    }
 
-    return getAliasID(id_str);
+    aliases[id_str] = id.toInt();
+    return aliases[id_str];
 }
 
 void HistoryKeeper::resetInstance()
@@ -319,17 +706,6 @@ void HistoryKeeper::resetInstance()
     historyInstance = nullptr;
 }
 
-qint64 HistoryKeeper::addGroupChatEntry(const QString &chat, const QString &message, const QString &sender, const QDateTime &dt)
-{
-    Q_UNUSED(chat)
-    Q_UNUSED(message)
-    Q_UNUSED(sender)
-    Q_UNUSED(dt)
-    // no groupchats yet
-
-    return -1;
-}
-
 HistoryKeeper::ChatType HistoryKeeper::convertToChatType(int ct)
 {
     if (ct < 0 || ct > 1)
@@ -365,29 +741,20 @@ void HistoryKeeper::renameHistory(QString from, QString to)
 
 void HistoryKeeper::markAsSent(int m_id)
 {
-    db->exec(QString("UPDATE sent_status SET status = 1 WHERE id = %1;").arg(m_id));
+    QMutexLocker lock(&queueMutex);
+    queueWrite([=]()
+    {
+        return QList<GenericDdInterface::Statement>{{"UPDATE history SET status = 1 WHERE id = ?;", {m_id}}};
+    });
 }
 
 void HistoryKeeper::setSyncType(Db::syncType sType)
 {
-    QString syncCmd;
-
-    switch (sType) {
-    case Db::syncType::stFull:
-        syncCmd = "FULL";
-        break;
-    case Db::syncType::stNormal:
-        syncCmd = "NORMAL";
-        break;
-    case Db::syncType::stOff:
-        syncCmd = "OFF";
-        break;
-    default:
-        syncCmd = "FULL";
-        break;
-    }
-
-    db->exec(QString("PRAGMA synchronous=%1;").arg(syncCmd));
+    post([=]()
+    {
+        writeQueued();
+        db->setSyncType(sType);
+    });
 }
 
 bool HistoryKeeper::isFileExist()
@@ -20,9 +20,20 @@
 #include <QMap>
 #include <QList>
 #include <QDateTime>
+#include <QMutex>
+#include <functional>
+#include "misc/db/genericddinterface.h"
 
-class GenericDdInterface;
-namespace Db { enum class syncType; }
+class QThread;
+class QObject;
+class HistoryWorker;
+
+/**
+ * The history database lives on its own thread, so the GUI never waits for the disk to write.
+ * Writes are queued and return at once, a message's id is assigned in memory when it's added.
+ * The writes queued while the thread was busy are run together in one batch of the database.
+ * Reads wait for the writes queued before them, pages of history are read without blocking.
+ **/
 
 class HistoryKeeper
 {
@@ -31,8 +42,8 @@ public:
 
     struct HistMessage
     {
-        HistMessage(qint64 id, QString chat, QString sender, QString message, QDateTime timestamp, bool isSent) :
-            id(id), chat(chat), sender(sender), message(message), timestamp(timestamp), isSent(isSent) {}
+        HistMessage(qint64 id, QString chat, QString sender, QString message, QDateTime timestamp, bool isSent, ChatType ctype = ctSingle) :
+            id(id), chat(chat), sender(sender), message(message), timestamp(timestamp), isSent(isSent), ctype(ctype) {}
 
         qint64 id;
         QString chat;
@@ -40,12 +51,13 @@ public:
         QString message;
         QDateTime timestamp;
         bool isSent;
+        ChatType ctype; ///< Only set by exportMessages
     };
 
     virtual ~HistoryKeeper();
 
     static HistoryKeeper* getInstance();
-    static void resetInstance();
+    static void resetInstance(); ///< Runs the queued writes, commits and joins the database thread, has to be called before exiting
 
     static QString getHistoryPath(QString currentProfile = QString(), int encrypted = -1); // -1 defaults to checking settings, 0 or 1 to specify
     static bool checkPassword(int encrypted = -1);
@@ -54,35 +66,72 @@ public:
     static bool removeHistory(int encrypted = -1);
     static QList<HistMessage> exportMessagesDeleteFile(int encrypted = -1);
 
-    qint64 addChatEntry(const QString& chat, const QString& message, const QString& sender, const QDateTime &dt, bool isSent);
-    qint64 addGroupChatEntry(const QString& chat, const QString& message, const QString& sender, const QDateTime &dt);
-    QList<HistMessage> getChatHistory(ChatType ct, const QString &chat, const QDateTime &time_from, const QDateTime &time_to);
-    void markAsSent(int m_id);
+    qint64 addChatEntry(const QString& chat, const QString& message, const QString& sender, const QDateTime &dt, bool isSent); ///< Queued, returns the message's id
+    qint64 addGroupChatEntry(const QString& chat, const QString& message, const QString& sender, const QDateTime &dt); ///< Queued, chat is the group's identity
+    /// Reads the count messages before the (beforeTime, beforeId) key on the database thread, oldest first.
+    /// The callback then runs on the GUI thread, unless receiver was deleted in the meantime.
+    void getChatHistoryPage(ChatType ct, const QString &chat, qint64 beforeTime, qint64 beforeId, int count,
+                            QObject *receiver, std::function<void(QList<HistMessage>)> callback);
+    /// Ranks the chat's messages holding every word of phrase, the last one may also be the start of a word.
+    /// Only the latest searchWindow matches are ranked, best first. Runs like getChatHistoryPage.
+    /// Without FTS5 the latest messages holding the words are returned instead
+    void searchChatHistory(ChatType ct, const QString &chat, const QString &phrase, int count,
+                           QObject *receiver, std::function<void(QList<HistMessage>)> callback);
+    /// Reads the messages of a friend's chat still waiting to be sent since the given time, oldest first.
+    /// Runs like getChatHistoryPage
+    void getUndeliveredMessages(const QString &chat, const QDateTime &since,
+                                QObject *receiver, std::function<void(QList<HistMessage>)> callback);
+    void markAsSent(int m_id); ///< Queued
 
     QList<HistMessage> exportMessages();
     void importMessages(const QList<HistoryKeeper::HistMessage> &lst);
 
-    void setSyncType(Db::syncType sType);
+    void setSyncType(Db::syncType sType); ///< Queued
 
 private:
-    HistoryKeeper(GenericDdInterface *db_);
+    typedef std::function<QList<GenericDdInterface::Statement>()> Write; ///< Builds a write's statements on the database thread
+
+    static const int searchWindow = 1000;
+    static const int compactionWrites = 10000; ///< The free pages are checked again after this many writes
+
+    /// Opens the database on its thread with openDb
+    HistoryKeeper(std::function<GenericDdInterface*()> openDb, Db::syncType sType);
     HistoryKeeper(HistoryKeeper &hk) = delete;
     HistoryKeeper& operator=(const HistoryKeeper&) = delete;
 
+    void init(Db::syncType sType);
+    bool migrateSchema(); ///< Brings the tables up to the latest schema version, false if a step failed and was rolled back
+    void createFtsIndex(); ///< Only when SQLite has FTS5, it's not part of the schema versions
+    void post(std::function<void()> work); ///< Runs work on the database thread, after the work posted before it
+    void runSync(std::function<void()> work); ///< Same, but returns once the work ran
+    void queueWrite(Write write); ///< Call with queueMutex locked
+    void writeQueued(); ///< Runs the queued writes in one batch, on the database thread
+    void compact(); ///< Rewrites the database if it has too many free pages, on the database thread
+
     void updateChatsID();
     void updateAliases();
     QPair<int, ChatType> getChatID(const QString &id_str, ChatType ct);
     int getAliasID(const QString &id_str);
-    QString wrapMessage(const QString &str);
-    QString unWrapMessage(const QString &str);
-    QList<QString> generateAddChatEntryCmd(const QString& chat, const QString& message, const QString& sender, const QDateTime &dt, bool isSent);
+    QList<GenericDdInterface::Statement> generateAddChatEntryCmd(qint64 id, ChatType ct, const QString& chat, const QString& message, const QString& sender, const QDateTime &dt, bool isSent);
 
     ChatType convertToChatType(int);
+    static QString toFtsQuery(int chat_id, const QString &phrase);
+
+    QThread *dbThread;
+    HistoryWorker *worker;
+    HistoryWorker *guiWorker; ///< Runs the callbacks of reads on the GUI thread
 
+    // Only used on the database thread
     GenericDdInterface *db;
+    bool ftsIndex; ///< history_fts is there and kept in step
+    bool notMigrated; ///< The file couldn't be migrated, db is in memory instead. Set before the constructor returns
+    int writesSinceCompaction;
     QMap<QString, int> aliases;
     QMap<QString, QPair<int, ChatType>> chats;
-    qint64 messageID;
+
+    QMutex queueMutex; ///< Protects the write queue and the message ids
+    QList<Write> queue;
+    qint64 messageID; ///< Last id assigned
 };
 
 #endif // HISTORYKEEPER_H
@@ -0,0 +1,178 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "latencyrecorder.h"
+
+#include <QElapsedTimer>
+#include <QMutexLocker>
+#include <QDateTime>
+#include <QFile>
+#include <QTextStream>
+#include <QDebug>
+#include <cstring>
+
+const int LatencyHistogram::bucketCount;
+
+LatencyHistogram::LatencyHistogram()
+    : count{0}, sum{0}, max{0}
+{
+    memset(buckets, 0, sizeof(buckets));
+}
+
+void LatencyHistogram::add(qint64 us)
+{
+    if (us < 0)
+        us = 0;
+
+    // Below 4µs one bucket per value, then the exponent and the next two bits
+    int bucket = us;
+    if (us >= 4)
+    {
+        int exponent = 2;
+        while (us >> (exponent + 1))
+            exponent++;
+        bucket = 4 * (exponent - 1) + ((us >> (exponent - 2)) & 3);
+    }
+
+    buckets[qMin(bucket, bucketCount - 1)]++;
+    count++;
+    sum += us;
+    if (us > max)
+        max = us;
+}
+
+qint64 LatencyHistogram::percentile(int percent) const
+{
+    if (!count)
+        return 0;
+
+    const quint64 rank = (count * percent + 99) / 100;
+    quint64 seen = 0;
+    for (int i = 0; i < bucketCount; ++i)
+    {
+        seen += buckets[i];
+        if (seen >= rank)
+            return i < bucketCount - 1 ? qMin(bucketUpperBound(i), max) : max;
+    }
+    return max;
+}
+
+qint64 LatencyHistogram::bucketUpperBound(int bucket)
+{
+    if (bucket < 4)
+        return bucket + 1;
+    return qint64(4 + bucket % 4 + 1) << (bucket / 4 - 1);
+}
+
+qint64 LatencyRecorder::now()
+{
+    // Started once, the first time any thread asks
+    static const QElapsedTimer clock = []()
+    {
+        QElapsedTimer timer;
+        timer.start();
+        return timer;
+    }();
+    return clock.nsecsElapsed() / 1000;
+}
+
+const char* LatencyRecorder::stageName(Stage stage)
+{
+    static const char* names[StageCount] =
+    {
+        "audio capture", "audio encode", "audio send", "audio jitter", "audio playout",
+        "video capture", "video convert", "video encode", "video send", "video unpack", "video render"
+    };
+    return stage < StageCount ? names[stage] : "";
+}
+
+void LatencyRecorder::reset()
+{
+    QMutexLocker lock(&mutex);
+    for (LatencyHistogram& histogram : histograms)
+        histogram = LatencyHistogram();
+}
+
+void LatencyRecorder::record(Stage stage, qint64 us)
+{
+    QMutexLocker lock(&mutex);
+    histograms[stage].add(us);
+}
+
+void LatencyRecorder::recordSince(Stage stage, qint64 timestamp)
+{
+    if (timestamp > 0)
+        record(stage, now() - timestamp);
+}
+
+LatencyHistogram LatencyRecorder::getHistogram(Stage stage) const
+{
+    QMutexLocker lock(&mutex);
+    return histograms[stage];
+}
+
+QString LatencyRecorder::report() const
+{
+    QString text;
+    QTextStream out(&text);
+    out << QString("%1 %2 %3 %4 %5 %6\n").arg("stage", -14).arg("count", 7)
+           .arg("mean", 8).arg("p50", 8).arg("p95", 8).arg("max", 8);
+
+    for (int i = 0; i < StageCount; ++i)
+    {
+        const LatencyHistogram h = getHistogram(static_cast<Stage>(i));
+        if (!h.count)
+            continue;
+
+        auto ms = [](qint64 us){return QString::number(us / 1000.0, 'f', 1);};
+        out << QString("%1 %2 %3 %4 %5 %6\n").arg(stageName(static_cast<Stage>(i)), -14)
+               .arg(h.count, 7).arg(ms(h.sum / h.count), 8).arg(ms(h.percentile(50)), 8)
+               .arg(ms(h.percentile(95)), 8).arg(ms(h.max), 8);
+    }
+
+    out.flush();
+    return text;
+}
+
+bool LatencyRecorder::dumpToFile(const QString& path) const
+{
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+    {
+        qWarning() << "LatencyRecorder: Can't write to" << path;
+        return false;
+    }
+
+    QTextStream out(&file);
+    out << "qTox call latency, " << QDateTime::currentDateTime().toString(Qt::ISODate) << ", times in ms\n";
+    out << report();
+
+    out << "\nhistograms, bucket upper bounds in ms\n";
+    for (int i = 0; i < StageCount; ++i)
+    {
+        const LatencyHistogram h = getHistogram(static_cast<Stage>(i));
+        if (!h.count)
+            continue;
+
+        out << stageName(static_cast<Stage>(i)) << ':';
+        for (int b = 0; b < LatencyHistogram::bucketCount; ++b)
+            if (h.buckets[b])
+                out << ' ' << QString::number(LatencyHistogram::bucketUpperBound(b) / 1000.0) << '=' << h.buckets[b];
+        out << '\n';
+    }
+
+    return true;
+}
@@ -0,0 +1,88 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef LATENCYRECORDER_H
+#define LATENCYRECORDER_H
+
+#include <QMutex>
+#include <QString>
+#include <cstdint>
+
+/**
+ * Histogram of durations in µs with four buckets per power of two,
+ * so percentiles are within 25% up to about a minute.
+ **/
+
+class LatencyHistogram
+{
+public:
+    static const int bucketCount = 104;
+
+    LatencyHistogram();
+
+    void add(qint64 us);
+    qint64 percentile(int percent) const; ///< Upper bound of the bucket holding that percentile, in µs
+    static qint64 bucketUpperBound(int bucket); ///< Exclusive, in µs
+
+    quint64 count;
+    qint64 sum;
+    qint64 max;
+    quint64 buckets[bucketCount];
+};
+
+/**
+ * Collects how long media spends in each stage of a call, in both directions.
+ * Stages record durations measured against now(), the clock every
+ * capture and receive timestamp is taken from.
+ * Thread safe.
+ **/
+
+class LatencyRecorder
+{
+public:
+    enum Stage
+    {
+        AudioCapture, ///< Captured until picked up for sending
+        AudioEncode,
+        AudioSend,
+        AudioJitter, ///< Received until popped from the jitter buffer
+        AudioPlayout, ///< Queued in OpenAL until heard
+        VideoCapture, ///< Captured until picked up for sending
+        VideoConvert, ///< Downscaling and conversion to I420
+        VideoEncode,
+        VideoSend,
+        VideoUnpack, ///< Packing the frame toxav decoded for display, the decode itself happens inside toxav
+        VideoRender, ///< Received until painted
+        StageCount
+    };
+
+    static qint64 now(); ///< Monotonic, in µs
+    static const char* stageName(Stage stage);
+
+    void reset(); ///< Call when a call starts
+    void record(Stage stage, qint64 us);
+    void recordSince(Stage stage, qint64 timestamp); ///< Records now() - timestamp, ignores unknown (0) timestamps
+
+    LatencyHistogram getHistogram(Stage stage) const;
+    QString report() const; ///< A table of every stage, in ms
+    bool dumpToFile(const QString& path) const;
+
+private:
+    mutable QMutex mutex;
+    LatencyHistogram histograms[StageCount];
+};
+
+#endif // LATENCYRECORDER_H
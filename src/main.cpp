@@ -21,6 +21,7 @@
 #include "src/widget/toxuri.h"
 #include "src/widget/toxsave.h"
 #include "src/autoupdate.h"
+#include "src/historykeeper.h"
 #include <QApplication>
 #include <QCommandLineParser>
 #include <QDateTime>
@@ -29,6 +30,7 @@
 #include <QFile>
 #include <QFontDatabase>
 #include <QMutexLocker>
+#include <QRegularExpression>
 
 #include <sodium.h>
 
@@ -70,6 +72,8 @@ int main(int argc, char *argv[])
     parser.addVersionOption();
     parser.addPositionalArgument("uri", QObject::tr("Tox URI to parse"));
     parser.addOption(QCommandLineOption("p", QObject::tr("Starts new instance and loads specified profile."), QObject::tr("profile")));
+    parser.addOption(QCommandLineOption("video-source", QObject::tr("Sends video from \"camera\", a \"synthetic\" test pattern, or a raw/Y4M file."), QObject::tr("source")));
+    parser.addOption(QCommandLineOption("video-mode", QObject::tr("Resolution and frame rate of synthetic and raw video, e.g. 1280x720@30."), QObject::tr("mode")));
     parser.process(a);
 
 #ifndef Q_OS_ANDROID
@@ -92,6 +96,23 @@ int main(int argc, char *argv[])
         }
     }
 
+    if (parser.isSet("video-source"))
+        Settings::getInstance().setVideoSource(parser.value("video-source") == "camera" ? QString() : parser.value("video-source"));
+
+    if (parser.isSet("video-mode"))
+    {
+        QRegularExpression modeRx("^(\\d+)x(\\d+)(?:@(\\d+))?$");
+        QRegularExpressionMatch mode = modeRx.match(parser.value("video-mode"));
+        if (!mode.hasMatch())
+        {
+            qWarning() << "Error: invalid --video-mode" << parser.value("video-mode");
+            return EXIT_FAILURE;
+        }
+        Settings::getInstance().setVideoSourceRes(QSize(mode.captured(1).toInt(), mode.captured(2).toInt()));
+        if (!mode.captured(3).isEmpty())
+            Settings::getInstance().setVideoSourceFps(mode.captured(3).toInt());
+    }
+
     sodium_init(); // For the auto-updater
 
 #ifdef LOG_TO_FILE
@@ -197,6 +218,9 @@ int main(int argc, char *argv[])
     a.setQuitOnLastWindowClosed(false);
     int errorcode = a.exec();
 
+    // Writes the queued history and commits its last batch before the thread is stopped
+    HistoryKeeper::resetInstance();
+
 #ifdef LOG_TO_FILE
     delete logFile;
     logFile = nullptr;
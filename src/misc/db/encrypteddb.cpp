@@ -15,139 +15,178 @@
 */
 
 #include "encrypteddb.h"
-#include "src/misc/settings.h"
+#include "encryptedvfs.h"
+#include "legacylogreader.h"
 #include "src/core.h"
 
-#include <tox/toxencryptsave.h>
-
 #include <QSqlQuery>
+#include <QSqlDriver>
 #include <QDebug>
 #include <QSqlError>
+#include <QFile>
+#include <QUrl>
 
-qint64 EncryptedDb::encryptedChunkSize = 4096;
-qint64 EncryptedDb::plainChunkSize = EncryptedDb::encryptedChunkSize - tox_pass_encryption_extra_length();
-
-EncryptedDb::EncryptedDb(const QString &fname, QList<QString> initList) :
-    PlainDb(":memory:", initList), fileName(fname)
+/// Has to run before the first table is created, pages and blocks then line up
+static QList<QString> withPageSize(const QList<QString>& initList)
 {
-    QByteArray fileContent;
-    if (pullFileContent(fileName, buffer))
-    {
-        qDebug() << "EncryptedDb: writing old data";
-        encrFile.setFileName(fileName);
-        encrFile.open(QIODevice::ReadOnly);
-        fileContent = encrFile.readAll();
-        chunkPosition = encrFile.size() / encryptedChunkSize;
-        encrFile.close();
-    }
-    else
-        chunkPosition = 0;
-
-    encrFile.setFileName(fileName);
-
-    if (!encrFile.open(QIODevice::WriteOnly))
-    {
-        qWarning() << "can't open file:" << fileName;
-    }
-    else
-    {
-        encrFile.write(fileContent);
-        encrFile.flush();
-    }
+    return QList<QString>() << QString("PRAGMA page_size=%1;").arg(EncryptedVfs::blockSize) << initList;
 }
 
-EncryptedDb::~EncryptedDb()
+/// The tables the statements of a legacy log were written for, HistoryKeeper migrates them afterwards
+static QList<QString> legacySchema()
 {
-    encrFile.close(); // Q: what if program is killed without being able to clean up?
-                      // A: cleanup isn't necessary, everything handled int appendToEncrypted(..) function
+    return QList<QString>()
+            << "CREATE TABLE IF NOT EXISTS history (id INTEGER PRIMARY KEY AUTOINCREMENT, timestamp INTEGER NOT NULL, "
+               "chat_id INTEGER NOT NULL, sender INTEGER NOT NULL, message TEXT NOT NULL);"
+            << "CREATE TABLE IF NOT EXISTS aliases (id INTEGER PRIMARY KEY AUTOINCREMENT, user_id TEXT UNIQUE NOT NULL);"
+            << "CREATE TABLE IF NOT EXISTS chats (id INTEGER PRIMARY KEY AUTOINCREMENT, name TEXT UNIQUE NOT NULL, ctype INTEGER NOT NULL);"
+            << "CREATE TABLE IF NOT EXISTS sent_status (id INTEGER PRIMARY KEY AUTOINCREMENT, status INTEGER NOT NULL DEFAULT 0);";
 }
 
-QSqlQuery EncryptedDb::exec(const QString &query)
+EncryptedDb::EncryptedDb(const QString &fname, const QByteArray& key, QList<QString> initList) :
+    PlainDb(prepareFile(fname, key, initList), withPageSize(initList), "QSQLITE_OPEN_URI"), fileName(fname)
 {
-    QSqlQuery retQSqlQuery = PlainDb::exec(query);
-    if (checkCmd(query))
-        appendToEncrypted(query);
+}
 
-    return retQSqlQuery;
+EncryptedDb::~EncryptedDb()
+{
 }
 
-bool EncryptedDb::pullFileContent(const QString &fname, QByteArray &buf)
+QString EncryptedDb::prepareFile(const QString& fname, const QByteArray& key, const QList<QString>& initList)
 {
-    QFile dbFile(fname);
-    if (!dbFile.open(QIODevice::ReadOnly))
+    if (key.isEmpty())
     {
-        qDebug() << "EncryptedDb::pullFileContent: file doesn't exist";
-        buf = QByteArray();
-        return false;
+        qWarning() << "EncryptedDb: No history password is set";
+        return ":memory:";
     }
-    QByteArray fileContent;
-
-    while (!dbFile.atEnd())
+    if (!EncryptedVfs::registerVfs() || !driverHasVfs())
+        return ":memory:";
+    EncryptedVfs::setKey(key);
+
+    // Finish or roll back a migration that was interrupted, see migrateLegacyLog
+    const QString legacyName = fname + ".legacy";
+    if (!QFile::exists(fname) && QFile::exists(legacyName))
+        QFile::rename(legacyName, fname);
+    QFile::remove(fname + ".new");
+    QFile::remove(fname + ".new-journal");
+    QFile::remove(legacyName);
+    recoverFile(fname);
+
+    if (isLegacyLog(fname, key))
     {
-        QByteArray encrChunk = dbFile.read(encryptedChunkSize);
-        qDebug() << "EncryptedDb::pullFileContent: got chunk:" << encrChunk.size();
-        buf = Core::getInstance()->decryptData(encrChunk, Core::ptHistory);
-        if (buf.size() > 0)
+        switch (migrateLegacyLog(fname, key, initList))
         {
-            fileContent += buf;
-        } else {
-            qWarning() << "EncryptedDb::pullFileContent: Encrypted history log is corrupted: can't decrypt, will be deleted";
-            buf = QByteArray();
-            return false;
+        case Migration::Done:
+            break;
+        case Migration::Corrupted:
+            // Older versions dropped a log they couldn't read, keep it aside instead
+            qWarning() << "EncryptedDb: Couldn't decrypt the encrypted history log, moving it to" << fname + ".corrupted";
+            QFile::remove(fname + ".corrupted");
+            QFile::rename(fname, fname + ".corrupted");
+            break;
+        case Migration::Failed:
+            // The log is fine, a later run may manage
+            qWarning() << "EncryptedDb: Couldn't migrate the encrypted history log, leaving it as it is";
+            return ":memory:";
         }
     }
 
-    QList<QByteArray> splittedBA = fileContent.split('\n');
-    QList<QString> sqlCmds;
+    return fileUri(fname);
+}
 
-    for (auto ba_line : splittedBA)
-    {
-        QString line = QByteArray::fromBase64(ba_line);
-        sqlCmds.append(line);
-    }
+QString EncryptedDb::filePath() const
+{
+    return isOpen() ? fileName : QString();
+}
 
-    PlainDb::exec("BEGIN TRANSACTION;");
-    for (auto line : sqlCmds)
+QString EncryptedDb::vacuumTarget(const QString &path) const
+{
+    return fileUri(path);
+}
+
+QString EncryptedDb::fileUri(const QString& fname)
+{
+    return QUrl::fromLocalFile(fname).toString(QUrl::FullyEncoded) + "?vfs=" + EncryptedVfs::name;
+}
+
+bool EncryptedDb::driverHasVfs()
+{
+    // SQLite looks the VFS of a URI up even for a database in memory, nothing touches the disk
+    const QString connection = "qTox VFS probe";
+    bool found;
     {
-        QSqlQuery r = PlainDb::exec(line);
+        QSqlDatabase probe = QSqlDatabase::addDatabase("QSQLITE", connection);
+        probe.setConnectOptions("QSQLITE_OPEN_URI");
+        probe.setDatabaseName(QString("file:vfs-probe?mode=memory&vfs=") + EncryptedVfs::name);
+        found = probe.open() && probe.driver()->handle().isValid();
+        if (!found)
+            qCritical() << "EncryptedDb: Qt's SQLite driver doesn't see the encrypting VFS:" << probe.lastError().text();
+        probe.close();
     }
-    PlainDb::exec("COMMIT TRANSACTION;");
+    QSqlDatabase::removeDatabase(connection);
+    return found;
+}
 
-    dbFile.close();
+bool EncryptedDb::isLegacyLog(const QString& fname, const QByteArray& key)
+{
+    // A database always starts with a whole block, which doesn't decrypt as a log chunk
+    QFile file(fname);
+    if (!file.open(QIODevice::ReadOnly) || file.size() == 0)
+        return false;
 
-    return true;
+    QByteArray encrChunk = file.read(LegacyLogReader::encryptedChunkSize);
+    return !EncryptedVfs::decrypt(encrChunk, key).isEmpty();
 }
 
-void EncryptedDb::appendToEncrypted(const QString &sql)
+EncryptedDb::Migration EncryptedDb::migrateLegacyLog(const QString& fname, const QByteArray& key, const QList<QString>& initList)
 {
-    QByteArray b64Str;
-    b64Str.append(sql);
-    b64Str = b64Str.toBase64();  // much easier to parse strings like this from file
-
-    buffer += b64Str + "\n";
+    qDebug() << "EncryptedDb: Migrating the encrypted history log" << fname;
 
-    while (buffer.size() > plainChunkSize)
+    LegacyLogReader log(fname, [key](const QByteArray& chunk)
     {
-        QByteArray filledChunk = buffer.left(plainChunkSize);
-        encrFile.seek(chunkPosition * encryptedChunkSize);
-        QByteArray encr = Core::getInstance()->encryptData(filledChunk, Core::ptHistory);
-        if (encr.size() > 0)
+        return EncryptedVfs::decrypt(chunk, key);
+    });
+    if (!log.start())
+        return Migration::Failed;
+
+    // Build the database next to the log, so that a crash leaves one of them whole
+    const QString newName = fname + ".new";
+    int statements = 0;
+    {
+        PlainDb newDb(fileUri(newName), withPageSize(legacySchema() + initList), "QSQLITE_OPEN_URI");
+        if (!newDb.isOpen())
+            return Migration::Failed;
+
+        // Replays while the rest of the log is still being decrypted
+        newDb.exec("BEGIN TRANSACTION;");
+        QString line;
+        while (log.next(line))
         {
-            encrFile.write(encr);
-            encrFile.flush();
+            newDb.exec(line);
+            statements++;
         }
 
-        buffer = buffer.right(buffer.size() - plainChunkSize);
-        chunkPosition++;
+        if (log.hasFailed())
+        {
+            qWarning() << "EncryptedDb: Encrypted history log is corrupted: can't decrypt";
+            newDb.exec("ROLLBACK TRANSACTION;");
+            return Migration::Corrupted;
+        }
+        if (newDb.exec("COMMIT TRANSACTION;").lastError().isValid())
+            return Migration::Failed;
     }
-    encrFile.seek(chunkPosition * encryptedChunkSize);
 
-    QByteArray encr = Core::getInstance()->encryptData(buffer, Core::ptHistory);
-    if (encr.size() > 0)
+    if (!QFile::rename(fname, fname + ".legacy"))
+        return Migration::Failed;
+    if (!QFile::rename(newName, fname))
     {
-        encrFile.write(encr);
+        QFile::rename(fname + ".legacy", fname);
+        return Migration::Failed;
     }
-    encrFile.flush();
+    QFile::remove(fname + ".legacy");
+
+    qDebug() << "EncryptedDb: Migrated" << statements << "statements";
+    return Migration::Done;
 }
 
 bool EncryptedDb::check(const QString &fname)
@@ -158,11 +197,14 @@ bool EncryptedDb::check(const QString &fname)
 
     if (file.size() > 0)
     {
-        QByteArray encrChunk = file.read(encryptedChunkSize);
+        // Either the first block of a database or the first chunk of an old log
+        QByteArray encrChunk = file.read(EncryptedVfs::encryptedBlockSize());
         QByteArray buf = Core::getInstance()->decryptData(encrChunk, Core::ptHistory);
         if (buf.size() == 0)
         {
-            state = false;
+            buf = Core::getInstance()->decryptData(encrChunk.left(LegacyLogReader::encryptedChunkSize), Core::ptHistory);
+            if (buf.size() == 0)
+                state = false;
         }
     } else {
         file.close();
@@ -172,14 +214,3 @@ bool EncryptedDb::check(const QString &fname)
     file.close();
     return state;
 }
-
-bool EncryptedDb::checkCmd(const QString &cmd)
-{
-    if (cmd.startsWith("INSERT", Qt::CaseInsensitive) || cmd.startsWith("UPDATE", Qt::CaseInsensitive)
-            || cmd.startsWith("DELETE", Qt::CaseInsensitive))
-    {
-        return true;
-    }
-
-    return false;
-}
@@ -20,30 +20,39 @@
 #include "plaindb.h"
 
 #include <QList>
-#include <QFile>
+#include <QByteArray>
+
+/**
+ * A SQLite database whose pages are encrypted on disk with the history key, see EncryptedVfs.
+ * Older versions kept an encrypted log of every statement instead, replayed into memory at startup.
+ * Such a log is migrated once when it's opened: the new database is built next to it,
+ * and only replaces it when complete.
+ **/
 
 class EncryptedDb : public PlainDb
 {
 public:
-    EncryptedDb(const QString& fname, QList<QString> initList);
+    /// key is the derived history key, the database and its journals keep their own copy.
+    /// If Qt's SQLite can't use EncryptedVfs or a legacy log can't be migrated, it's left alone and the database stays in memory
+    EncryptedDb(const QString& fname, const QByteArray& key, QList<QString> initList);
     virtual ~EncryptedDb();
 
-    virtual QSqlQuery exec(const QString &query);
     static bool check(const QString &fname);
 
-private:
-    bool pullFileContent(const QString& fname, QByteArray &buf);
-    void appendToEncrypted(const QString &sql);
-    bool checkCmd(const QString &cmd);
+protected:
+    virtual QString filePath() const;
+    virtual QString vacuumTarget(const QString &path) const;
 
-    QFile encrFile;
-    QString fileName;
+private:
+    enum class Migration {Done, Corrupted, Failed}; ///< Only a corrupted log is moved aside
 
-    static qint64 plainChunkSize;
-    static qint64 encryptedChunkSize;
+    static QString prepareFile(const QString& fname, const QByteArray& key, const QList<QString>& initList); ///< Returns the URI to open
+    static QString fileUri(const QString& fname);
+    static bool driverHasVfs(); ///< Qt's driver may be built with its own SQLite, which doesn't know EncryptedVfs
+    static bool isLegacyLog(const QString& fname, const QByteArray& key);
+    static Migration migrateLegacyLog(const QString& fname, const QByteArray& key, const QList<QString>& initList);
 
-    qint64 chunkPosition;
-    QByteArray buffer;
+    QString fileName;
 };
 
 #endif // ENCRYPTEDDB_H
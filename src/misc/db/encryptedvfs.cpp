@@ -0,0 +1,459 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "encryptedvfs.h"
+
+#include <tox/toxencryptsave.h>
+#include <sqlite3.h>
+
+#include <QByteArray>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QDebug>
+
+#include <cstring>
+
+const char* EncryptedVfs::name = "qtox-encrypted";
+const int EncryptedVfs::blockSize;
+
+/// Our file, the root VFS's file follows it in the same allocation
+struct EncryptedFile
+{
+    sqlite3_file base;
+    QByteArray* key; ///< Copied from currentKey when the file is opened
+    sqlite3_file* real;
+};
+
+static sqlite3_vfs encryptedVfs;
+static sqlite3_io_methods encryptedIo;
+static sqlite3_vfs* rootVfs = nullptr;
+
+static QMutex keyMutex;
+static QByteArray currentKey;
+
+static sqlite3_vfs* root(sqlite3_vfs* vfs)
+{
+    return static_cast<sqlite3_vfs*>(vfs->pAppData);
+}
+
+static sqlite3_file* real(sqlite3_file* file)
+{
+    return reinterpret_cast<EncryptedFile*>(file)->real;
+}
+
+static const QByteArray& key(sqlite3_file* file)
+{
+    return *reinterpret_cast<EncryptedFile*>(file)->key;
+}
+
+static int realSize(sqlite3_file* file, sqlite3_int64& size)
+{
+    return real(file)->pMethods->xFileSize(real(file), &size);
+}
+
+/// Decrypts block index of a file that is physicalSize bytes on disk, past the end it's empty
+static int readBlock(sqlite3_file* file, qint64 index, qint64 physicalSize, QByteArray& plain)
+{
+    const qint64 offset = index * EncryptedVfs::encryptedBlockSize();
+    const qint64 size = qMin(EncryptedVfs::encryptedBlockSize(), physicalSize - offset);
+    if (size <= static_cast<qint64>(tox_pass_encryption_extra_length()))
+    {
+        plain.clear();
+        return SQLITE_OK;
+    }
+
+    QByteArray encrypted(size, Qt::Uninitialized);
+    int rc = real(file)->pMethods->xRead(real(file), encrypted.data(), size, offset);
+    if (rc != SQLITE_OK)
+        return rc == SQLITE_IOERR_SHORT_READ ? SQLITE_CORRUPT : rc;
+
+    plain = EncryptedVfs::decrypt(encrypted, key(file));
+    if (plain.isEmpty())
+    {
+        qWarning() << "EncryptedVfs: Can't decrypt block" << index;
+        return SQLITE_IOERR_READ;
+    }
+    return SQLITE_OK;
+}
+
+static int writeBlock(sqlite3_file* file, qint64 index, const QByteArray& plain)
+{
+    QByteArray encrypted = EncryptedVfs::encrypt(plain, key(file));
+    if (encrypted.isEmpty())
+        return SQLITE_IOERR_WRITE;
+
+    return real(file)->pMethods->xWrite(real(file), encrypted.constData(), encrypted.size(),
+                                        index * EncryptedVfs::encryptedBlockSize());
+}
+
+static int encClose(sqlite3_file* file)
+{
+    sqlite3_file* r = real(file);
+    int rc = r->pMethods ? r->pMethods->xClose(r) : SQLITE_OK;
+    file->pMethods = nullptr;
+    delete reinterpret_cast<EncryptedFile*>(file)->key;
+    return rc;
+}
+
+static int encRead(sqlite3_file* file, void* buf, int amount, sqlite3_int64 offset)
+{
+    sqlite3_int64 physicalSize;
+    int rc = realSize(file, physicalSize);
+    if (rc != SQLITE_OK)
+        return rc;
+
+    char* dst = static_cast<char*>(buf);
+    const qint64 end = offset + amount;
+    qint64 pos = offset;
+    QByteArray plain;
+    while (pos < end)
+    {
+        const qint64 index = pos / EncryptedVfs::blockSize;
+        const qint64 blockStart = index * EncryptedVfs::blockSize;
+        if ((rc = readBlock(file, index, physicalSize, plain)) != SQLITE_OK)
+            return rc;
+
+        const qint64 from = pos - blockStart;
+        const qint64 to = qMin(end - blockStart, qint64(plain.size()));
+        if (to <= from)
+            break;
+        memcpy(dst + (pos - offset), plain.constData() + from, to - from);
+        pos = blockStart + to;
+    }
+
+    if (pos < end)
+    {
+        // SQLite wants the rest zeroed on short reads
+        memset(dst + (pos - offset), 0, end - pos);
+        return SQLITE_IOERR_SHORT_READ;
+    }
+    return SQLITE_OK;
+}
+
+static int encWrite(sqlite3_file* file, const void* buf, int amount, sqlite3_int64 offset)
+{
+    sqlite3_int64 physicalSize;
+    int rc = realSize(file, physicalSize);
+    if (rc != SQLITE_OK)
+        return rc;
+
+    const qint64 B = EncryptedVfs::blockSize;
+    const qint64 size = EncryptedVfs::logicalSize(physicalSize);
+    const qint64 firstBlock = offset / B;
+    QByteArray plain;
+
+    // Only the last block may be partial, fill the gap up to the write with zeroes
+    for (qint64 index = size / B; index < firstBlock; ++index)
+    {
+        if ((rc = readBlock(file, index, physicalSize, plain)) != SQLITE_OK)
+            return rc;
+        plain.append(QByteArray(B - plain.size(), '\0'));
+        if ((rc = writeBlock(file, index, plain)) != SQLITE_OK)
+            return rc;
+    }
+    if (firstBlock > size / B)
+        rc = realSize(file, physicalSize);
+
+    const char* src = static_cast<const char*>(buf);
+    const qint64 end = offset + amount;
+    qint64 pos = offset;
+    while (pos < end)
+    {
+        const qint64 index = pos / B;
+        const qint64 blockStart = index * B;
+        const qint64 from = pos - blockStart;
+        const qint64 to = qMin(end - blockStart, B);
+
+        // Whole pages, the common case, don't need the old content
+        if (from == 0 && to == B)
+        {
+            plain = QByteArray(src + (pos - offset), B);
+        }
+        else
+        {
+            if ((rc = readBlock(file, index, physicalSize, plain)) != SQLITE_OK)
+                return rc;
+            if (plain.size() < to)
+                plain.append(QByteArray(to - plain.size(), '\0'));
+            memcpy(plain.data() + from, src + (pos - offset), to - from);
+        }
+
+        if ((rc = writeBlock(file, index, plain)) != SQLITE_OK)
+            return rc;
+        pos = blockStart + to;
+    }
+    return SQLITE_OK;
+}
+
+static int encTruncate(sqlite3_file* file, sqlite3_int64 size)
+{
+    sqlite3_int64 physicalSize;
+    int rc = realSize(file, physicalSize);
+    if (rc != SQLITE_OK)
+        return rc;
+
+    const qint64 B = EncryptedVfs::blockSize;
+    const qint64 fullBlocks = size / B;
+    const qint64 rest = size % B;
+
+    QByteArray plain;
+    if (rest && (rc = readBlock(file, fullBlocks, physicalSize, plain)) != SQLITE_OK)
+        return rc;
+
+    if ((rc = real(file)->pMethods->xTruncate(real(file), fullBlocks * EncryptedVfs::encryptedBlockSize())) != SQLITE_OK)
+        return rc;
+
+    if (!rest)
+        return SQLITE_OK;
+
+    plain.resize(rest);
+    return writeBlock(file, fullBlocks, plain);
+}
+
+static int encSync(sqlite3_file* file, int flags)
+{
+    return real(file)->pMethods->xSync(real(file), flags);
+}
+
+static int encFileSize(sqlite3_file* file, sqlite3_int64* size)
+{
+    sqlite3_int64 physicalSize;
+    int rc = realSize(file, physicalSize);
+    if (rc == SQLITE_OK)
+        *size = EncryptedVfs::logicalSize(physicalSize);
+    return rc;
+}
+
+static int encLock(sqlite3_file* file, int lock)
+{
+    return real(file)->pMethods->xLock(real(file), lock);
+}
+
+static int encUnlock(sqlite3_file* file, int lock)
+{
+    return real(file)->pMethods->xUnlock(real(file), lock);
+}
+
+static int encCheckReservedLock(sqlite3_file* file, int* out)
+{
+    return real(file)->pMethods->xCheckReservedLock(real(file), out);
+}
+
+static int encFileControl(sqlite3_file* file, int op, void* arg)
+{
+    // Size hints are in plaintext bytes, preallocating with them would break logicalSize()
+    if (op == SQLITE_FCNTL_SIZE_HINT || op == SQLITE_FCNTL_CHUNK_SIZE)
+        return SQLITE_OK;
+    return real(file)->pMethods->xFileControl(real(file), op, arg);
+}
+
+static int encSectorSize(sqlite3_file*)
+{
+    // Blocks are rewritten whole, let SQLite journal them whole
+    return EncryptedVfs::blockSize;
+}
+
+static int encDeviceCharacteristics(sqlite3_file*)
+{
+    return 0;
+}
+
+static int encOpen(sqlite3_vfs* vfs, const char* name, sqlite3_file* file, int flags, int* outFlags)
+{
+    EncryptedFile* enc = reinterpret_cast<EncryptedFile*>(file);
+    enc->real = reinterpret_cast<sqlite3_file*>(enc + 1);
+    enc->real->pMethods = nullptr;
+
+    int rc = root(vfs)->xOpen(root(vfs), name, enc->real, flags, outFlags);
+    if (rc != SQLITE_OK)
+    {
+        file->pMethods = nullptr;
+        return rc;
+    }
+
+    QMutexLocker lock(&keyMutex);
+    enc->key = new QByteArray(currentKey);
+    file->pMethods = &encryptedIo;
+    return SQLITE_OK;
+}
+
+static int encDelete(sqlite3_vfs* vfs, const char* name, int syncDir)
+{
+    return root(vfs)->xDelete(root(vfs), name, syncDir);
+}
+
+static int encAccess(sqlite3_vfs* vfs, const char* name, int flags, int* out)
+{
+    return root(vfs)->xAccess(root(vfs), name, flags, out);
+}
+
+static int encFullPathname(sqlite3_vfs* vfs, const char* name, int size, char* out)
+{
+    return root(vfs)->xFullPathname(root(vfs), name, size, out);
+}
+
+static void* encDlOpen(sqlite3_vfs* vfs, const char* name)
+{
+    return root(vfs)->xDlOpen(root(vfs), name);
+}
+
+static void encDlError(sqlite3_vfs* vfs, int size, char* out)
+{
+    root(vfs)->xDlError(root(vfs), size, out);
+}
+
+static void (*encDlSym(sqlite3_vfs* vfs, void* handle, const char* symbol))(void)
+{
+    return root(vfs)->xDlSym(root(vfs), handle, symbol);
+}
+
+static void encDlClose(sqlite3_vfs* vfs, void* handle)
+{
+    root(vfs)->xDlClose(root(vfs), handle);
+}
+
+static int encRandomness(sqlite3_vfs* vfs, int size, char* out)
+{
+    return root(vfs)->xRandomness(root(vfs), size, out);
+}
+
+static int encSleep(sqlite3_vfs* vfs, int us)
+{
+    return root(vfs)->xSleep(root(vfs), us);
+}
+
+static int encCurrentTime(sqlite3_vfs* vfs, double* out)
+{
+    return root(vfs)->xCurrentTime(root(vfs), out);
+}
+
+static int encGetLastError(sqlite3_vfs* vfs, int size, char* out)
+{
+    return root(vfs)->xGetLastError(root(vfs), size, out);
+}
+
+static int encCurrentTimeInt64(sqlite3_vfs* vfs, sqlite3_int64* out)
+{
+    if (root(vfs)->iVersion >= 2 && root(vfs)->xCurrentTimeInt64)
+        return root(vfs)->xCurrentTimeInt64(root(vfs), out);
+
+    double days;
+    int rc = root(vfs)->xCurrentTime(root(vfs), &days);
+    *out = static_cast<sqlite3_int64>(days * 86400000.0);
+    return rc;
+}
+
+bool EncryptedVfs::registerVfs()
+{
+    static QMutex mutex;
+    QMutexLocker lock(&mutex);
+    if (rootVfs)
+        return true;
+
+    sqlite3_vfs* defaultVfs = sqlite3_vfs_find(nullptr);
+    if (!defaultVfs)
+    {
+        qCritical() << "EncryptedVfs: SQLite has no default VFS";
+        return false;
+    }
+
+    // Version 1 io methods, SQLite won't try WAL or memory mapping on them
+    encryptedIo.iVersion = 1;
+    encryptedIo.xClose = encClose;
+    encryptedIo.xRead = encRead;
+    encryptedIo.xWrite = encWrite;
+    encryptedIo.xTruncate = encTruncate;
+    encryptedIo.xSync = encSync;
+    encryptedIo.xFileSize = encFileSize;
+    encryptedIo.xLock = encLock;
+    encryptedIo.xUnlock = encUnlock;
+    encryptedIo.xCheckReservedLock = encCheckReservedLock;
+    encryptedIo.xFileControl = encFileControl;
+    encryptedIo.xSectorSize = encSectorSize;
+    encryptedIo.xDeviceCharacteristics = encDeviceCharacteristics;
+
+    encryptedVfs.iVersion = 2;
+    encryptedVfs.szOsFile = sizeof(EncryptedFile) + defaultVfs->szOsFile;
+    encryptedVfs.mxPathname = defaultVfs->mxPathname;
+    encryptedVfs.zName = name;
+    encryptedVfs.pAppData = defaultVfs;
+    encryptedVfs.xOpen = encOpen;
+    encryptedVfs.xDelete = encDelete;
+    encryptedVfs.xAccess = encAccess;
+    encryptedVfs.xFullPathname = encFullPathname;
+    encryptedVfs.xDlOpen = encDlOpen;
+    encryptedVfs.xDlError = encDlError;
+    encryptedVfs.xDlSym = encDlSym;
+    encryptedVfs.xDlClose = encDlClose;
+    encryptedVfs.xRandomness = encRandomness;
+    encryptedVfs.xSleep = encSleep;
+    encryptedVfs.xCurrentTime = encCurrentTime;
+    encryptedVfs.xGetLastError = encGetLastError;
+    encryptedVfs.xCurrentTimeInt64 = encCurrentTimeInt64;
+
+    if (sqlite3_vfs_register(&encryptedVfs, 0) != SQLITE_OK)
+    {
+        qCritical() << "EncryptedVfs: SQLite refused to register the VFS";
+        return false;
+    }
+
+    rootVfs = defaultVfs;
+    return true;
+}
+
+void EncryptedVfs::setKey(const QByteArray& key)
+{
+    QMutexLocker lock(&keyMutex);
+    currentKey = key;
+}
+
+QByteArray EncryptedVfs::encrypt(const QByteArray& plain, const QByteArray& key)
+{
+    if (key.size() != static_cast<int>(tox_pass_key_length()))
+        return QByteArray();
+
+    QByteArray encrypted(plain.size() + tox_pass_encryption_extra_length(), Qt::Uninitialized);
+    if (tox_pass_key_encrypt(reinterpret_cast<const uint8_t*>(plain.constData()), plain.size(),
+                             reinterpret_cast<const uint8_t*>(key.constData()), reinterpret_cast<uint8_t*>(encrypted.data())) == -1)
+        return QByteArray();
+    return encrypted;
+}
+
+QByteArray EncryptedVfs::decrypt(const QByteArray& encrypted, const QByteArray& key)
+{
+    const int size = encrypted.size() - tox_pass_encryption_extra_length();
+    if (key.size() != static_cast<int>(tox_pass_key_length()) || size <= 0)
+        return QByteArray();
+
+    QByteArray plain(size, Qt::Uninitialized);
+    if (tox_pass_key_decrypt(reinterpret_cast<const uint8_t*>(encrypted.constData()), encrypted.size(),
+                             reinterpret_cast<const uint8_t*>(key.constData()), reinterpret_cast<uint8_t*>(plain.data())) != size)
+        return QByteArray();
+    return plain;
+}
+
+qint64 EncryptedVfs::encryptedBlockSize()
+{
+    return blockSize + tox_pass_encryption_extra_length();
+}
+
+qint64 EncryptedVfs::logicalSize(qint64 physicalSize)
+{
+    const qint64 blocks = physicalSize / encryptedBlockSize();
+    const qint64 rest = physicalSize % encryptedBlockSize();
+    const qint64 extra = tox_pass_encryption_extra_length();
+    return blocks * blockSize + (rest > extra ? rest - extra : 0);
+}
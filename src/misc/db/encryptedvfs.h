@@ -0,0 +1,47 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef ENCRYPTEDVFS_H
+#define ENCRYPTEDVFS_H
+
+#include <QByteArray>
+
+/**
+ * A SQLite VFS keeping every file it opens encrypted with the history key.
+ * Files are cut in blocks of blockSize bytes, each encrypted on its own with the derived history key,
+ * so SQLite reads and writes the database a page at a time straight from the disk.
+ * A file keeps a copy of the key set when it was opened, clearing the password doesn't affect it.
+ * Only the last block may be partial, the logical size of a file follows from its size on disk.
+ * Journals and temporary files go through it too, WAL and memory mapping are not supported.
+ * Qt's SQLite driver has to use the same system SQLite we register it in, EncryptedDb checks it does.
+ **/
+
+class EncryptedVfs
+{
+public:
+    static const char* name; ///< Open the database with this as the vfs URI parameter
+    static const int blockSize = 4096; ///< Plaintext bytes per block, also the database's page size
+
+    static bool registerVfs(); ///< Registers the VFS on first call, returns false if SQLite refused it
+    static void setKey(const QByteArray& key); ///< The derived key the files opened from now on use
+
+    static QByteArray encrypt(const QByteArray& plain, const QByteArray& key); ///< Returns an empty array on failure
+    static QByteArray decrypt(const QByteArray& encrypted, const QByteArray& key); ///< Same
+    static qint64 encryptedBlockSize(); ///< Size of a block on disk
+    static qint64 logicalSize(qint64 physicalSize); ///< Plaintext size of a file of this size on disk
+};
+
+#endif // ENCRYPTEDVFS_H
@@ -17,15 +17,33 @@
 #ifndef GENERICDDINTERFACE_H
 #define GENERICDDINTERFACE_H
 
+#include <QList>
+#include <QString>
+#include <QVariant>
+
 class QSqlQuery;
-class QString;
+namespace Db { enum class syncType; }
 
 class GenericDdInterface
 {
 public:
+    struct Statement
+    {
+        QString query;
+        QVariantList values; ///< Bound to the query's ? placeholders, in order
+    };
+
     virtual ~GenericDdInterface();
 
     virtual QSqlQuery exec(const QString &query) = 0;
+    /// Binds the values to the query's placeholders, the query is only prepared the first time
+    virtual QSqlQuery exec(const QString &query, const QVariantList &values) = 0;
+
+    /// Runs the statements in the current write batch, which is committed once it's big or old enough
+    virtual void write(const QList<Statement> &statements) = 0;
+    virtual void commit() = 0; ///< Commits the current write batch right away
+    virtual void setSyncType(Db::syncType sType) = 0; ///< Also decides how long writes may wait in a batch
+    virtual bool compactIfNeeded() = 0; ///< Returns true if the database was rewritten without its free pages
 };
 
 #endif // GENERICDDINTERFACE_H
@@ -0,0 +1,178 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "legacylogreader.h"
+
+#include <tox/toxencryptsave.h>
+
+#include <QThreadPool>
+#include <QRunnable>
+#include <QMutexLocker>
+#include <QDebug>
+
+#include <cstring>
+
+const qint64 LegacyLogReader::encryptedChunkSize;
+const int LegacyLogReader::chunksPerTask;
+
+class LegacyLogReader::DecryptTask : public QRunnable
+{
+public:
+    DecryptTask(LegacyLogReader* reader, int task)
+        : reader{reader}, task{task}
+    {
+    }
+
+    virtual void run()
+    {
+        reader->decryptChunks(task);
+    }
+
+private:
+    LegacyLogReader* reader;
+    int task;
+};
+
+LegacyLogReader::LegacyLogReader(const QString& fname, Decryptor decrypt, QThreadPool* pool)
+    : file{fname}, decrypt{decrypt}, pool{pool ? pool : QThreadPool::globalInstance()},
+      encrypted{nullptr}, encryptedSize{0}, chunkCount{0}, plainData{nullptr}, plainSize{0}, readPos{0},
+      nextTask{0}, runningTasks{0}, failed{false}
+{
+}
+
+LegacyLogReader::~LegacyLogReader()
+{
+    {
+        QMutexLocker lock(&mutex);
+        while (runningTasks)
+            taskFinished.wait(&mutex);
+    }
+
+    if (encrypted && encryptedCopy.isEmpty())
+        file.unmap(const_cast<uchar*>(encrypted));
+}
+
+qint64 LegacyLogReader::plainChunkSize()
+{
+    return encryptedChunkSize - tox_pass_encryption_extra_length();
+}
+
+bool LegacyLogReader::start()
+{
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        qDebug() << "LegacyLogReader: Can't open" << file.fileName();
+        return false;
+    }
+
+    encryptedSize = file.size();
+    encrypted = file.map(0, encryptedSize);
+    if (!encrypted)
+    {
+        encryptedCopy = file.readAll();
+        encrypted = reinterpret_cast<const uchar*>(encryptedCopy.constData());
+    }
+
+    chunkCount = (encryptedSize + encryptedChunkSize - 1) / encryptedChunkSize;
+    if (!chunkCount)
+        return true;
+
+    const qint64 lastChunk = encryptedSize - (chunkCount - 1) * encryptedChunkSize;
+    if (lastChunk <= static_cast<qint64>(tox_pass_encryption_extra_length()))
+    {
+        qWarning() << "LegacyLogReader: The log is truncated";
+        failed = true;
+        return true;
+    }
+
+    plain.resize(chunkCount * plainChunkSize());
+    plainData = plain.data();
+    plainSize = (chunkCount - 1) * plainChunkSize() + lastChunk - tox_pass_encryption_extra_length();
+
+    const int taskCount = (chunkCount + chunksPerTask - 1) / chunksPerTask;
+    taskDone.fill(false, taskCount);
+    runningTasks = taskCount;
+    for (int task = 0; task < taskCount; ++task)
+        pool->start(new DecryptTask(this, task));
+
+    return true;
+}
+
+void LegacyLogReader::decryptChunks(int task)
+{
+    const int last = qMin(chunkCount, (task + 1) * chunksPerTask);
+    bool ok = true;
+    for (int chunk = task * chunksPerTask; chunk < last && ok; ++chunk)
+    {
+        const qint64 offset = chunk * encryptedChunkSize;
+        const int size = qMin(encryptedChunkSize, encryptedSize - offset);
+        QByteArray decrypted = decrypt(QByteArray::fromRawData(reinterpret_cast<const char*>(encrypted) + offset, size));
+        ok = decrypted.size() == size - static_cast<int>(tox_pass_encryption_extra_length());
+        if (ok)
+            memcpy(plainData + chunk * plainChunkSize(), decrypted.constData(), decrypted.size());
+    }
+
+    QMutexLocker lock(&mutex);
+    if (!ok)
+        failed = true;
+    taskDone[task] = true;
+    runningTasks--;
+    taskFinished.wakeAll();
+}
+
+qint64 LegacyLogReader::readyEnd(bool wait)
+{
+    QMutexLocker lock(&mutex);
+    if (wait)
+        while (!failed && nextTask < taskDone.size() && !taskDone[nextTask])
+            taskFinished.wait(&mutex);
+
+    while (nextTask < taskDone.size() && taskDone[nextTask])
+        nextTask++;
+
+    return qMin(qint64(nextTask) * chunksPerTask * plainChunkSize(), plainSize);
+}
+
+bool LegacyLogReader::next(QString& statement)
+{
+    qint64 end = readyEnd(false);
+    forever
+    {
+        // The last statement may not end with a newline
+        if (hasFailed() || readPos >= plainSize)
+            return false;
+
+        const char* begin = plainData + readPos;
+        const char* newline = static_cast<const char*>(memchr(begin, '\n', end - readPos));
+        if (newline || (end == plainSize && readPos < plainSize))
+        {
+            const qint64 length = newline ? newline - begin : plainSize - readPos;
+            statement = QByteArray::fromBase64(QByteArray::fromRawData(begin, length));
+            readPos = qMin(readPos + length + 1, plainSize);
+            return true;
+        }
+
+        if (end == plainSize)
+            return false;
+        end = readyEnd(true);
+    }
+}
+
+bool LegacyLogReader::hasFailed() const
+{
+    QMutexLocker lock(&mutex);
+    return failed;
+}
@@ -0,0 +1,84 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef LEGACYLOGREADER_H
+#define LEGACYLOGREADER_H
+
+#include <QFile>
+#include <QByteArray>
+#include <QVector>
+#include <QMutex>
+#include <QWaitCondition>
+#include <functional>
+
+class QThreadPool;
+
+/**
+ * Reads the encrypted history log older versions wrote: base64'd SQL statements, one per line,
+ * cut in chunks of encryptedChunkSize bytes encrypted independently.
+ * The chunks are decrypted in parallel on a thread pool into one preallocated buffer,
+ * and statements are handed out in order as soon as the chunks holding them are ready.
+ **/
+
+class LegacyLogReader
+{
+public:
+    typedef std::function<QByteArray(const QByteArray&)> Decryptor; ///< Returns an empty array on failure
+
+    static const qint64 encryptedChunkSize = 4096;
+    static const int chunksPerTask = 64;
+
+    /// The decryptor is called from the pool's threads, by default the global pool
+    LegacyLogReader(const QString& fname, Decryptor decrypt, QThreadPool* pool = nullptr);
+    ~LegacyLogReader(); ///< Waits for the pending decryptions
+
+    bool start(); ///< Returns false if the file can't be read
+    bool next(QString& statement); ///< Returns false once all statements were read, or on failure
+    bool hasFailed() const; ///< A chunk didn't decrypt, the log is corrupted or the key is wrong
+
+    static qint64 plainChunkSize();
+
+private:
+    class DecryptTask;
+    friend class DecryptTask;
+
+    void decryptChunks(int task);
+    qint64 readyEnd(bool wait); ///< End of the plaintext decrypted without gaps, can wait for the next task
+
+private:
+    QFile file;
+    Decryptor decrypt;
+    QThreadPool* pool;
+
+    const uchar* encrypted; ///< The file, mapped when possible
+    QByteArray encryptedCopy;
+    qint64 encryptedSize;
+    int chunkCount;
+
+    QByteArray plain; ///< Every chunk decrypted, at a multiple of plainChunkSize
+    char* plainData; ///< Written by the tasks, each to its own chunks
+    qint64 plainSize;
+    qint64 readPos;
+
+    mutable QMutex mutex;
+    QWaitCondition taskFinished;
+    QVector<bool> taskDone;
+    int nextTask; ///< First task whose plaintext isn't known to be ready
+    int runningTasks;
+    bool failed;
+};
+
+#endif // LEGACYLOGREADER_H
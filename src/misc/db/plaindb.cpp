@@ -18,26 +18,71 @@
 #include <QDebug>
 #include <QSqlQuery>
 #include <QString>
+#include <QTimer>
+#include <QFile>
+#include <QVariant>
+#include <QSqlError>
 
-PlainDb::PlainDb(const QString &db_name, QList<QString> initList)
+#ifdef Q_OS_WIN
+ #include <io.h>
+#else
+ #include <unistd.h>
+#endif
+
+const double PlainDb::maxFreeRatio = 0.25;
+const int PlainDb::minFreePages;
+
+/// Flushes a file to the disk, VACUUM INTO doesn't
+static bool syncFile(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadWrite))
+        return false;
+#ifdef Q_OS_WIN
+    return _commit(file.handle()) == 0;
+#else
+    return fsync(file.handle()) == 0;
+#endif
+}
+
+PlainDb::PlainDb(const QString &db_name, QList<QString> initList, const QString &connectOptions)
 {
+    if (db_name != ":memory:" && connectOptions.isEmpty())
+        recoverFile(db_name);
+
     db = new QSqlDatabase();
     *db = QSqlDatabase::addDatabase("QSQLITE");
     db->setDatabaseName(db_name);
+    db->setConnectOptions(connectOptions);
 
     if (!db->open())
     {
         qWarning() << QString("Can't open file: %1, history will not be saved!").arg(db_name);
+        db->setConnectOptions();
         db->setDatabaseName(":memory:");
         db->open();
     }
 
+    // Readers don't block the writer and commits append to the log instead of rewriting pages.
+    // Files opened through a VFS, like EncryptedDb's, stay on a rollback journal.
+    walMode = isOpen() && connectOptions.isEmpty();
+    setJournalMode();
+
     for (const QString &cmd : initList)
         db->exec(cmd);
+
+    batchWrites = 0;
+    commitTimer = new QTimer();
+    commitTimer->setSingleShot(true);
+    QObject::connect(commitTimer, &QTimer::timeout, [this](){commit();});
+    setSyncType(Db::syncType::stFull);
 }
 
 PlainDb::~PlainDb()
 {
+    commit();
+    delete commitTimer;
+    clearStatements();
     db->close();
     QString dbConName = db->connectionName();
     delete db;
@@ -49,3 +94,172 @@ QSqlQuery PlainDb::exec(const QString &query)
 {
     return db->exec(query);
 }
+
+QSqlQuery PlainDb::exec(const QString &query, const QVariantList &values)
+{
+    auto it = statements.find(query);
+    if (it == statements.end())
+    {
+        QSqlQuery statement(*db);
+        statement.setForwardOnly(true);
+        if (!statement.prepare(query))
+        {
+            qWarning() << "PlainDb: Can't prepare" << query << ":" << statement.lastError().text();
+            return statement;
+        }
+        it = statements.insert(query, statement);
+    }
+
+    QSqlQuery& statement = it.value();
+    for (int i = 0; i < values.size(); ++i)
+        statement.bindValue(i, values[i]);
+    if (!statement.exec())
+        qWarning() << "PlainDb: Query failed:" << statement.lastError().text();
+    return statement;
+}
+
+void PlainDb::clearStatements()
+{
+    for (QSqlQuery& statement : statements)
+        statement.finish();
+    statements.clear();
+}
+
+bool PlainDb::isOpen() const
+{
+    return db->databaseName() != ":memory:";
+}
+
+void PlainDb::write(const QList<Statement> &statements)
+{
+    if (!batchWrites)
+        db->exec("BEGIN TRANSACTION;");
+
+    for (const Statement &statement : statements)
+        exec(statement.query, statement.values);
+
+    if (++batchWrites >= maxBatchWrites)
+        commit();
+    else if (!commitTimer->isActive())
+        commitTimer->start(maxBatchDelay);
+}
+
+void PlainDb::commit()
+{
+    commitTimer->stop();
+    if (!batchWrites)
+        return;
+
+    batchWrites = 0;
+    db->exec("COMMIT TRANSACTION;");
+}
+
+void PlainDb::setJournalMode()
+{
+    if (walMode && db->exec("PRAGMA journal_mode=WAL;").lastError().isValid())
+        qWarning() << "PlainDb: Can't switch" << db->databaseName() << "to WAL";
+}
+
+void PlainDb::setSyncType(Db::syncType sType)
+{
+    QString syncCmd;
+
+    // Batches only lose what a crash would lose anyway at this level of durability
+    switch (sType) {
+    case Db::syncType::stOff:
+        syncCmd = "OFF";
+        maxBatchWrites = 1024;
+        maxBatchDelay = 2000;
+        break;
+    case Db::syncType::stNormal:
+        syncCmd = "NORMAL";
+        maxBatchWrites = 128;
+        maxBatchDelay = 250;
+        break;
+    case Db::syncType::stFull:
+    default:
+        syncCmd = "FULL";
+        maxBatchWrites = 1;
+        maxBatchDelay = 0;
+        break;
+    }
+
+    syncType = sType;
+    commit();
+    db->exec(QString("PRAGMA synchronous=%1;").arg(syncCmd));
+}
+
+bool PlainDb::compactIfNeeded()
+{
+    const QString path = filePath();
+    if (path.isEmpty())
+        return false;
+
+    QSqlQuery pages = db->exec("PRAGMA page_count;");
+    QSqlQuery freePages = db->exec("PRAGMA freelist_count;");
+    if (!pages.first() || !freePages.first())
+        return false;
+
+    const qint64 total = pages.value(0).toLongLong();
+    const qint64 free = freePages.value(0).toLongLong();
+    pages.finish();
+    freePages.finish();
+    if (free < minFreePages || free < total * maxFreeRatio)
+        return false;
+
+    qDebug() << "PlainDb: Compacting" << path << "," << free << "of" << total << "pages are free";
+    commit();
+    clearStatements();
+
+    // The snapshot is built aside and only swapped in once it's complete and on the disk
+    const QString compactPath = path + ".compact";
+    QFile::remove(compactPath);
+    QSqlQuery vacuum(*db);
+    vacuum.prepare("VACUUM INTO ?;");
+    vacuum.addBindValue(vacuumTarget(compactPath));
+    if (!vacuum.exec() || !syncFile(compactPath))
+    {
+        qWarning() << "PlainDb: Compaction failed:" << vacuum.lastError().text();
+        QFile::remove(compactPath);
+        return false;
+    }
+    vacuum.finish();
+
+    db->close();
+    const QString oldPath = path + ".precompact";
+    bool swapped = QFile::rename(path, oldPath);
+    if (swapped && !QFile::rename(compactPath, path))
+    {
+        QFile::rename(oldPath, path);
+        swapped = false;
+    }
+    QFile::remove(oldPath);
+    QFile::remove(compactPath);
+
+    if (!db->open())
+        qWarning() << "PlainDb: Can't reopen" << path << "after compacting it";
+    setJournalMode();
+    setSyncType(syncType);
+
+    qDebug() << "PlainDb: Compaction" << (swapped ? "done" : "failed, kept the old file");
+    return swapped;
+}
+
+void PlainDb::recoverFile(const QString &path)
+{
+    const QString oldPath = path + ".precompact";
+    if (!QFile::exists(path) && QFile::exists(oldPath))
+        QFile::rename(oldPath, path);
+    QFile::remove(oldPath);
+    QFile::remove(path + ".compact");
+}
+
+QString PlainDb::filePath() const
+{
+    return isOpen() ? db->databaseName() : QString();
+}
+
+QString PlainDb::vacuumTarget(const QString &path) const
+{
+    return path;
+}
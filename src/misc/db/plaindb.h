@@ -20,6 +20,10 @@
 #include "genericddinterface.h"
 
 #include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QHash>
+
+class QTimer;
 
 namespace Db {
     enum class syncType : int {stOff = 0, stNormal = 1, stFull = 2};
@@ -28,13 +32,45 @@ namespace Db {
 class PlainDb : public GenericDdInterface
 {
 public:
-    PlainDb(const QString &db_name, QList<QString> initList);
+    PlainDb(const QString &db_name, QList<QString> initList, const QString &connectOptions = QString());
     virtual ~PlainDb();
 
     virtual QSqlQuery exec(const QString &query);
+    virtual QSqlQuery exec(const QString &query, const QVariantList &values);
+    bool isOpen() const; ///< false if the database only lives in memory
+
+    virtual void write(const QList<Statement> &statements);
+    virtual void commit();
+    virtual void setSyncType(Db::syncType sType);
+    virtual bool compactIfNeeded();
+
+    static void recoverFile(const QString &path); ///< Finishes or rolls back a compaction interrupted by a crash
+
+protected:
+    virtual QString filePath() const; ///< The file on disk, empty in memory
+    virtual QString vacuumTarget(const QString &path) const; ///< How VACUUM INTO has to name a file
+
+private:
+    void clearStatements(); ///< Needed before closing the database or vacuuming it
+    void setJournalMode();
 
 private:
     QSqlDatabase *db;
+    Db::syncType syncType;
+    bool walMode; ///< Write-ahead logging, for files SQLite accesses directly
+    QHash<QString, QSqlQuery> statements; ///< Prepared statements by query
+
+    /// Compaction snapshots the live pages into a new file and swaps it in once
+    /// free pages are more than maxFreeRatio of the file and at least minFreePages
+    static const double maxFreeRatio;
+    static const int minFreePages = 256;
+
+    /// Group commit, a transaction stays open until it holds maxBatchWrites writes or is maxBatchDelay ms old.
+    /// With stFull durability every write is committed right away.
+    QTimer* commitTimer;
+    int batchWrites;
+    int maxBatchWrites;
+    int maxBatchDelay;
 };
 
 #endif // PLAINDB_H
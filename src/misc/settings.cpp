@@ -45,7 +45,8 @@ Settings* Settings::settings{nullptr};
 bool Settings::makeToxPortable{false};
 
 Settings::Settings() :
-    loaded(false), useCustomDhtList{false}, currentProfileId(0)
+    loaded(false), useCustomDhtList{false}, currentProfileId(0),
+    videoSourceRes{640, 480}, videoSourceFps{30}
 {
     load();
 }
@@ -266,6 +267,10 @@ void Settings::load()
         inDev = s.value("inDev", "").toString();
         outDev = s.value("outDev", "").toString();
         filterAudio = s.value("filterAudio", false).toBool();
+        suppressSilence = s.value("suppressSilence", true).toBool();
+        vadThreshold = s.value("vadThreshold", 9).toInt();
+        vadHangover = s.value("vadHangover", 400).toInt();
+        recordCalls = s.value("recordCalls", false).toBool();
     s.endGroup();
 
     s.beginGroup("Video");
@@ -427,6 +432,10 @@ void Settings::saveGlobal(QString path)
         s.setValue("inDev", inDev);
         s.setValue("outDev", outDev);
         s.setValue("filterAudio", filterAudio);
+        s.setValue("suppressSilence", suppressSilence);
+        s.setValue("vadThreshold", vadThreshold);
+        s.setValue("vadHangover", vadHangover);
+        s.setValue("recordCalls", recordCalls);
     s.endGroup();
 
     s.beginGroup("Video");
@@ -1069,6 +1078,48 @@ void Settings::setFilterAudio(bool newValue)
     filterAudio = newValue;
 }
 
+bool Settings::getSuppressSilence() const
+{
+    return suppressSilence;
+}
+
+void Settings::setSuppressSilence(bool newValue)
+{
+    suppressSilence = newValue;
+}
+
+int Settings::getVadThreshold() const
+{
+    return vadThreshold;
+}
+
+void Settings::setVadThreshold(int newValue)
+{
+    if (newValue > 0 && newValue <= 40)
+        vadThreshold = newValue;
+}
+
+int Settings::getVadHangover() const
+{
+    return vadHangover;
+}
+
+void Settings::setVadHangover(int newValue)
+{
+    if (newValue >= 0 && newValue <= 5000)
+        vadHangover = newValue;
+}
+
+bool Settings::getRecordCalls() const
+{
+    return recordCalls;
+}
+
+void Settings::setRecordCalls(bool newValue)
+{
+    recordCalls = newValue;
+}
+
 QSize Settings::getCamVideoRes() const
 {
     return camVideoRes;
@@ -1079,6 +1130,38 @@ void Settings::setCamVideoRes(QSize newValue)
     camVideoRes = newValue;
 }
 
+QString Settings::getVideoSource() const
+{
+    return videoSource;
+}
+
+void Settings::setVideoSource(const QString& newValue)
+{
+    videoSource = newValue;
+}
+
+QSize Settings::getVideoSourceRes() const
+{
+    return videoSourceRes;
+}
+
+void Settings::setVideoSourceRes(QSize newValue)
+{
+    if (newValue.isValid())
+        videoSourceRes = newValue;
+}
+
+int Settings::getVideoSourceFps() const
+{
+    return videoSourceFps;
+}
+
+void Settings::setVideoSourceFps(int newValue)
+{
+    if (newValue > 0 && newValue <= 60)
+        videoSourceFps = newValue;
+}
+
 QString Settings::getFriendAdress(const QString &publicKey) const
 {
     QString key = ToxID::fromString(publicKey).publicKey;
@@ -146,9 +146,30 @@ public:
     bool getFilterAudio() const;
     void setFilterAudio(bool newValue);
 
+    bool getSuppressSilence() const; ///< Don't send the frames the voice activity detector finds silent
+    void setSuppressSilence(bool newValue);
+
+    int getVadThreshold() const; ///< dB above the noise floor a frame needs to count as speech
+    void setVadThreshold(int newValue);
+
+    int getVadHangover() const; ///< ms we keep sending after the last speech
+    void setVadHangover(int newValue);
+
+    bool getRecordCalls() const; ///< Save what we send in calls to CallRecorder::recordingsDir()
+    void setRecordCalls(bool newValue);
+
     QSize getCamVideoRes() const;
     void setCamVideoRes(QSize newValue);
 
+    QString getVideoSource() const; ///< Empty for the camera, "synthetic" or the path of a raw/Y4M file
+    void setVideoSource(const QString& newValue);
+
+    QSize getVideoSourceRes() const; ///< Resolution of the synthetic and raw file sources
+    void setVideoSourceRes(QSize newValue);
+
+    int getVideoSourceFps() const;
+    void setVideoSourceFps(int newValue);
+
     // Assume all widgets have unique names
     // Don't use it to save every single thing you want to save, use it
     // for some general purpose widgets, such as MainWindows or Splitters,
@@ -330,9 +351,17 @@ private:
     QString inDev;
     QString outDev;
     bool filterAudio;
+    bool suppressSilence;
+    int vadThreshold;
+    int vadHangover;
+    bool recordCalls;
 
     // Video
     QSize camVideoRes;
+    // Set from the command line for this run only, never saved
+    QString videoSource;
+    QSize videoSourceRes;
+    int videoSourceFps;
 
     struct friendProp
     {
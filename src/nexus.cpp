@@ -2,6 +2,8 @@
 #include "core.h"
 #include "misc/settings.h"
 #include "video/camera.h"
+#include "video/syntheticvideosource.h"
+#include "video/filevideosource.h"
 #include "widget/gui.h"
 #include <QThread>
 #include <QDebug>
@@ -19,6 +21,7 @@ Nexus::Nexus(QObject *parent) :
     QObject(parent),
     core{nullptr},
     coreThread{nullptr},
+    videoSource{nullptr},
     widget{nullptr},
     androidgui{nullptr},
     started{false}
@@ -29,6 +32,8 @@ Nexus::~Nexus()
 {
     delete core;
     delete coreThread;
+    if (videoSource != Camera::getInstance())
+        delete videoSource;
 #ifdef Q_OS_ANDROID
     delete androidgui;
 #else
@@ -64,7 +69,8 @@ void Nexus::start()
     QString profilePath = Settings::getInstance().detectProfile();
     coreThread = new QThread(this);
     coreThread->setObjectName("qTox Core");
-    core = new Core(Camera::getInstance(), coreThread, profilePath);
+    videoSource = createVideoSource();
+    core = new Core(videoSource, coreThread, profilePath);
     core->moveToThread(coreThread);
     connect(coreThread, &QThread::started, core, &Core::start);
 
@@ -146,6 +152,20 @@ void Nexus::destroyInstance()
     nexus = nullptr;
 }
 
+VideoSource* Nexus::createVideoSource()
+{
+    Settings& s = Settings::getInstance();
+    QString source = s.getVideoSource();
+
+    if (source.isEmpty() || source == "camera")
+        return Camera::getInstance();
+
+    if (source == "synthetic")
+        return new SyntheticVideoSource(s.getVideoSourceRes(), s.getVideoSourceFps());
+
+    return new FileVideoSource(source, s.getVideoSourceRes(), s.getVideoSourceFps());
+}
+
 Core* Nexus::getCore()
 {
     return getInstance().core;
@@ -5,6 +5,7 @@
 
 class QThread;
 class Core;
+class VideoSource;
 class Widget;
 class AndroidGUI;
 
@@ -28,9 +29,12 @@ private:
     explicit Nexus(QObject *parent = 0);
     ~Nexus();
 
+    static VideoSource* createVideoSource(); ///< The Camera, or the test source chosen in the settings
+
 private:
     Core* core;
     QThread* coreThread;
+    VideoSource* videoSource;
     Widget* widget;
     AndroidGUI* androidgui;
     bool started;
@@ -62,6 +62,14 @@ void OfflineMsgEngine::registerReceipt(int receipt, int messageID, ChatMessage::
     undeliveredMsgs[messageID] = {msg, timestamp, receipt};
 }
 
+ChatMessage::Ptr OfflineMsgEngine::getUndeliveredMsg(int messageID)
+{
+    QMutexLocker ml(&mutex);
+
+    auto it = undeliveredMsgs.find(messageID);
+    return it != undeliveredMsgs.end() ? it.value().msg : ChatMessage::Ptr();
+}
+
 void OfflineMsgEngine::deliverOfflineMsgs()
 {
     QMutexLocker ml(&mutex);
@@ -37,6 +37,7 @@ public:
 
     void dischargeReceipt(int receipt);
     void registerReceipt(int receipt, int messageID, ChatMessage::Ptr msg, const QDateTime &timestamp = QDateTime::currentDateTime());
+    ChatMessage::Ptr getUndeliveredMsg(int messageID); ///< The message waiting for a receipt, null if there's none
 
 public slots:
     void deliverOfflineMsgs();
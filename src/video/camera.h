@@ -48,7 +48,6 @@ public:
     ~Camera();
 
     static Camera* getInstance(); ///< Returns the global widget's Camera instance
-    VideoFrame getLastFrame();
 
     void setResolution(QSize res);
     QSize getCurrentResolution();
@@ -62,6 +61,7 @@ public:
     // VideoSource interface
     virtual void subscribe();
     virtual void unsubscribe();
+    virtual VideoFrame getLastFrame();
 
 signals:
     void resolutionProbingFinished(QList<QSize> res);
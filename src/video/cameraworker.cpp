@@ -15,6 +15,7 @@
 */
 
 #include "cameraworker.h"
+#include "src/latencyrecorder.h"
 
 #include <QTimer>
 #include <QDebug>
@@ -174,7 +175,7 @@ void CameraWorker::doWork()
 
     QByteArray frameData(reinterpret_cast<char*>(frame.data), frame.total() * frame.channels());
 
-    emit newFrameAvailable(VideoFrame{frameData, QSize(frame.cols, frame.rows), VideoFrame::BGR});
+    emit newFrameAvailable(VideoFrame{frameData, QSize(frame.cols, frame.rows), VideoFrame::BGR, LatencyRecorder::now()});
 }
 
 void CameraWorker::suspend()
@@ -0,0 +1,226 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "filevideosource.h"
+#include "src/latencyrecorder.h"
+
+#include <QDebug>
+#include <QThread>
+#include <QTimer>
+#include <QMutexLocker>
+
+FileVideoSource::FileVideoSource(const QString& path, QSize resolution, int fps)
+    : path(path)
+    , resolution(resolution)
+    , fps(fps > 0 ? fps : 30)
+    , isY4M(false)
+    , dataStart(0)
+    , refcount(0)
+    , thread(nullptr)
+    , clock(nullptr)
+{
+    qRegisterMetaType<VideoFrame>();
+
+    thread = new QThread();
+    thread->setObjectName("qTox File Video");
+    moveToThread(thread);
+    file.moveToThread(thread);
+    thread->start();
+}
+
+FileVideoSource::~FileVideoSource()
+{
+    QMetaObject::invokeMethod(this, "_stop", Qt::BlockingQueuedConnection);
+    thread->exit();
+    thread->wait();
+    delete thread;
+}
+
+void FileVideoSource::subscribe()
+{
+    if (refcount++ <= 0)
+        QMetaObject::invokeMethod(this, "_start");
+}
+
+void FileVideoSource::unsubscribe()
+{
+    if (--refcount <= 0)
+    {
+        QMetaObject::invokeMethod(this, "_stop");
+        refcount = 0;
+    }
+}
+
+VideoFrame FileVideoSource::getLastFrame()
+{
+    QMutexLocker lock(&mutex);
+    return currFrame;
+}
+
+void FileVideoSource::_start()
+{
+    if (!file.isOpen() && !openFile())
+        return;
+
+    if (!clock)
+    {
+        clock = new QTimer(this);
+        clock->setTimerType(Qt::PreciseTimer);
+        connect(clock, &QTimer::timeout, this, &FileVideoSource::readFrame);
+    }
+
+    clock->setInterval(1000 / fps);
+    clock->start();
+}
+
+void FileVideoSource::_stop()
+{
+    if (clock)
+        clock->stop();
+    file.close();
+}
+
+bool FileVideoSource::openFile()
+{
+    file.setFileName(path);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        qWarning() << "FileVideoSource: Can't open" << path;
+        return false;
+    }
+
+    isY4M = false;
+    dataStart = 0;
+    QByteArray magic = file.peek(9);
+    if (magic == "YUV4MPEG2")
+    {
+        if (!parseY4MHeader(file.readLine()))
+        {
+            qWarning() << "FileVideoSource: Unsupported Y4M file" << path;
+            file.close();
+            return false;
+        }
+        isY4M = true;
+        dataStart = file.pos();
+    }
+
+    if (!resolution.isValid() || resolution.isEmpty())
+    {
+        qWarning() << "FileVideoSource: Unknown resolution for raw file" << path;
+        file.close();
+        return false;
+    }
+
+    qDebug() << "FileVideoSource: Replaying" << path << resolution << "at" << fps << "fps";
+    return true;
+}
+
+bool FileVideoSource::parseY4MHeader(const QByteArray& header)
+{
+    QList<QByteArray> tokens = header.trimmed().split(' ');
+    for (const QByteArray& token : tokens.mid(1))
+    {
+        if (token.isEmpty())
+            continue;
+
+        const QByteArray value = token.mid(1);
+        switch (token[0])
+        {
+        case 'W':
+            resolution.setWidth(value.toInt());
+            break;
+        case 'H':
+            resolution.setHeight(value.toInt());
+            break;
+        case 'F':
+        {
+            QList<QByteArray> rate = value.split(':');
+            if (rate.size() == 2 && rate[1].toInt() > 0 && rate[0].toInt() > 0)
+                fps = qMax(1, rate[0].toInt() / rate[1].toInt());
+            break;
+        }
+        case 'C':
+            if (!value.startsWith("420"))
+                return false;
+            break;
+        default:
+            break;
+        }
+    }
+
+    return resolution.isValid() && !resolution.isEmpty();
+}
+
+void FileVideoSource::readFrame()
+{
+    const int w = resolution.width();
+    const int h = resolution.height();
+    const int cw = (w + 1) / 2;
+    const int ch = (h + 1) / 2;
+    const int frameSize = w * h + 2 * cw * ch;
+
+    // Read the next frame, rewinding once at the end of the file
+    for (int attempt = 0; attempt < 2; ++attempt)
+    {
+        if (isY4M)
+        {
+            QByteArray frameHeader = file.readLine();
+            if (!frameHeader.startsWith("FRAME"))
+            {
+                file.seek(dataStart);
+                continue;
+            }
+        }
+
+        planes = file.read(frameSize);
+        if (planes.size() == frameSize)
+            break;
+
+        file.seek(dataStart);
+    }
+
+    if (planes.size() != frameSize)
+    {
+        qWarning() << "FileVideoSource: No complete frame in" << path;
+        _stop();
+        return;
+    }
+
+    // Convert from planar to packed, see NetVideoSource::pushVPXFrame for the layout
+    const uint8_t* yData = reinterpret_cast<const uint8_t*>(planes.constData());
+    const uint8_t* uData = yData + w * h;
+    const uint8_t* vData = uData + cw * ch;
+
+    QByteArray frameData(w * h * 3, Qt::Uninitialized);
+    uint8_t* dst = reinterpret_cast<uint8_t*>(frameData.data());
+    for (int y = 0; y < h; ++y)
+    {
+        for (int x = 0; x < w; ++x)
+        {
+            *dst++ = yData[x + y * w];
+            *dst++ = uData[x / 2 + (y / 2) * cw];
+            *dst++ = vData[x / 2 + (y / 2) * cw];
+        }
+    }
+
+    VideoFrame frame{frameData, resolution, VideoFrame::YUV, LatencyRecorder::now()};
+
+    mutex.lock();
+    currFrame = frame;
+    mutex.unlock();
+
+    emit frameAvailable(frame);
+}
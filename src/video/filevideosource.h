@@ -0,0 +1,70 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef FILEVIDEOSOURCE_H
+#define FILEVIDEOSOURCE_H
+
+#include <QFile>
+#include <QMutex>
+#include "videosource.h"
+
+class QThread;
+class QTimer;
+
+/**
+ * Replays a YUV4MPEG2 (.y4m) or raw I420 file in a loop, from its own thread.
+ * Y4M files carry their own resolution and frame rate, raw files use
+ * the ones given to the constructor.
+ **/
+
+class FileVideoSource : public VideoSource
+{
+    Q_OBJECT
+public:
+    FileVideoSource(const QString& path, QSize resolution, int fps);
+    ~FileVideoSource();
+
+    // VideoSource interface
+    virtual void subscribe();
+    virtual void unsubscribe();
+    virtual VideoFrame getLastFrame();
+
+private slots:
+    void _start();
+    void _stop();
+    void readFrame();
+
+private:
+    bool openFile(); ///< Opens the file and parses the Y4M header if there is one
+    bool parseY4MHeader(const QByteArray& header);
+
+private:
+    QString path;
+    QSize resolution;
+    int fps;
+    bool isY4M;
+    qint64 dataStart; ///< Offset of the first frame in the file
+    int refcount; ///< Number of users suscribed to the source
+    QFile file;
+    QByteArray planes; ///< I420 planes of the frame being read
+    QThread* thread;
+    QTimer* clock;
+
+    QMutex mutex;
+    VideoFrame currFrame;
+};
+
+#endif // FILEVIDEOSOURCE_H
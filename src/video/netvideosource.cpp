@@ -28,7 +28,7 @@ void NetVideoSource::pushFrame(VideoFrame frame)
     emit frameAvailable(frame);
 }
 
-void NetVideoSource::pushVPXFrame(const vpx_image *image)
+void NetVideoSource::pushVPXFrame(const vpx_image *image, qint64 timestamp)
 {
     const int dw = image->d_w;
     const int dh = image->d_h;
@@ -40,6 +40,7 @@ void NetVideoSource::pushVPXFrame(const vpx_image *image)
     frame.frameData.resize(dw * dh * 3); //YUV 24bit
     frame.resolution = QSize(dw, dh);
     frame.format = VideoFrame::YUV;
+    frame.timestamp = timestamp;
 
     const uint8_t* yData = image->planes[VPX_PLANE_Y];
     const uint8_t* uData = image->planes[VPX_PLANE_V];
@@ -27,7 +27,7 @@ public:
     NetVideoSource();
 
     void pushFrame(VideoFrame frame);
-    void pushVPXFrame(const vpx_image *image);
+    void pushVPXFrame(const vpx_image *image, qint64 timestamp = 0); ///< timestamp is when the frame was received
 
     virtual void subscribe() {}
     virtual void unsubscribe() {}
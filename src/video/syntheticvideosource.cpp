@@ -0,0 +1,147 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "syntheticvideosource.h"
+#include "src/latencyrecorder.h"
+
+#include <QDebug>
+#include <QThread>
+#include <QTimer>
+#include <QMutexLocker>
+#include <cstring>
+
+SyntheticVideoSource::SyntheticVideoSource(QSize resolution, int fps)
+    : resolution(resolution)
+    , fps(fps > 0 ? fps : 30)
+    , refcount(0)
+    , frameCount(0)
+    , thread(nullptr)
+    , clock(nullptr)
+{
+    qRegisterMetaType<VideoFrame>();
+
+    if (!resolution.isValid() || resolution.isEmpty())
+        this->resolution = QSize(640, 480);
+
+    // BGR color bars: white, yellow, cyan, green, magenta, red, blue, black
+    static const uint8_t colors[8][3] = {
+        {255, 255, 255}, {  0, 255, 255}, {255, 255,   0}, {  0, 255,   0},
+        {255,   0, 255}, {  0,   0, 255}, {255,   0,   0}, {  0,   0,   0},
+    };
+
+    const int w = this->resolution.width();
+    bars.resize(w * 2 * 3);
+    for (int x = 0; x < w * 2; ++x)
+    {
+        const uint8_t* c = colors[((x % w) * 8 / w) % 8];
+        memcpy(bars.data() + x * 3, c, 3);
+    }
+
+    thread = new QThread();
+    thread->setObjectName("qTox Synthetic Video");
+    moveToThread(thread);
+    thread->start();
+
+    qDebug() << "SyntheticVideoSource: Generating" << this->resolution << "at" << this->fps << "fps";
+}
+
+SyntheticVideoSource::~SyntheticVideoSource()
+{
+    QMetaObject::invokeMethod(this, "_stop", Qt::BlockingQueuedConnection);
+    thread->exit();
+    thread->wait();
+    delete thread;
+}
+
+void SyntheticVideoSource::subscribe()
+{
+    if (refcount++ <= 0)
+        QMetaObject::invokeMethod(this, "_start");
+}
+
+void SyntheticVideoSource::unsubscribe()
+{
+    if (--refcount <= 0)
+    {
+        QMetaObject::invokeMethod(this, "_stop");
+        refcount = 0;
+    }
+}
+
+VideoFrame SyntheticVideoSource::getLastFrame()
+{
+    QMutexLocker lock(&mutex);
+    return currFrame;
+}
+
+void SyntheticVideoSource::_start()
+{
+    if (!clock)
+    {
+        clock = new QTimer(this);
+        clock->setTimerType(Qt::PreciseTimer);
+        clock->setInterval(1000 / fps);
+        connect(clock, &QTimer::timeout, this, &SyntheticVideoSource::generateFrame);
+    }
+
+    clock->start();
+}
+
+void SyntheticVideoSource::_stop()
+{
+    if (clock)
+        clock->stop();
+}
+
+void SyntheticVideoSource::generateFrame()
+{
+    const int w = resolution.width();
+    const int h = resolution.height();
+    const int bpl = w * 3;
+
+    QByteArray frameData(bpl * h, Qt::Uninitialized);
+    char* data = frameData.data();
+
+    // scrolling bars
+    const int offset = (frameCount * 4) % w;
+    for (int y = 0; y < h; ++y)
+        memcpy(data + y * bpl, bars.constData() + offset * 3, bpl);
+
+    // bouncing box whose brightness pulses, so every frame differs from the last
+    const int boxSize = qMax(h / 6, 2);
+    const int rangeX = qMax(w - boxSize, 1);
+    const int rangeY = qMax(h - boxSize, 1);
+    int bx = (frameCount * 5) % (2 * rangeX);
+    int by = (frameCount * 3) % (2 * rangeY);
+    if (bx >= rangeX)
+        bx = 2 * rangeX - bx - 1;
+    if (by >= rangeY)
+        by = 2 * rangeY - by - 1;
+
+    const char shade = static_cast<char>(64 + (frameCount * 8) % 192);
+    for (int y = by; y < by + boxSize && y < h; ++y)
+        memset(data + y * bpl + bx * 3, shade, qMin(boxSize, w - bx) * 3);
+
+    ++frameCount;
+
+    VideoFrame frame{frameData, resolution, VideoFrame::BGR, LatencyRecorder::now()};
+
+    mutex.lock();
+    currFrame = frame;
+    mutex.unlock();
+
+    emit frameAvailable(frame);
+}
@@ -0,0 +1,63 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef SYNTHETICVIDEOSOURCE_H
+#define SYNTHETICVIDEOSOURCE_H
+
+#include <QMutex>
+#include <QByteArray>
+#include "videosource.h"
+
+class QThread;
+class QTimer;
+
+/**
+ * Generates a moving test pattern (scrolling color bars and a bouncing box)
+ * at a fixed resolution and frame rate, from its own thread.
+ * It can replace the Camera on machines without a capture device.
+ **/
+
+class SyntheticVideoSource : public VideoSource
+{
+    Q_OBJECT
+public:
+    SyntheticVideoSource(QSize resolution, int fps);
+    ~SyntheticVideoSource();
+
+    // VideoSource interface
+    virtual void subscribe();
+    virtual void unsubscribe();
+    virtual VideoFrame getLastFrame();
+
+private slots:
+    void _start();
+    void _stop();
+    void generateFrame();
+
+private:
+    QSize resolution;
+    int fps;
+    int refcount; ///< Number of users suscribed to the source
+    quint64 frameCount;
+    QByteArray bars; ///< One pre-rendered row of color bars, twice the frame width to scroll through
+    QThread* thread;
+    QTimer* clock;
+
+    QMutex mutex;
+    VideoFrame currFrame;
+};
+
+#endif // SYNTHETICVIDEOSOURCE_H
@@ -15,6 +15,63 @@
 */
 
 #include "videoframe.h"
+#include <QVector>
+
+VideoFrame VideoFrame::downscaled(QSize target) const
+{
+    const int w = resolution.width();
+    const int h = resolution.height();
+    // Upscaling one dimension isn't supported, it's kept as is
+    const int dw = qMin(target.width(), w);
+    const int dh = qMin(target.height(), h);
+
+    if (!isValid() || dw <= 0 || dh <= 0 || (dw >= w && dh >= h))
+        return *this;
+
+    // Box filter: each destination pixel averages every source pixel its area covers.
+    // Source columns map to the destination column they fall in, rows are summed one at a time
+    const uint8_t* src = reinterpret_cast<const uint8_t*>(frameData.constData());
+
+    QVector<int> column(w);
+    QVector<int> columnWidth(dw, 0);
+    for (int sx = 0; sx < w; ++sx)
+    {
+        column[sx] = qMin(sx * dw / w, dw - 1);
+        columnWidth[column[sx]]++;
+    }
+
+    QByteArray scaledData(dw * dh * 3, Qt::Uninitialized);
+    uint8_t* dst = reinterpret_cast<uint8_t*>(scaledData.data());
+    QVector<quint32> sums(dw * 3);
+
+    for (int y = 0; y < dh; ++y)
+    {
+        const int sy0 = y * h / dh;
+        const int sy1 = qMax(sy0 + 1, (y + 1) * h / dh);
+
+        sums.fill(0);
+        for (int sy = sy0; sy < sy1; ++sy)
+        {
+            const uint8_t* row = src + sy * w * 3;
+            for (int sx = 0; sx < w; ++sx)
+            {
+                quint32* sum = sums.data() + column[sx] * 3;
+                sum[0] += row[sx * 3];
+                sum[1] += row[sx * 3 + 1];
+                sum[2] += row[sx * 3 + 2];
+            }
+        }
+
+        for (int x = 0; x < dw; ++x)
+        {
+            const quint32 count = columnWidth[x] * (sy1 - sy0);
+            for (int c = 0; c < 3; ++c)
+                *dst++ = (sums[x * 3 + c] + count / 2) / count;
+        }
+    }
+
+    return VideoFrame(scaledData, QSize(dw, dh), format, timestamp);
+}
 
 vpx_image_t VideoFrame::createVpxImage() const
 {
@@ -31,6 +88,31 @@ vpx_image_t VideoFrame::createVpxImage() const
     // http://fourcc.org/yuv.php#IYUV
     vpx_img_alloc(&img, VPX_IMG_FMT_VPXI420, w, h, 1);
 
+    if (format == YUV)
+    {
+        // Packed YUV as produced by NetVideoSource, see pushVPXFrame for the plane order
+        for (int y = 0; y < h; ++y)
+        {
+            for (int x = 0; x < w; ++x)
+            {
+                const uint8_t* px = reinterpret_cast<const uint8_t*>(frameData.data()) + (x + y * w) * 3;
+
+                img.planes[VPX_PLANE_Y][x + y * img.stride[VPX_PLANE_Y]] = px[0];
+
+                if (!(x % (1 << img.x_chroma_shift)) && !(y % (1 << img.y_chroma_shift)))
+                {
+                    const int i = x / (1 << img.x_chroma_shift);
+                    const int j = y / (1 << img.y_chroma_shift);
+
+                    img.planes[VPX_PLANE_V][i + j * img.stride[VPX_PLANE_V]] = px[1];
+                    img.planes[VPX_PLANE_U][i + j * img.stride[VPX_PLANE_U]] = px[2];
+                }
+            }
+        }
+
+        return img;
+    }
+
     for (int y = 0; y < h; ++y)
     {
         for (int x = 0; x < w; ++x)
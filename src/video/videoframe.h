@@ -35,9 +35,10 @@ struct VideoFrame
     QByteArray frameData;
     QSize resolution;
     ColorFormat format;
+    qint64 timestamp; ///< LatencyRecorder::now() when captured or received, 0 if unknown
 
-    VideoFrame() : format(NONE) {}
-    VideoFrame(QByteArray d, QSize r, ColorFormat f) : frameData(d), resolution(r), format(f) {}
+    VideoFrame() : format(NONE), timestamp(0) {}
+    VideoFrame(QByteArray d, QSize r, ColorFormat f, qint64 t = 0) : frameData(d), resolution(r), format(f), timestamp(t) {}
 
     void invalidate()
     {
@@ -50,6 +51,7 @@ struct VideoFrame
         return !frameData.isEmpty() && resolution.isValid() && format != NONE;
     }
 
+    VideoFrame downscaled(QSize target) const; ///< Box filter over each pixel's whole footprint, returns the frame as is if target isn't smaller
     vpx_image_t createVpxImage() const;
 };
 
@@ -0,0 +1,46 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "videoframeslot.h"
+
+const int VideoFrameSlot::freshFlag;
+
+VideoFrameSlot::VideoFrameSlot()
+    : back{0}, front{1}, middle{2}
+{
+}
+
+bool VideoFrameSlot::publish(const VideoFrame& frame)
+{
+    frames[back] = frame;
+    const int previous = middle.exchange(back | freshFlag, std::memory_order_acq_rel);
+    back = previous & ~freshFlag;
+
+    // Don't keep the replaced frame's data alive until it gets overwritten
+    frames[back] = VideoFrame();
+    return !(previous & freshFlag);
+}
+
+bool VideoFrameSlot::take(VideoFrame& frame)
+{
+    if (!(middle.load(std::memory_order_acquire) & freshFlag))
+        return false;
+
+    frames[front] = VideoFrame();
+    front = middle.exchange(front, std::memory_order_acq_rel) & ~freshFlag;
+    frame = frames[front];
+    return true;
+}
@@ -0,0 +1,47 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef VIDEOFRAMESLOT_H
+#define VIDEOFRAMESLOT_H
+
+#include "videoframe.h"
+#include <atomic>
+
+/**
+ * Hands the newest frame of one producer thread to one consumer thread.
+ * Triple buffered: the producer never waits for the consumer, the consumer always
+ * gets the latest complete frame, and frames it didn't take in time are replaced
+ * in place. Frames are implicitly shared, nothing is deep copied.
+ **/
+
+class VideoFrameSlot
+{
+public:
+    VideoFrameSlot();
+
+    bool publish(const VideoFrame& frame); ///< Producer side, returns false if it replaced a frame nobody took
+    bool take(VideoFrame& frame); ///< Consumer side, returns false if nothing new was published since the last take
+
+private:
+    static const int freshFlag = 4;
+
+    VideoFrame frames[3];
+    int back; ///< Only touched by the producer
+    int front; ///< Only touched by the consumer
+    std::atomic<int> middle; ///< The slot in between, with freshFlag until the consumer takes it
+};
+
+#endif // VIDEOFRAMESLOT_H
@@ -0,0 +1,195 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "videoratecontroller.h"
+
+#include <QDebug>
+#include <QMutexLocker>
+
+// Resolution ladder in quarters of the source resolution
+static const int scaleLadder[] = {4, 3, 2, 1};
+static const int scaleLevels = sizeof(scaleLadder) / sizeof(scaleLadder[0]);
+
+// Frame interval ladder in ms, the first one is what calls always used
+static const int intervalLadder[] = {50, 66, 100, 200};
+static const int intervalLevels = sizeof(intervalLadder) / sizeof(intervalLadder[0]);
+
+const int VideoRateController::windowMs;
+const int VideoRateController::cleanWindowsToUpgrade;
+const unsigned VideoRateController::minBitrate;
+
+VideoRateController::VideoRateController()
+{
+    reset(0);
+}
+
+void VideoRateController::reset(unsigned maxBitrate)
+{
+    scaleLevel = 0;
+    rateLevel = 0;
+    this->maxBitrate = maxBitrate;
+    curBitrate = maxBitrate;
+    cleanWindows = 0;
+
+    window.start();
+    windowFrames = 0;
+    windowFailures = 0;
+    windowEncodeUs = 0;
+    windowBytes = 0;
+
+    QMutexLocker lock(&statsMutex);
+    stats = Stats();
+    stats.frameInterval = intervalLadder[0];
+    stats.bitrate = curBitrate;
+}
+
+QSize VideoRateController::targetResolution(QSize sourceRes) const
+{
+    const int scale = scaleLadder[scaleLevel];
+    if (scale == 4)
+        return sourceRes;
+
+    // Keep the dimensions even for the I420 chroma planes
+    return QSize((sourceRes.width() * scale / 4) & ~1, (sourceRes.height() * scale / 4) & ~1);
+}
+
+int VideoRateController::frameInterval() const
+{
+    return intervalLadder[rateLevel];
+}
+
+unsigned VideoRateController::bitrate() const
+{
+    return curBitrate;
+}
+
+void VideoRateController::frameSent(QSize resolution, qint64 encodeUs, int frameBytes, bool failed)
+{
+    windowFrames++;
+    windowEncodeUs += encodeUs;
+    if (failed)
+        windowFailures++;
+    else
+        windowBytes += frameBytes;
+
+    {
+        QMutexLocker lock(&statsMutex);
+        stats.resolution = resolution;
+        if (failed)
+            stats.sendFailures++;
+    }
+
+    if (window.elapsed() >= windowMs)
+        evaluate();
+}
+
+VideoRateController::Stats VideoRateController::getStats() const
+{
+    QMutexLocker lock(&statsMutex);
+    return stats;
+}
+
+void VideoRateController::evaluate()
+{
+    const qint64 elapsed = window.restart();
+    const int meanEncodeUs = windowEncodeUs / windowFrames;
+    const int sentFrames = windowFrames - windowFailures;
+    const int meanBytes = sentFrames ? windowBytes / sentFrames : 0;
+
+    // Encoding takes most of the frame interval, we can't keep up whatever the link does
+    const bool cpuBound = meanEncodeUs > frameInterval() * 800;
+    const bool congested = windowFailures > 0;
+    const unsigned sentKbps = elapsed ? windowBytes * 8 / elapsed : 0;
+    const bool overBudget = sentKbps > curBitrate + curBitrate / 8;
+
+    if (congested || cpuBound || overBudget)
+    {
+        cleanWindows = 0;
+
+        if (congested && curBitrate > minBitrate)
+        {
+            // Aim below what actually went through during this window
+            unsigned target = curBitrate * 3 / 4;
+            if (sentKbps && sentKbps < target)
+                target = sentKbps;
+            curBitrate = target > minBitrate ? target : minBitrate;
+        }
+
+        // The encoder only sends less with smaller or fewer frames
+        if (cpuBound || overBudget || windowFailures * 4 > windowFrames || curBitrate == minBitrate)
+            stepDown(cpuBound);
+    }
+    else if (++cleanWindows >= cleanWindowsToUpgrade)
+    {
+        cleanWindows = 0;
+        stepUp();
+    }
+
+    {
+        QMutexLocker lock(&statsMutex);
+        stats.frameInterval = frameInterval();
+        stats.bitrate = curBitrate;
+        stats.encodeTime = meanEncodeUs;
+        stats.frameBytes = meanBytes;
+    }
+
+    windowFrames = 0;
+    windowFailures = 0;
+    windowEncodeUs = 0;
+    windowBytes = 0;
+}
+
+void VideoRateController::stepDown(bool cpuBound)
+{
+    // Resolution goes first down to half, then the frame rate, then the rest of the resolution
+    if (scaleLevel < 2 || (cpuBound && scaleLevel < scaleLevels - 1))
+        scaleLevel++;
+    else if (rateLevel < intervalLevels - 1)
+        rateLevel++;
+    else if (scaleLevel < scaleLevels - 1)
+        scaleLevel++;
+    else
+        return;
+
+    qDebug() << "VideoRateController: Stepping down to scale" << scaleLadder[scaleLevel] << "/4,"
+             << intervalLadder[rateLevel] << "ms," << curBitrate << "kbit/s";
+
+    QMutexLocker lock(&statsMutex);
+    stats.downgrades++;
+}
+
+void VideoRateController::stepUp()
+{
+    if (curBitrate < maxBitrate)
+    {
+        unsigned target = curBitrate * 5 / 4;
+        curBitrate = target < maxBitrate ? target : maxBitrate;
+    }
+    else if (scaleLevel > 2)
+        scaleLevel--;
+    else if (rateLevel > 0)
+        rateLevel--;
+    else if (scaleLevel > 0)
+        scaleLevel--;
+    else
+        return;
+
+    qDebug() << "VideoRateController: Stepping up to scale" << scaleLadder[scaleLevel] << "/4,"
+             << intervalLadder[rateLevel] << "ms," << curBitrate << "kbit/s";
+
+    QMutexLocker lock(&statsMutex);
+    stats.upgrades++;
+}
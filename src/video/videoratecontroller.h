@@ -0,0 +1,89 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef VIDEORATECONTROLLER_H
+#define VIDEORATECONTROLLER_H
+
+#include <QSize>
+#include <QMutex>
+#include <QElapsedTimer>
+#include <atomic>
+
+/**
+ * Decides the resolution, frame interval and bitrate of a call's outgoing video.
+ * It is fed the outcome of every sent frame and re-evaluates once per window:
+ * send failures and encode times close to the frame interval step the quality down,
+ * a run of clean windows steps it back up.
+ * The bitrate is a budget kept on the encoding side: toxav has no way to retune its running VP8 encoder,
+ * so windows sending more than it step the resolution or the frame rate down.
+ * frameSent() and the bitrate are used from the thread sending the call's video,
+ * targetResolution() and frameInterval() may be read from the encoding thread, getStats() from anywhere.
+ **/
+
+class VideoRateController
+{
+public:
+    struct Stats
+    {
+        QSize resolution; ///< Resolution of the last frame sent
+        int frameInterval = 0; ///< ms between two frames
+        unsigned bitrate = 0; ///< Target bitrate in kbit/s
+        int encodeTime = 0; ///< Mean time spent converting and encoding a frame, in µs
+        int frameBytes = 0; ///< Mean encoded frame size
+        int sendFailures = 0; ///< Failed toxav_send_video since the call started
+        int downgrades = 0;
+        int upgrades = 0;
+    };
+
+    VideoRateController();
+
+    void reset(unsigned maxBitrate); ///< Call when a call starts, restores full quality
+
+    QSize targetResolution(QSize sourceRes) const; ///< Resolution to downscale the source to before encoding
+    int frameInterval() const;
+    unsigned bitrate() const;
+
+    void frameSent(QSize resolution, qint64 encodeUs, int frameBytes, bool failed);
+
+    Stats getStats() const;
+
+private:
+    void evaluate();
+    void stepDown(bool cpuBound);
+    void stepUp();
+
+private:
+    static const int windowMs = 1000;
+    static const int cleanWindowsToUpgrade = 5;
+    static const unsigned minBitrate = 100;
+
+    std::atomic<int> scaleLevel; ///< Index in the scale ladder, 0 is full resolution
+    std::atomic<int> rateLevel; ///< Index in the frame interval ladder, 0 is the fastest
+    unsigned maxBitrate;
+    unsigned curBitrate;
+    int cleanWindows;
+
+    QElapsedTimer window;
+    int windowFrames;
+    int windowFailures;
+    qint64 windowEncodeUs;
+    qint64 windowBytes;
+
+    mutable QMutex statsMutex;
+    Stats stats;
+};
+
+#endif // VIDEORATECONTROLLER_H
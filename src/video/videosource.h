@@ -31,6 +31,9 @@ public:
     virtual void subscribe() = 0;
     virtual void unsubscribe() = 0;
 
+    /// Returns the most recent frame, or an invalid frame if the source doesn't keep one
+    virtual VideoFrame getLastFrame() { return VideoFrame(); }
+
 signals:
     void frameAvailable(const VideoFrame& frame);
 
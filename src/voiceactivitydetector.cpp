@@ -0,0 +1,101 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "voiceactivitydetector.h"
+
+#include <cmath>
+
+// Anything quieter than this is silence whatever the noise floor
+static const float minSpeechDb = -55.f;
+static const float initialNoiseFloorDb = -60.f;
+// Extra dB asked of frames that cross zero more often than speech does
+static const float hissZeroCrossings = 0.4f;
+static const float hissMarginDb = 6.f;
+
+VoiceActivityDetector::VoiceActivityDetector()
+    : frames{0}, suppressed{0}
+{
+    reset(false, 9, 400, 20);
+}
+
+void VoiceActivityDetector::reset(bool enabled, int thresholdDb, int hangoverMs, int frameMs)
+{
+    this->enabled = enabled;
+    threshold = thresholdDb;
+    hangoverFrames = frameMs > 0 ? hangoverMs / frameMs : 0;
+    hangoverLeft = 0;
+    noiseFloor = initialNoiseFloorDb;
+    speaking = false;
+    frames = 0;
+    suppressed = 0;
+}
+
+bool VoiceActivityDetector::process(const int16_t* frame, int samples)
+{
+    frames++;
+    if (samples <= 0)
+        return true;
+
+    int64_t energy = 0;
+    int crossings = 0;
+    for (int i = 0; i < samples; ++i)
+    {
+        energy += frame[i] * frame[i];
+        if (i && (frame[i] ^ frame[i - 1]) < 0)
+            crossings++;
+    }
+
+    const float power = static_cast<float>(energy) / samples / (32768.f * 32768.f);
+    const float db = 10.f * std::log10(power + 1e-10f);
+    const float zcr = samples > 1 ? static_cast<float>(crossings) / (samples - 1) : 0;
+
+    float margin = threshold;
+    if (zcr > hissZeroCrossings)
+        margin += hissMarginDb;
+    const bool voiced = db > minSpeechDb && db > noiseFloor + margin;
+
+    // Follow drops in the noise quickly, and rises slowly, so speech doesn't raise the floor
+    if (!voiced)
+        noiseFloor += (db - noiseFloor) * (db < noiseFloor ? 0.2f : 0.02f);
+    else
+        noiseFloor += (db - noiseFloor) * 0.001f;
+
+    if (voiced)
+        hangoverLeft = hangoverFrames;
+    else if (hangoverLeft > 0)
+        hangoverLeft--;
+    speaking = voiced || hangoverLeft > 0;
+
+    if (!enabled || speaking)
+        return true;
+
+    suppressed++;
+    return false;
+}
+
+bool VoiceActivityDetector::isSpeaking() const
+{
+    return speaking;
+}
+
+VoiceActivityDetector::Stats VoiceActivityDetector::getStats() const
+{
+    Stats stats;
+    stats.frames = frames;
+    stats.suppressed = suppressed;
+    stats.reduction = stats.frames ? static_cast<int>(100 * stats.suppressed / stats.frames) : 0;
+    return stats;
+}
@@ -0,0 +1,63 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef VOICEACTIVITYDETECTOR_H
+#define VOICEACTIVITYDETECTOR_H
+
+#include <QtGlobal>
+#include <atomic>
+#include <cstdint>
+
+/**
+ * Tells speech from silence in our outgoing audio, so silent frames needn't be
+ * encoded and sent. A frame is speech when its energy stands far enough above
+ * the tracked noise floor, hiss with a high zero crossing rate needs more.
+ * Speech keeps the detector open for a hangover, so word endings aren't cut.
+ * When filter_audio is built in the frames it sees are already denoised.
+ * Only used from the thread sending the audio, except for getStats().
+ **/
+
+class VoiceActivityDetector
+{
+public:
+    struct Stats
+    {
+        quint64 frames = 0;
+        quint64 suppressed = 0; ///< Silent frames that weren't sent
+        int reduction = 0; ///< Percentage of frames that weren't sent
+    };
+
+    VoiceActivityDetector();
+
+    /// Call when a call starts, a disabled detector still tracks speech but lets every frame through
+    void reset(bool enabled, int thresholdDb, int hangoverMs, int frameMs);
+
+    bool process(const int16_t* frame, int samples); ///< Returns true if the frame should be sent
+    bool isSpeaking() const;
+
+    Stats getStats() const;
+
+private:
+    bool enabled;
+    float threshold;
+    int hangoverFrames;
+    int hangoverLeft;
+    float noiseFloor; ///< dBFS
+    std::atomic<bool> speaking;
+    std::atomic<quint64> frames, suppressed;
+};
+
+#endif // VOICEACTIVITYDETECTOR_H
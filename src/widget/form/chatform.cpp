@@ -328,7 +328,8 @@ void ChatForm::onAvStart(int FriendId, int CallId, bool video)
         connect(videoButton, SIGNAL(clicked()),
                 this, SLOT(onHangupCallTriggered()));
 
-        netcam->show(Core::getInstance()->getVideoSourceFromCall(CallId), f->getDisplayedName());
+        netcam->show(Core::getInstance()->getVideoSourceFromCall(CallId), f->getDisplayedName(),
+                     Core::getCallLatency(CallId));
     }
     else
     {
@@ -446,7 +447,8 @@ void ChatForm::onAvStarting(int FriendId, int CallId, bool video)
         videoButton->setToolTip(tr("End video call"));
         connect(videoButton, SIGNAL(clicked()), this, SLOT(onHangupCallTriggered()));
 
-        netcam->show(Core::getInstance()->getVideoSourceFromCall(CallId), f->getDisplayedName());
+        netcam->show(Core::getInstance()->getVideoSourceFromCall(CallId), f->getDisplayedName(),
+                     Core::getCallLatency(CallId));
     }
     else
     {
@@ -527,6 +529,15 @@ void ChatForm::onAvRejected(int FriendId, int)
     netcam->hide();
 }
 
+void ChatForm::onAvSelfSpeaking(int FriendId, int, bool speaking)
+{
+    if (FriendId != f->getFriendID())
+        return;
+
+    micButton->setProperty("speaking", speaking);
+    Style::repolish(micButton);
+}
+
 void ChatForm::onAvMediaChange(int FriendId, int CallId, bool video)
 {
     if (FriendId != f->getFriendID() || CallId != callId)
@@ -536,7 +547,8 @@ void ChatForm::onAvMediaChange(int FriendId, int CallId, bool video)
 
     if (video)
     {
-        netcam->show(Core::getInstance()->getVideoSourceFromCall(CallId), f->getDisplayedName());
+        netcam->show(Core::getInstance()->getVideoSourceFromCall(CallId), f->getDisplayedName(),
+                     Core::getCallLatency(CallId));
     }
     else
     {
@@ -641,6 +653,7 @@ void ChatForm::enableCallButtons()
     audioOutputFlag = false;
     
     micButton->setObjectName("grey");
+    micButton->setProperty("speaking", false);
     micButton->style()->polish(micButton);
     micButton->setToolTip("");
     micButton->disconnect();    
@@ -790,88 +803,62 @@ void ChatForm::onAvatarRemoved(int FriendId)
     avatar->setPixmap(QPixmap(":/img/contact_dark.png"), Qt::transparent);
 }
 
-void ChatForm::loadHistory(QDateTime since, bool processUndelivered)
+void ChatForm::loadHistory(QDateTime resendSince)
 {
-    QDateTime now = historyBaselineDate.addMSecs(-1);
+    // Before the page, which then shows the messages sent again
+    if (resendSince.isValid())
+        resendUndelivered(resendSince);
 
-    if (since > now)
-        return;
+    if (historyCursorId == 0)
+        requestHistoryPage();
+}
 
-    if (!earliestMessage.isNull())
+void ChatForm::resendUndelivered(const QDateTime &since)
+{
+    HistoryKeeper::getInstance()->getUndeliveredMessages(f->getToxID().publicKey, since, this,
+                                                         [=](QList<HistoryKeeper::HistMessage> msgs)
     {
-        if (earliestMessage < since)
-            return;
-        if (earliestMessage < now)
+        for (const auto &it : msgs)
         {
-            now = earliestMessage;
-            now = now.addMSecs(-1);
-        }
-    }
-
-    auto msgs = HistoryKeeper::getInstance()->getChatHistory(HistoryKeeper::ctSingle, f->getToxID().publicKey, since, now);
+            if (!ToxID::fromString(it.sender).isMine() || getOfflineMsgEngine()->getUndeliveredMsg(it.id))
+                continue;
 
-    ToxID storedPrevId = previousId;
-    ToxID prevId;
+            // A message whose page is already shown gets marked as sent there
+            ChatMessage::Ptr msg = historyLines.value(it.id);
+            if (!msg)
+                msg = GenericChatForm::createHistoryMessage(it);
 
-    QList<ChatLine::Ptr> historyMessages;
+            int rec;
+            if (!it.message.startsWith("/me "))
+                rec = Core::getInstance()->sendMessage(f->getFriendID(), msg->toString());
+            else
+                rec = Core::getInstance()->sendAction(f->getFriendID(), msg->toString());
 
-    QDate lastDate(1,0,0);
-    for (const auto &it : msgs)
-    {
-        // Show the date every new day
-        QDateTime msgDateTime = it.timestamp.toLocalTime();
-        QDate msgDate = msgDateTime.date();
-        if (msgDate > lastDate)
-        {
-            lastDate = msgDate;
-            historyMessages.append(ChatMessage::createChatInfoMessage(msgDate.toString(), ChatMessage::INFO, QDateTime()));
+            getOfflineMsgEngine()->registerReceipt(rec, it.id, msg);
         }
+    });
+}
 
-        // Show each messages
-        ToxID authorId = ToxID::fromString(it.sender);
-        QString authorStr = authorId.isMine() ? Core::getInstance()->getUsername() : resolveToxID(authorId);
-        bool isAction = it.message.startsWith("/me ");
-
-        ChatMessage::Ptr msg = ChatMessage::createChatMessage(authorStr,
-                                                              isAction ? it.message.right(it.message.length() - 4) : it.message,
-                                                              isAction ? ChatMessage::ACTION : ChatMessage::NORMAL,
-                                                              authorId.isMine(),
-                                                              QDateTime());
-
-        if(!isAction && prevId == authorId)
-            msg->hideSender();
+QString ChatForm::historyChat() const
+{
+    return f->getToxID().publicKey;
+}
 
-        prevId = authorId;
+HistoryKeeper::ChatType ChatForm::historyChatType() const
+{
+    return HistoryKeeper::ctSingle;
+}
 
-        if (it.isSent || !authorId.isMine())
-        {
-            msg->markAsSent(msgDateTime);
-        }
-        else
-        {
-            if (processUndelivered)
-            {
-                int rec;
-                if (!isAction)
-                    rec = Core::getInstance()->sendMessage(f->getFriendID(), msg->toString());
-                else
-                    rec = Core::getInstance()->sendAction(f->getFriendID(), msg->toString());
-                
-                getOfflineMsgEngine()->registerReceipt(rec, it.id, msg);
-            }
-        }
-        historyMessages.append(msg);
+ChatMessage::Ptr ChatForm::createHistoryMessage(const HistoryKeeper::HistMessage &it)
+{
+    // Sent again before its page was loaded, the receipt marks this one
+    if (!it.isSent)
+    {
+        if (ChatMessage::Ptr msg = getOfflineMsgEngine()->getUndeliveredMsg(it.id))
+            return msg;
     }
 
-    previousId = storedPrevId;
-    int savedSliderPos = chatWidget->verticalScrollBar()->maximum() - chatWidget->verticalScrollBar()->value();
-
-    earliestMessage = since;
-
-    chatWidget->insertChatlineOnTop(historyMessages);
-
-    savedSliderPos = chatWidget->verticalScrollBar()->maximum() - savedSliderPos;
-    chatWidget->verticalScrollBar()->setValue(savedSliderPos);
+    return GenericChatForm::createHistoryMessage(it);
 }
 
 void ChatForm::onLoadHistory()
@@ -880,8 +867,8 @@ void ChatForm::onLoadHistory()
 
     if (dlg.exec())
     {
-        QDateTime fromTime = dlg.getFromDate();
-        loadHistory(fromTime);
+        historyTarget = dlg.getFromDate();
+        requestHistoryPage();
     }
 }
 
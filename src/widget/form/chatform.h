@@ -41,7 +41,9 @@ public:
     ChatForm(Friend* chatFriend);
     ~ChatForm();
     void setStatusMessage(QString newMessage);
-    void loadHistory(QDateTime since, bool processUndelivered = false);
+    /// Shows the latest page of history, older ones follow as the chat is scrolled up.
+    /// Undelivered messages newer than resendSince are sent again right away, whether their page is loaded or not.
+    void loadHistory(QDateTime resendSince = QDateTime());
 
     void dischargeReceipt(int receipt);
     void setFriendTyping(bool isTyping);
@@ -76,6 +78,7 @@ public slots:
     void onAvMediaChange(int FriendId, int CallId, bool video);
     void onAvCallFailed(int FriendId);
     void onAvRejected(int FriendId, int CallId);
+    void onAvSelfSpeaking(int FriendId, int CallId, bool speaking);
     void onMicMuteToggle();
     void onVolMuteToggle();
     void onAvatarChange(int FriendId, const QPixmap& pic);
@@ -102,6 +105,9 @@ protected:
     void dropEvent(QDropEvent* ev);
     void registerReceipt(int receipt, int messageID, ChatMessage::Ptr msg);
     virtual void hideEvent(QHideEvent* event);
+    virtual QString historyChat() const; ///< The friend's public key
+    virtual HistoryKeeper::ChatType historyChatType() const;
+    virtual ChatMessage::Ptr createHistoryMessage(const HistoryKeeper::HistMessage &it); ///< Reuses the messages sent again before their page loaded
 
 private:
     Friend* f;
@@ -122,6 +128,8 @@ private:
     CallConfirmWidget *callConfirm;
     void enableCallButtons();
     bool isTyping;
+
+    void resendUndelivered(const QDateTime &since);
 };
 
 #endif // CHATFORM_H
@@ -20,6 +20,9 @@
 #include <QFileDialog>
 #include <QHBoxLayout>
 #include <QDebug>
+#include <QLineEdit>
+#include <QListWidget>
+#include <QShortcut>
 
 #include "src/misc/smileypack.h"
 #include "src/widget/emoticonswidget.h"
@@ -36,6 +39,9 @@
 #include "src/chatlog/chatlog.h"
 #include "src/chatlog/content/timestamp.h"
 
+const int GenericChatForm::historyPageSize;
+const int GenericChatForm::searchHitCount;
+
 GenericChatForm::GenericChatForm(QWidget *parent)
   : QWidget(parent)
   , audioInputFlag(false)
@@ -67,6 +73,22 @@ GenericChatForm::GenericChatForm(QWidget *parent)
 
     connect(&Settings::getInstance(), &Settings::emojiFontChanged, this, [this]() { chatWidget->forceRelayout(); });
 
+    searchWidget = new QWidget();
+    searchEdit = new QLineEdit();
+    searchEdit->setPlaceholderText(tr("Search history"));
+    searchEdit->setClearButtonEnabled(true);
+    searchHits = new QListWidget();
+    searchHits->setMaximumHeight(150);
+    searchHits->hide();
+    QVBoxLayout *searchLayout = new QVBoxLayout(searchWidget);
+    searchLayout->setMargin(0);
+    searchLayout->addWidget(searchEdit);
+    searchLayout->addWidget(searchHits);
+    searchWidget->hide();
+
+    searchTimer.setSingleShot(true);
+    searchTimer.setInterval(200);
+
     msgEdit = new ChatTextEdit();
 
     sendButton = new QPushButton();
@@ -115,6 +137,7 @@ GenericChatForm::GenericChatForm(QWidget *parent)
     micButton->setStyleSheet(micButtonStylesheet);
 
     setLayout(mainLayout);
+    mainLayout->addWidget(searchWidget);
     mainLayout->addWidget(chatWidget);
     mainLayout->addLayout(mainFootLayout);
     mainLayout->setMargin(0);
@@ -164,10 +187,22 @@ GenericChatForm::GenericChatForm(QWidget *parent)
     menu.addSeparator();
     menu.addAction(QIcon::fromTheme("document-save"), tr("Save chat log"), this, SLOT(onSaveLogClicked()));
     menu.addAction(QIcon::fromTheme("edit-clear"), tr("Clear displayed messages"), this, SLOT(clearChatArea(bool)));
+    menu.addAction(QIcon::fromTheme("edit-find"), tr("Search history"), this, SLOT(toggleSearch()));
     menu.addSeparator();
 
     connect(emoteButton, &QPushButton::clicked, this, &GenericChatForm::onEmoteButtonClicked);
     connect(chatWidget, &ChatLog::customContextMenuRequested, this, &GenericChatForm::onChatContextMenuRequested);
+    connect(chatWidget, &ChatLog::nearTop, this, &GenericChatForm::loadHistoryPage);
+    connect(searchEdit, &QLineEdit::textChanged, this, [this]() { searchTimer.start(); });
+    connect(&searchTimer, &QTimer::timeout, this, &GenericChatForm::onSearchTimeout);
+    connect(searchHits, &QListWidget::itemActivated, this, &GenericChatForm::onSearchHitActivated);
+    connect(searchHits, &QListWidget::itemClicked, this, &GenericChatForm::onSearchHitActivated);
+    connect(new QShortcut(QKeySequence::Find, this), &QShortcut::activated, this, &GenericChatForm::toggleSearch);
+    QShortcut *closeSearch = new QShortcut(Qt::Key_Escape, searchWidget);
+    closeSearch->setContext(Qt::WidgetWithChildrenShortcut);
+    connect(closeSearch, &QShortcut::activated, this, &GenericChatForm::toggleSearch);
+
+    resetHistoryPaging();
 
     chatWidget->setStyleSheet(Style::getStylesheet(":/ui/chatArea/chatArea.css"));
     headWidget->setStyleSheet(Style::getStylesheet(":/ui/chatArea/chatHead.css"));
@@ -330,8 +365,8 @@ void GenericChatForm::clearChatArea(bool notinform)
     if (!notinform)
         addSystemInfoMessage(tr("Cleared"), ChatMessage::INFO, QDateTime::currentDateTime());
 
-    earliestMessage = QDateTime(); //null
     historyBaselineDate = QDateTime::currentDateTime();
+    resetHistoryPaging();
 
     emit chatAreaCleared();
 }
@@ -341,6 +376,261 @@ void GenericChatForm::onSelectAllClicked()
     chatWidget->selectAll();
 }
 
+void GenericChatForm::loadHistoryPage()
+{
+    if (historyCursorId != 0)
+        requestHistoryPage();
+}
+
+void GenericChatForm::resetHistoryPaging()
+{
+    historyCursorTime = historyBaselineDate.toMSecsSinceEpoch();
+    historyCursorId = 0;
+    historyTopDate = QDate();
+    historyTarget = QDateTime();
+    historyGeneration++;
+    historyLoading = false;
+    historyExhausted = false;
+    historyLines.clear();
+    historyJumpId = 0;
+    historyJumpTime = 0;
+    historyJumpPages = 0;
+    historyWindowed = false;
+}
+
+QString GenericChatForm::historyChat() const
+{
+    return QString();
+}
+
+HistoryKeeper::ChatType GenericChatForm::historyChatType() const
+{
+    return HistoryKeeper::ctSingle;
+}
+
+void GenericChatForm::requestHistoryPage()
+{
+    const QString chat = historyChat();
+    if (historyLoading || historyExhausted || chat.isEmpty())
+        return;
+
+    historyLoading = true;
+    int generation = historyGeneration;
+    HistoryKeeper::getInstance()->getChatHistoryPage(historyChatType(), chat,
+                                                     historyCursorTime, historyCursorId, historyPageSize, this,
+                                                     [=](QList<HistoryKeeper::HistMessage> msgs)
+    {
+        if (generation == historyGeneration)
+            insertHistoryPage(msgs);
+    });
+}
+
+void GenericChatForm::insertHistoryPage(const QList<HistoryKeeper::HistMessage> &msgs)
+{
+    historyLoading = false;
+    historyExhausted = msgs.size() < historyPageSize;
+
+    ToxID prevId;
+
+    QList<ChatLine::Ptr> historyMessages;
+
+    QDate lastDate;
+    for (const auto &it : msgs)
+    {
+        // Show the date every new day, the first day of the page may go on in the next one
+        QDate msgDate = it.timestamp.toLocalTime().date();
+        if (lastDate.isValid() && msgDate != lastDate)
+            historyMessages.append(ChatMessage::createChatInfoMessage(msgDate.toString(), ChatMessage::INFO, QDateTime()));
+        lastDate = msgDate;
+
+        // Show each messages
+        ChatMessage::Ptr msg = createHistoryMessage(it);
+
+        ToxID authorId = ToxID::fromString(it.sender);
+        if(!it.message.startsWith("/me ") && prevId == authorId)
+            msg->hideSender();
+
+        prevId = authorId;
+
+        historyLines[it.id] = msg;
+        historyMessages.append(msg);
+    }
+
+    if (!msgs.isEmpty())
+    {
+        // The day the newer page started with didn't start there
+        if (historyTopDate.isValid() && historyTopDate != lastDate)
+            historyMessages.append(ChatMessage::createChatInfoMessage(historyTopDate.toString(), ChatMessage::INFO, QDateTime()));
+
+        historyTopDate = msgs.first().timestamp.toLocalTime().date();
+        historyCursorTime = msgs.first().timestamp.toMSecsSinceEpoch();
+        historyCursorId = msgs.first().id;
+    }
+
+    if (historyExhausted && historyTopDate.isValid())
+    {
+        historyMessages.prepend(ChatMessage::createChatInfoMessage(historyTopDate.toString(), ChatMessage::INFO, QDateTime()));
+        historyTopDate = QDate();
+    }
+
+    chatWidget->insertChatlineOnTop(historyMessages);
+
+    if (historyJumpId != 0)
+    {
+        if (ChatLine::Ptr line = historyLines.value(historyJumpId))
+        {
+            chatWidget->scrollToLine(line);
+            historyJumpId = 0;
+        }
+        else if (historyExhausted)
+        {
+            historyJumpId = 0;
+        }
+        else if (++historyJumpPages >= maxJumpPages)
+        {
+            showHistoryWindow(historyJumpTime, historyJumpId);
+            return;
+        }
+    }
+
+    // The date picked in the dialog or the message jumped to can be pages back
+    if (historyJumpId != 0 || (historyTarget.isValid() && historyCursorTime > historyTarget.toMSecsSinceEpoch()))
+        requestHistoryPage();
+}
+
+ChatMessage::Ptr GenericChatForm::createHistoryMessage(const HistoryKeeper::HistMessage &msg)
+{
+    ToxID authorId = ToxID::fromString(msg.sender);
+    QString authorStr = authorId.isMine() ? Core::getInstance()->getUsername() : resolveToxID(authorId);
+    bool isAction = msg.message.startsWith("/me ");
+
+    ChatMessage::Ptr line = ChatMessage::createChatMessage(authorStr,
+                                                           isAction ? msg.message.right(msg.message.length() - 4) : msg.message,
+                                                           isAction ? ChatMessage::ACTION : ChatMessage::NORMAL,
+                                                           authorId.isMine(),
+                                                           QDateTime());
+
+    if (msg.isSent || !authorId.isMine())
+        line->markAsSent(msg.timestamp.toLocalTime());
+
+    return line;
+}
+
+void GenericChatForm::jumpToHistory(qint64 time, qint64 id)
+{
+    if (ChatLine::Ptr line = historyLines.value(id))
+    {
+        chatWidget->scrollToLine(line);
+        return;
+    }
+
+    // Shown without coming from history, like the messages of this session, or hidden by a window
+    if (time > historyCursorTime || (time == historyCursorTime && id > historyCursorId))
+    {
+        if (historyWindowed)
+            showHistoryWindow(time, id);
+        return;
+    }
+
+    historyJumpId = id;
+    historyJumpTime = time;
+    historyJumpPages = 0;
+    requestHistoryPage();
+}
+
+void GenericChatForm::showHistoryWindow(qint64 time, qint64 id)
+{
+    // Every page up to the message could be most of the history, the chat starts over from it instead
+    chatWidget->clear();
+    previousId = ToxID();
+    addSystemInfoMessage(tr("Newer messages are hidden, clear the chat to show them again"), ChatMessage::INFO, QDateTime::currentDateTime());
+
+    // The first page ends with the message
+    resetHistoryPaging();
+    historyCursorTime = time;
+    historyCursorId = id + 1;
+    historyJumpId = id;
+    historyJumpTime = time;
+    historyWindowed = true;
+    requestHistoryPage();
+}
+
+void GenericChatForm::toggleSearch()
+{
+    if (searchWidget->isVisible())
+    {
+        searchWidget->hide();
+        searchEdit->clear();
+        msgEdit->setFocus();
+    }
+    else
+    {
+        searchWidget->show();
+        searchEdit->setFocus();
+    }
+}
+
+void GenericChatForm::onSearchTimeout()
+{
+    QString phrase = searchEdit->text().trimmed();
+    if (phrase.isEmpty())
+    {
+        searchHits->clear();
+        searchHits->hide();
+        return;
+    }
+
+    searchHistory(phrase);
+}
+
+void GenericChatForm::searchHistory(const QString &phrase)
+{
+    const QString chat = historyChat();
+    if (chat.isEmpty())
+    {
+        showSearchHits(phrase, QList<HistoryKeeper::HistMessage>());
+        return;
+    }
+
+    HistoryKeeper::getInstance()->searchChatHistory(historyChatType(), chat, phrase, searchHitCount, this,
+                                                    [=](QList<HistoryKeeper::HistMessage> hits)
+    {
+        showSearchHits(phrase, hits);
+    });
+}
+
+void GenericChatForm::showSearchHits(const QString &phrase, const QList<HistoryKeeper::HistMessage> &hits)
+{
+    // The text changed while searching, another search is coming
+    if (phrase != searchEdit->text().trimmed())
+        return;
+
+    searchHits->clear();
+    for (const auto &hit : hits)
+    {
+        ToxID authorId = ToxID::fromString(hit.sender);
+        QString authorStr = authorId.isMine() ? Core::getInstance()->getUsername() : resolveToxID(authorId);
+        QString text = QString("%1  %2: %3").arg(hit.timestamp.toLocalTime().toString(Qt::SystemLocaleShortDate),
+                                                  authorStr, hit.message.simplified());
+
+        QListWidgetItem *item = new QListWidgetItem(text, searchHits);
+        item->setData(Qt::UserRole, hit.id);
+        item->setData(Qt::UserRole + 1, hit.timestamp.toMSecsSinceEpoch());
+    }
+
+    if (hits.isEmpty())
+        new QListWidgetItem(tr("No messages found"), searchHits);
+
+    searchHits->show();
+}
+
+void GenericChatForm::onSearchHitActivated(QListWidgetItem *item)
+{
+    qint64 id = item->data(Qt::UserRole).toLongLong();
+    if (id != 0)
+        jumpToHistory(item->data(Qt::UserRole + 1).toLongLong(), id);
+}
+
 QString GenericChatForm::resolveToxID(const ToxID &id)
 {
     Friend *f = FriendList::findFriend(id);
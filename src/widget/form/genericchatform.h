@@ -21,7 +21,10 @@
 #include <QPoint>
 #include <QDateTime>
 #include <QMenu>
+#include <QHash>
+#include <QTimer>
 #include "src/corestructs.h"
+#include "src/historykeeper.h"
 #include "src/chatlog/chatmessage.h"
 
 // Spacing in px inserted when the author of the last message changes
@@ -30,6 +33,9 @@
 class QLabel;
 class QVBoxLayout;
 class QPushButton;
+class QLineEdit;
+class QListWidget;
+class QListWidgetItem;
 class CroppingLabel;
 class ChatTextEdit;
 class ChatLog;
@@ -74,11 +80,27 @@ protected slots:
     void onCopyLogClicked();
     void clearChatArea(bool);
     void onSelectAllClicked();
+    void loadHistoryPage(); ///< Goes on with the history already shown when scrolling up
+    void toggleSearch();
+    void onSearchTimeout();
+    void onSearchHitActivated(QListWidgetItem* item);
 
 protected:
     QString resolveToxID(const ToxID &id);
     void insertChatMessage(ChatMessage::Ptr msg);
 
+    void resetHistoryPaging();
+    virtual QString historyChat() const; ///< The chat's name in the history, empty if it keeps none
+    virtual HistoryKeeper::ChatType historyChatType() const;
+    void requestHistoryPage(); ///< Requests the page before the oldest message shown, for insertHistoryPage
+    void insertHistoryPage(const QList<HistoryKeeper::HistMessage> &msgs); ///< Prepends a page, oldest first, with dates between days
+    virtual ChatMessage::Ptr createHistoryMessage(const HistoryKeeper::HistMessage &msg); ///< Called for each message of a page
+    void jumpToHistory(qint64 time, qint64 id); ///< Scrolls to a message, loading the pages up to it
+    void showHistoryWindow(qint64 time, qint64 id); ///< Replaces the chat with the history up to a message
+
+    void searchHistory(const QString &phrase); ///< Requests the hits of a search, for showSearchHits
+    void showSearchHits(const QString &phrase, const QList<HistoryKeeper::HistMessage> &hits); ///< Best first
+
     ToxID previousId;
     QMenu menu;
     int curRow;
@@ -90,8 +112,30 @@ protected:
     ChatTextEdit *msgEdit;
     QPushButton *sendButton;
     ChatLog *chatWidget;
-    QDateTime earliestMessage;
     QDateTime historyBaselineDate = QDateTime::currentDateTime(); // used by HistoryKeeper to load messages from t to historyBaselineDate (excluded)
+
+    // History is loaded a page at a time, going back from the oldest message shown
+    static const int historyPageSize = 100;
+    qint64 historyCursorTime; ///< Timestamp and id of the oldest message shown, the next page ends before them
+    qint64 historyCursorId;
+    QDate historyTopDate; ///< Day of the oldest message shown, its date is inserted once the day is complete
+    QDateTime historyTarget; ///< Pages are loaded without waiting for scrolling until this date is shown
+    int historyGeneration = 0; ///< Changes when the chat is cleared, the pages requested before are dropped
+    bool historyLoading;
+    bool historyExhausted;
+    QHash<qint64, ChatMessage::Ptr> historyLines; ///< The messages loaded from history by id
+    qint64 historyJumpId; ///< Pages are loaded until this message is shown, then it's scrolled to
+    qint64 historyJumpTime;
+    int historyJumpPages; ///< Loaded since the jump started, after maxJumpPages the message is shown in a window of its own
+    static const int maxJumpPages = 10;
+    bool historyWindowed; ///< The chat shows a window of history around a message, the newer messages are hidden
+
+    // Search as you type, once the text didn't change for a moment
+    static const int searchHitCount = 50;
+    QWidget *searchWidget;
+    QLineEdit *searchEdit;
+    QListWidget *searchHits;
+    QTimer searchTimer;
     bool audioInputFlag;
     bool audioOutputFlag;
 };
@@ -26,10 +26,16 @@
 #include <QPushButton>
 #include <QMimeData>
 #include <QDragEnterEvent>
+#include <QTimer>
+#include <QMenu>
+#include <algorithm>
 #include "src/historykeeper.h"
 #include "src/misc/flowlayout.h"
 #include <QDebug>
 
+// Peers louder than this are shown as speaking
+static const float speakingLevel = 0.05f;
+
 GroupChatForm::GroupChatForm(Group* chatGroup)
     : group(chatGroup), inCall{false}
 {
@@ -37,6 +43,10 @@ GroupChatForm::GroupChatForm(Group* chatGroup)
 
     tabber = new TabCompleter(msgEdit, group);
 
+    speakingTimer = new QTimer(this);
+    speakingTimer->setInterval(200);
+    connect(speakingTimer, &QTimer::timeout, this, &GroupChatForm::updateSpeakingPeers);
+
     fileButton->setEnabled(false);
     if (group->isAvGroupchat())
     {
@@ -62,16 +72,8 @@ GroupChatForm::GroupChatForm(Group* chatGroup)
     msgEdit->setObjectName("group");
 
     namesListLayout = new FlowLayout(0,5,0);
-    QStringList names(group->getPeerList());
-    QLabel *l;
-    
-    for (const QString& name : names)
-    {
-        l = new QLabel(name);
-        l->setTextFormat(Qt::PlainText);
-        namesListLayout->addWidget(l);
-    }
-    
+    onUserListChanged();
+
     headTextLayout->addWidget(nusersLabel);
     headTextLayout->addLayout(namesListLayout);
     headTextLayout->addStretch();
@@ -121,20 +123,65 @@ void GroupChatForm::onUserListChanged()
         delete child;
     }
 
-    QStringList names(group->getPeerList());
-    unsigned nNames = names.size();
-    for (unsigned i=0; i<nNames; ++i)
+    // Sorted by name like Group::getPeerList, each label remembers its peer for the call menu
+    const QMap<int, QString> peers = group->getPeers();
+    QList<int> peerIds = peers.keys();
+    std::sort(peerIds.begin(), peerIds.end(), [&](int a, int b)
+        {return QString::compare(peers[a], peers[b], Qt::CaseInsensitive) < 0;});
+
+    for (int i = 0; i < peerIds.size(); ++i)
     {
-        QString nameStr = names[i];
-        if (i!=nNames-1)
-            nameStr+=", ";
+        const int peerId = peerIds[i];
+        QString nameStr = peers[peerId];
+        if (i != peerIds.size() - 1)
+            nameStr += ", ";
         QLabel* nameLabel = new QLabel(nameStr);
         nameLabel->setObjectName("peersLabel");
         nameLabel->setTextFormat(Qt::PlainText);
+        nameLabel->setProperty("peerId", peerId);
+        nameLabel->setContextMenuPolicy(Qt::CustomContextMenu);
+        connect(nameLabel, &QLabel::customContextMenuRequested, this, [=](const QPoint& pos)
+            {showPeerMenu(peerId, nameLabel->mapToGlobal(pos));});
         namesListLayout->addWidget(nameLabel);
     }
 }
 
+void GroupChatForm::showPeerMenu(int peerId, const QPoint& pos)
+{
+    if (!inCall)
+        return;
+
+    const int groupId = group->getGroupId();
+    QMenu menu;
+    QAction* muteAction = menu.addAction(tr("Mute", "Mutes a single peer of a group call"));
+    muteAction->setCheckable(true);
+    muteAction->setChecked(Core::isGroupCallPeerMuted(groupId, peerId));
+
+    QMenu* volumeMenu = menu.addMenu(tr("Volume", "Submenu setting a single peer's volume in a group call"));
+    const float gain = Core::getGroupCallPeerGain(groupId, peerId);
+    QHash<QAction*, float> gainActions;
+    for (int percent : {25, 50, 100, 150, 200})
+    {
+        QAction* action = volumeMenu->addAction(tr("%1%", "Volume of a group call peer").arg(percent));
+        action->setCheckable(true);
+        action->setChecked(qAbs(gain - percent / 100.f) < 0.01f);
+        gainActions[action] = percent / 100.f;
+    }
+
+    QAction* selected = menu.exec(pos);
+    if (!selected)
+        return;
+
+    // The call may have ended while the menu was open
+    if (!inCall)
+        return;
+
+    if (selected == muteAction)
+        Core::setGroupCallPeerMuted(groupId, peerId, muteAction->isChecked());
+    else if (gainActions.contains(selected))
+        Core::setGroupCallPeerGain(groupId, peerId, gainActions[selected]);
+}
+
 void GroupChatForm::dragEnterEvent(QDragEnterEvent *ev)
 {
     if (ev->mimeData()->hasFormat("friend"))
@@ -209,6 +256,7 @@ void GroupChatForm::onCallClicked()
         volButton->style()->polish(volButton);
         volButton->setToolTip(tr("Mute call"));
         inCall = true;
+        speakingTimer->start();
     }
     else
     {
@@ -225,6 +273,37 @@ void GroupChatForm::onCallClicked()
         volButton->style()->polish(volButton);
         volButton->setToolTip("");
         inCall = false;
+        speakingTimer->stop();
+        updateSpeakingPeers();
+    }
+}
+
+void GroupChatForm::updateSpeakingPeers()
+{
+    const bool selfSpeaking = inCall && Core::isGroupCallSelfSpeaking(group->getGroupId());
+    if (micButton->property("speaking").toBool() != selfSpeaking)
+    {
+        micButton->setProperty("speaking", selfSpeaking);
+        Style::repolish(micButton);
+    }
+
+    QHash<int, float> levels;
+    if (inCall)
+        levels = Core::getGroupCallPeerLevels(group->getGroupId());
+
+    for (int i = 0; i < namesListLayout->count(); ++i)
+    {
+        QLabel* label = qobject_cast<QLabel*>(namesListLayout->itemAt(i)->widget());
+        if (!label)
+            continue;
+
+        const bool speaking = levels.value(label->property("peerId").toInt()) > speakingLevel;
+        const QString objectName = speaking ? "speakingPeersLabel" : "peersLabel";
+        if (label->objectName() != objectName)
+        {
+            label->setObjectName(objectName);
+            Style::repolish(label);
+        }
     }
 }
 
@@ -265,3 +344,19 @@ void GroupChatForm::keyReleaseEvent(QKeyEvent* ev)
     if (msgEdit->hasFocus())
         return;
 }
+
+void GroupChatForm::loadHistory()
+{
+    if (historyCursorId == 0)
+        requestHistoryPage();
+}
+
+QString GroupChatForm::historyChat() const
+{
+    return group->getIdentity();
+}
+
+HistoryKeeper::ChatType GroupChatForm::historyChatType() const
+{
+    return HistoryKeeper::ctGroup;
+}
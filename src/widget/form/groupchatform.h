@@ -23,6 +23,7 @@ namespace Ui {class MainWindow;}
 class Group;
 class TabCompleter;
 class FlowLayout;
+class QTimer;
 
 class GroupChatForm : public GenericChatForm
 {
@@ -31,6 +32,7 @@ public:
     GroupChatForm(Group* chatGroup);
 
     void onUserListChanged();
+    void loadHistory(); ///< Shows the latest page of the group's history, older pages load as the chat is scrolled up
 
     void keyPressEvent(QKeyEvent* ev);
     void keyReleaseEvent(QKeyEvent* ev);
@@ -43,8 +45,13 @@ private slots:
     void onMicMuteToggle();
     void onVolMuteToggle();
     void onCallClicked();
+    void updateSpeakingPeers();
+    void showPeerMenu(int peerId, const QPoint& pos); ///< Per peer mute and volume, while in the call
 
 protected:
+    virtual QString historyChat() const; ///< The group's identity
+    virtual HistoryKeeper::ChatType historyChatType() const;
+
     // drag & drop
     void dragEnterEvent(QDragEnterEvent* ev);
     void dropEvent(QDropEvent* ev);
@@ -54,6 +61,7 @@ private:
     FlowLayout* namesListLayout;
     QLabel *nusersLabel;
     TabCompleter* tabber;
+    QTimer* speakingTimer;
     bool inCall;
 };
 
@@ -18,6 +18,8 @@
 #include "ui_avsettings.h"
 #include "src/misc/settings.h"
 #include "src/audio.h"
+#include "src/callrecorder.h"
+#include <QDir>
 
 #if defined(__APPLE__) && defined(__MACH__)
  #include <OpenAL/al.h>
@@ -43,6 +45,16 @@ AVForm::AVForm() :
     bodyUI->filterAudio->setDisabled(true);
 #endif
 
+    const Settings& s = Settings::getInstance();
+    bodyUI->suppressSilence->setChecked(s.getSuppressSilence());
+    bodyUI->vadThresholdSpinBox->setValue(s.getVadThreshold());
+    bodyUI->vadHangoverSpinBox->setValue(s.getVadHangover());
+    bodyUI->vadThresholdSpinBox->setEnabled(s.getSuppressSilence());
+    bodyUI->vadHangoverSpinBox->setEnabled(s.getSuppressSilence());
+    bodyUI->recordCalls->setChecked(s.getRecordCalls());
+    bodyUI->recordCalls->setToolTip(tr("Saves the audio and video you send in calls to %1, as they were encoded.")
+                                    .arg(QDir::toNativeSeparators(CallRecorder::recordingsDir())));
+
     connect(Camera::getInstance(), &Camera::propProbingFinished, this, &AVForm::onPropProbingFinished);
     connect(Camera::getInstance(), &Camera::resolutionProbingFinished, this, &AVForm::onResProbingFinished);
 
@@ -50,6 +62,10 @@ AVForm::AVForm() :
     connect(bodyUI->inDevCombobox, qcomboboxIndexChanged, this, &AVForm::onInDevChanged);
     connect(bodyUI->outDevCombobox, qcomboboxIndexChanged, this, &AVForm::onOutDevChanged);
     connect(bodyUI->filterAudio, SIGNAL(toggled(bool)), this, SLOT(onFilterAudioToggled(bool)));
+    connect(bodyUI->suppressSilence, SIGNAL(toggled(bool)), this, SLOT(onSuppressSilenceToggled(bool)));
+    connect(bodyUI->vadThresholdSpinBox, SIGNAL(valueChanged(int)), this, SLOT(onVadThresholdChanged(int)));
+    connect(bodyUI->vadHangoverSpinBox, SIGNAL(valueChanged(int)), this, SLOT(onVadHangoverChanged(int)));
+    connect(bodyUI->recordCalls, SIGNAL(toggled(bool)), this, SLOT(onRecordCallsToggled(bool)));
     connect(bodyUI->rescanButton, &QPushButton::clicked, this, [=](){getAudioInDevices(); getAudioOutDevices();});
     bodyUI->playbackSlider->setValue(100);
 }
@@ -244,6 +260,28 @@ void AVForm::onFilterAudioToggled(bool filterAudio)
     Settings::getInstance().setFilterAudio(filterAudio);
 }
 
+void AVForm::onSuppressSilenceToggled(bool suppressSilence)
+{
+    Settings::getInstance().setSuppressSilence(suppressSilence);
+    bodyUI->vadThresholdSpinBox->setEnabled(suppressSilence);
+    bodyUI->vadHangoverSpinBox->setEnabled(suppressSilence);
+}
+
+void AVForm::onVadThresholdChanged(int threshold)
+{
+    Settings::getInstance().setVadThreshold(threshold);
+}
+
+void AVForm::onVadHangoverChanged(int hangover)
+{
+    Settings::getInstance().setVadHangover(hangover);
+}
+
+void AVForm::onRecordCallsToggled(bool recordCalls)
+{
+    Settings::getInstance().setRecordCalls(recordCalls);
+}
+
 void AVForm::on_HueSlider_valueChanged(int value)
 {
     Camera::getInstance()->setProp(Camera::HUE, value / 100.0);
@@ -53,6 +53,10 @@ private slots:
     void onInDevChanged(const QString& deviceDescriptor);
     void onOutDevChanged(const QString& deviceDescriptor);
     void onFilterAudioToggled(bool filterAudio);
+    void onSuppressSilenceToggled(bool suppressSilence);
+    void onVadThresholdChanged(int threshold);
+    void onVadHangoverChanged(int hangover);
+    void onRecordCallsToggled(bool recordCalls);
     void on_playbackSlider_valueChanged(int value);
 
     // camera
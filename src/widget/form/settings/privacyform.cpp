@@ -183,11 +183,11 @@ void PrivacyForm::onEncryptLogsUpdated()
         }
     }
 
+    HistoryKeeper::resetInstance();
     core->clearPassword(Core::ptHistory);
     Settings::getInstance().setEncryptLogs(false);
     bodyUI->cbEncryptHistory->setChecked(false);
     bodyUI->changeLogsPwButton->setEnabled(false);
-    HistoryKeeper::resetInstance();
 }
 
 bool PrivacyForm::setToxPassword()
@@ -135,7 +135,7 @@ void FriendWidget::setAsActiveChatroom()
         Friend* f = FriendList::findFriend(friendId);
         if (Settings::getInstance().getEnableLogging())
         {
-            f->getChatForm()->loadHistory(QDateTime::currentDateTime().addDays(-7), true);
+            f->getChatForm()->loadHistory(QDateTime::currentDateTime().addDays(-7));
             historyLoaded = true;
         }
     }
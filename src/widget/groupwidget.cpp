@@ -33,6 +33,7 @@
 
 GroupWidget::GroupWidget(int GroupId, QString Name)
     : groupId{GroupId}
+    , historyLoaded{false}
 {
     avatar->setPixmap(QPixmap(":img/group.png"), Qt::transparent);
     statusPic.setPixmap(QPixmap(":img/status/dot_online.png"));
@@ -86,6 +87,16 @@ void GroupWidget::setAsActiveChatroom()
 {
     setActive(true);
     avatar->setPixmap(QPixmap(":img/group_dark.png"), Qt::transparent);
+
+    if (!historyLoaded && Settings::getInstance().getEnableLogging())
+    {
+        Group* g = GroupList::findGroup(groupId);
+        if (g)
+        {
+            g->getChatForm()->loadHistory();
+            historyLoaded = true;
+        }
+    }
 }
 
 void GroupWidget::setAsInactiveChatroom()
@@ -47,6 +47,7 @@ protected:
 
 public:
     int groupId;
+    bool historyLoaded;
 };
 
 #endif // GROUPWIDGET_H
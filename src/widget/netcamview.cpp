@@ -17,12 +17,20 @@
 #include "netcamview.h"
 #include "src/core.h"
 #include "src/widget/videosurface.h"
+#include "src/latencyrecorder.h"
 #include <QLabel>
 #include <QHBoxLayout>
+#include <QTimer>
+#include <QMenu>
+#include <QContextMenuEvent>
+#include <QFileDialog>
+#include <QMessageBox>
+#include <QFontDatabase>
 
 NetCamView::NetCamView(QWidget* parent)
     : QWidget(parent)
     , mainLayout(new QHBoxLayout())
+    , latency(nullptr)
 {
     setLayout(mainLayout);
     setWindowTitle(tr("Tox video"));
@@ -30,24 +38,82 @@ NetCamView::NetCamView(QWidget* parent)
 
     videoSurface = new VideoSurface(this);
 
-    mainLayout->addWidget(videoSurface);
+    latencyLabel = new QLabel(this);
+    latencyLabel->setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+    latencyLabel->setAlignment(Qt::AlignTop | Qt::AlignLeft);
+    latencyLabel->hide();
+
+    latencyTimer = new QTimer(this);
+    latencyTimer->setInterval(1000);
+    connect(latencyTimer, &QTimer::timeout, this, &NetCamView::updateLatency);
+
+    mainLayout->addWidget(videoSurface, 1);
+    mainLayout->addWidget(latencyLabel);
 }
 
-void NetCamView::show(VideoSource *source, const QString &title)
+void NetCamView::show(VideoSource *source, const QString &title, LatencyRecorder* latency)
 {
+    this->latency = latency;
+    videoSurface->setLatencyRecorder(latency);
     setSource(source);
     setTitle(title);
 
+    if (latencyLabel->isVisible())
+        updateLatency();
+
     QWidget::show();
 }
 
 void NetCamView::hide()
 {
     setSource(nullptr);
+    videoSurface->setLatencyRecorder(nullptr);
+    latency = nullptr;
+    latencyTimer->stop();
+    latencyLabel->hide();
 
     QWidget::hide();
 }
 
+void NetCamView::contextMenuEvent(QContextMenuEvent* event)
+{
+    if (!latency)
+        return;
+
+    QMenu menu;
+    QAction* showLatency = menu.addAction(tr("Show latency"));
+    showLatency->setCheckable(true);
+    showLatency->setChecked(latencyLabel->isVisible());
+    QAction* saveLatency = menu.addAction(tr("Save latency report..."));
+
+    QAction* selectedItem = menu.exec(event->globalPos());
+    if (selectedItem == showLatency)
+    {
+        latencyLabel->setVisible(showLatency->isChecked());
+        if (showLatency->isChecked())
+        {
+            updateLatency();
+            latencyTimer->start();
+        }
+        else
+        {
+            latencyTimer->stop();
+        }
+    }
+    else if (selectedItem == saveLatency)
+    {
+        QString path = QFileDialog::getSaveFileName(this, tr("Save latency report"));
+        if (!path.isEmpty() && !latency->dumpToFile(path))
+            QMessageBox::warning(this, tr("Save latency report"), tr("Couldn't write to %1").arg(path));
+    }
+}
+
+void NetCamView::updateLatency()
+{
+    if (latency)
+        latencyLabel->setText(latency->report());
+}
+
 void NetCamView::setSource(VideoSource *s)
 {
     videoSurface->setSource(s);
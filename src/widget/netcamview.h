@@ -20,9 +20,12 @@
 #include <QWidget>
 
 class QHBoxLayout;
+class QLabel;
+class QTimer;
 struct vpx_image;
 class VideoSurface;
 class VideoSource;
+class LatencyRecorder;
 
 class NetCamView : public QWidget
 {
@@ -31,15 +34,25 @@ class NetCamView : public QWidget
 public:
     NetCamView(QWidget *parent=0);
 
-    virtual void show(VideoSource* source, const QString& title);
+    /// latency is the call's recorder, it can then be shown live and saved from the context menu
+    virtual void show(VideoSource* source, const QString& title, LatencyRecorder* latency = nullptr);
     virtual void hide();
 
     void setSource(VideoSource* s);
     void setTitle(const QString& title);
 
+protected:
+    virtual void contextMenuEvent(QContextMenuEvent* event);
+
+private slots:
+    void updateLatency();
+
 private:
     QHBoxLayout* mainLayout;
     VideoSurface* videoSurface;
+    LatencyRecorder* latency;
+    QLabel* latencyLabel;
+    QTimer* latencyTimer;
 };
 
 #endif // NETCAMVIEW_H
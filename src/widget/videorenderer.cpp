@@ -0,0 +1,333 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "videorenderer.h"
+#include "src/latencyrecorder.h"
+#include <QCoreApplication>
+#include <QMutexLocker>
+#include <QOpenGLBuffer>
+#include <QOpenGLShaderProgram>
+#include <QDebug>
+
+VideoRenderer::VideoRenderer(QGLWidget* surface)
+    : surface{surface}
+    , latency{nullptr}
+    , wakePending{false}
+    , dirty{false}
+    , exiting{false}
+    , visible{true}
+    , pbo{nullptr, nullptr}
+    , bgrProgramm{nullptr}
+    , yuvProgramm{nullptr}
+    , textureId{0}
+    , pboAllocSize{0}
+    , pboIndex{0}
+    , format{VideoFrame::NONE}
+{
+    setObjectName("qTox Video Renderer");
+}
+
+void VideoRenderer::pushFrame(const VideoFrame& frame)
+{
+    slot.publish(frame);
+    wake();
+}
+
+void VideoRenderer::requestPaint()
+{
+    dirty = true;
+    wake();
+}
+
+void VideoRenderer::resize(QSize size)
+{
+    {
+        QMutexLocker lock(&mutex);
+        this->size = size;
+    }
+    requestPaint();
+}
+
+void VideoRenderer::setVisible(bool visible)
+{
+    {
+        QMutexLocker lock(&mutex);
+        this->visible = visible;
+    }
+    requestPaint();
+}
+
+void VideoRenderer::setLatencyRecorder(LatencyRecorder* recorder)
+{
+    latency = recorder;
+}
+
+void VideoRenderer::stop()
+{
+    {
+        QMutexLocker lock(&mutex);
+        exiting = true;
+    }
+    wake();
+    wait();
+}
+
+void VideoRenderer::wake()
+{
+    // Whatever changed before this is seen by the render thread once it clears wakePending
+    if (!wakePending.exchange(true))
+        wakeSem.release();
+}
+
+void VideoRenderer::run()
+{
+    surface->makeCurrent();
+    initializeGL();
+
+    VideoFrame frame;
+    forever
+    {
+        wakeSem.acquire();
+        wakePending = false;
+
+        QSize paintSize;
+        {
+            QMutexLocker lock(&mutex);
+            if (exiting)
+                break;
+            // Frames keep replacing each other in the slot, showing again draws the newest
+            if (!visible)
+                continue;
+            paintSize = size;
+        }
+
+        // Frames published while we were busy replaced each other in the slot, only the newest is left
+        qint64 shownTimestamp = 0;
+        const bool fresh = slot.take(frame);
+        if (!dirty.exchange(false) && !fresh)
+            continue;
+
+        if (fresh)
+        {
+            upload(frame);
+            shownTimestamp = frame.timestamp;
+            frame = VideoFrame();
+        }
+
+        paint(paintSize);
+
+        // Blocks until the next vertical refresh with the surface's swap interval
+        surface->swapBuffers();
+
+        LatencyRecorder* recorder = latency;
+        if (recorder)
+            recorder->recordSince(LatencyRecorder::VideoRender, shownTimestamp);
+    }
+
+    cleanupGL();
+    surface->doneCurrent();
+    surface->context()->moveToThread(QCoreApplication::instance()->thread());
+}
+
+void VideoRenderer::initializeGL()
+{
+    qDebug() << "VideoRenderer: Init";
+    // pbo
+    pbo[0] = new QOpenGLBuffer(QOpenGLBuffer::PixelUnpackBuffer);
+    pbo[0]->setUsagePattern(QOpenGLBuffer::StreamDraw);
+    pbo[0]->create();
+
+    pbo[1] = new QOpenGLBuffer(QOpenGLBuffer::PixelUnpackBuffer);
+    pbo[1]->setUsagePattern(QOpenGLBuffer::StreamDraw);
+    pbo[1]->create();
+
+    // shaders
+    bgrProgramm = new QOpenGLShaderProgram;
+    bgrProgramm->addShaderFromSourceCode(QOpenGLShader::Vertex,
+                                     "attribute vec4 vertices;"
+                                     "varying vec2 coords;"
+                                     "void main() {"
+                                     "    gl_Position = vec4(vertices.xy, 0.0, 1.0);"
+                                     "    coords = vertices.xy*vec2(0.5, 0.5) + vec2(0.5, 0.5);"
+                                     "}");
+
+    // brg frag-shader
+    bgrProgramm->addShaderFromSourceCode(QOpenGLShader::Fragment,
+                                     "uniform sampler2D texture0;"
+                                     "varying vec2 coords;"
+                                     "void main() {"
+                                     "    vec4 color = texture2D(texture0,coords*vec2(1.0, -1.0));"
+                                     "    gl_FragColor = vec4(color.bgr, 1.0);"
+                                     "}");
+
+    bgrProgramm->bindAttributeLocation("vertices", 0);
+    bgrProgramm->link();
+
+    // shaders
+    yuvProgramm = new QOpenGLShaderProgram;
+    yuvProgramm->addShaderFromSourceCode(QOpenGLShader::Vertex,
+                                     "attribute vec4 vertices;"
+                                     "varying vec2 coords;"
+                                     "void main() {"
+                                     "    gl_Position = vec4(vertices.xy, 0.0, 1.0);"
+                                     "    coords = vertices.xy*vec2(0.5, 0.5) + vec2(0.5, 0.5);"
+                                     "}");
+
+    // yuv frag-shader
+    yuvProgramm->addShaderFromSourceCode(QOpenGLShader::Fragment,
+                                     "uniform sampler2D texture0;"
+                                     "varying vec2 coords;"
+                                     "void main() {"
+                                     "      vec3 yuv = texture2D(texture0,coords*vec2(1.0, -1.0)).rgb - vec3(0.0, 0.5, 0.5);"
+                                     "      vec3 rgb = mat3(1.0, 1.0, 1.0, 0.0, -0.21482, 2.12798, 1.28033, -0.38059, 0.0)*yuv;"
+                                     "      gl_FragColor = vec4(rgb, 1.0);"
+                                     "}");
+
+    yuvProgramm->bindAttributeLocation("vertices", 0);
+    yuvProgramm->link();
+}
+
+void VideoRenderer::cleanupGL()
+{
+    delete pbo[0];
+    delete pbo[1];
+    pbo[0] = pbo[1] = nullptr;
+
+    delete bgrProgramm;
+    delete yuvProgramm;
+    bgrProgramm = yuvProgramm = nullptr;
+
+    if (textureId != 0)
+        glDeleteTextures(1, &textureId);
+    textureId = 0;
+}
+
+void VideoRenderer::upload(const VideoFrame& frame)
+{
+    if (!frame.isValid())
+        return;
+
+    if (res != frame.resolution)
+    {
+        res = frame.resolution;
+
+        // delete old texture
+        if (textureId != 0)
+            glDeleteTextures(1, &textureId);
+
+        // a texture used to render the pbo (has the match the pixelformat of the source)
+        glGenTextures(1,&textureId);
+        glBindTexture(GL_TEXTURE_2D, textureId);
+        glTexImage2D(GL_TEXTURE_2D,0, GL_RGB, res.width(), res.height(), 0, GL_RGB, GL_UNSIGNED_BYTE, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    }
+
+    // Alternate between the two pbos so we never write to one the GPU may still be reading
+    pboIndex = (pboIndex + 1) % 2;
+
+    if (pboAllocSize != frame.frameData.size())
+    {
+        qDebug() << "VideoRenderer: Resize pbo " << frame.frameData.size() << "(" << frame.resolution << ")" << "bytes (before" << pboAllocSize << ")";
+
+        pbo[0]->bind();
+        pbo[0]->allocate(frame.frameData.size());
+        pbo[0]->release();
+
+        pbo[1]->bind();
+        pbo[1]->allocate(frame.frameData.size());
+        pbo[1]->release();
+
+        pboAllocSize = frame.frameData.size();
+    }
+
+    // transfer data, the texture update from the pbo is queued without waiting for it
+    pbo[pboIndex]->bind();
+    void* ptr = pbo[pboIndex]->map(QOpenGLBuffer::WriteOnly);
+    if (ptr)
+        memcpy(ptr, frame.frameData.constData(), frame.frameData.size());
+    pbo[pboIndex]->unmap();
+
+    glBindTexture(GL_TEXTURE_2D, textureId);
+    glTexSubImage2D(GL_TEXTURE_2D,0,0,0, res.width(), res.height(), GL_RGB, GL_UNSIGNED_BYTE, 0);
+    pbo[pboIndex]->release();
+
+    format = frame.format;
+}
+
+void VideoRenderer::paint(QSize size)
+{
+    // background
+    glViewport(0, 0, size.width(), size.height());
+    glClearColor(0, 0, 0, 1);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    if (!res.isValid() || res.isEmpty())
+        return;
+
+    // keep aspect ratio
+    float aspectRatio = float(res.width()) / float(res.height());
+    if (size.width() < float(size.height()) * aspectRatio)
+    {
+        float h = float(size.width()) / aspectRatio;
+        glViewport(0, (size.height() - h)*0.5f, size.width(), h);
+    }
+    else
+    {
+        float w = float(size.height()) * float(aspectRatio);
+        glViewport((size.width() - w)*0.5f, 0, w, size.height());
+    }
+
+    QOpenGLShaderProgram* programm = nullptr;
+    switch (format)
+    {
+    case VideoFrame::YUV:
+        programm = yuvProgramm;
+        break;
+    case VideoFrame::BGR:
+        programm = bgrProgramm;
+        break;
+    default:
+        break;
+    }
+
+    if (programm)
+    {
+        // render pbo
+        static float values[] = {
+            -1, -1,
+            1, -1,
+            -1, 1,
+            1, 1
+        };
+
+        programm->bind();
+        programm->setAttributeArray(0, GL_FLOAT, values, 2);
+        programm->enableAttributeArray(0);
+    }
+
+    glBindTexture(GL_TEXTURE_2D, textureId);
+
+    //draw fullscreen quad
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    if (programm)
+    {
+        programm->disableAttributeArray(0);
+        programm->release();
+    }
+}
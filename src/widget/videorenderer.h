@@ -0,0 +1,89 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef VIDEORENDERER_H
+#define VIDEORENDERER_H
+
+#include <QThread>
+#include <QGLWidget>
+#include <QMutex>
+#include <QSemaphore>
+#include <QSize>
+#include <atomic>
+#include "src/video/videoframeslot.h"
+
+class QOpenGLBuffer;
+class QOpenGLShaderProgram;
+class LatencyRecorder;
+
+/**
+ * Owns a VideoSurface's GL context and draws on its own thread,
+ * so neither the GUI nor the video sources wait on each other.
+ * Sources publish into a latest-frame slot from their own thread, the renderer
+ * draws whatever is newest when it gets to it and swapBuffers paces it to the display.
+ * Publishing never takes a lock, the renderer is woken at most once per frame it draws.
+ * Nothing is drawn or swapped while the surface is hidden.
+ **/
+
+class VideoRenderer : public QThread
+{
+    Q_OBJECT
+public:
+    VideoRenderer(QGLWidget* surface);
+
+    void pushFrame(const VideoFrame& frame); ///< From one thread at a time
+    void requestPaint(); ///< Redraw the last frame, e.g. after an expose
+    void resize(QSize size);
+    void setVisible(bool visible); ///< Drawing pauses while hidden
+    void setLatencyRecorder(LatencyRecorder* recorder);
+    void stop(); ///< Blocks until the thread exited, the context is back on the GUI thread
+
+protected:
+    virtual void run();
+
+private:
+    void initializeGL();
+    void cleanupGL();
+    void upload(const VideoFrame& frame);
+    void paint(QSize size);
+    void wake(); ///< Lets the render thread look at what changed
+
+private:
+    QGLWidget* surface;
+    VideoFrameSlot slot;
+    std::atomic<LatencyRecorder*> latency;
+
+    QSemaphore wakeSem;
+    std::atomic<bool> wakePending; ///< A wake is posted and the render thread didn't look yet
+    std::atomic<bool> dirty; ///< Redraw even without a new frame
+
+    QMutex mutex; ///< Guards the fields below, set from the GUI thread
+    bool exiting;
+    bool visible;
+    QSize size;
+
+    // Render thread only
+    QOpenGLBuffer* pbo[2];
+    QOpenGLShaderProgram* bgrProgramm;
+    QOpenGLShaderProgram* yuvProgramm;
+    GLuint textureId;
+    int pboAllocSize;
+    int pboIndex;
+    QSize res;
+    VideoFrame::ColorFormat format;
+};
+
+#endif // VIDEORENDERER_H
@@ -15,24 +15,54 @@
 */
 
 #include "videosurface.h"
+#include "videorenderer.h"
 #include "src/video/camera.h"
-#include <QTimer>
-#include <QOpenGLBuffer>
-#include <QOpenGLShaderProgram>
+#include <QResizeEvent>
+#include <QThread>
 #include <QDebug>
+#include <atomic>
+
+/// Lets a source's frames through to the renderer until it's closed.
+/// An emission that started before the disconnect can still reach it, even after the surface is gone
+struct VideoSurface::FrameGate
+{
+    explicit FrameGate(VideoRenderer* renderer) : renderer{renderer}, open{true}, inFlight{0} {}
+
+    void pushFrame(const VideoFrame& frame)
+    {
+        inFlight++;
+        if (open)
+            renderer->pushFrame(frame);
+        inFlight--;
+    }
+
+    void close() ///< Returns once no frame is being pushed anymore
+    {
+        open = false;
+        while (inFlight)
+            QThread::yieldCurrentThread();
+    }
+
+    VideoRenderer* const renderer;
+    std::atomic<bool> open;
+    std::atomic<int> inFlight;
+};
+
+static QGLFormat surfaceFormat()
+{
+    // Double buffered and synced to the display, swapBuffers paces the render thread
+    QGLFormat format(QGL::DoubleBuffer);
+    format.setSwapInterval(1);
+    return format;
+}
 
 VideoSurface::VideoSurface(QWidget* parent)
-    : QGLWidget(QGLFormat(QGL::SingleBuffer), parent)
+    : QGLWidget(surfaceFormat(), parent)
     , source{nullptr}
-    , pbo{nullptr, nullptr}
-    , bgrProgramm{nullptr}
-    , yuvProgramm{nullptr}
-    , textureId{0}
-    , pboAllocSize{0}
     , hasSubscribed{false}
-    , pboIndex{0}
 {
-    
+    setAutoBufferSwap(false);
+    renderer = new VideoRenderer(this);
 }
 
 VideoSurface::VideoSurface(VideoSource *source, QWidget* parent)
@@ -43,16 +73,11 @@ VideoSurface::VideoSurface(VideoSource *source, QWidget* parent)
 
 VideoSurface::~VideoSurface()
 {
-    if (pbo[0])
-    {
-        delete pbo[0];
-        delete pbo[1];
-    }
-
-    if (textureId != 0)
-        glDeleteTextures(1, &textureId);
-
     unsubscribe();
+
+    // Gives the context back to us before QGLWidget destroys it
+    renderer->stop();
+    delete renderer;
 }
 
 void VideoSurface::setSource(VideoSource *src)
@@ -65,180 +90,40 @@ void VideoSurface::setSource(VideoSource *src)
     subscribe();
 }
 
-void VideoSurface::initializeGL()
+void VideoSurface::setLatencyRecorder(LatencyRecorder* recorder)
 {
-    QGLWidget::initializeGL();
-    qDebug() << "VideoSurface: Init";
-    // pbo
-    pbo[0] = new QOpenGLBuffer(QOpenGLBuffer::PixelUnpackBuffer);
-    pbo[0]->setUsagePattern(QOpenGLBuffer::StreamDraw);
-    pbo[0]->create();
-
-    pbo[1] = new QOpenGLBuffer(QOpenGLBuffer::PixelUnpackBuffer);
-    pbo[1]->setUsagePattern(QOpenGLBuffer::StreamDraw);
-    pbo[1]->create();
-
-    // shaders
-    bgrProgramm = new QOpenGLShaderProgram;
-    bgrProgramm->addShaderFromSourceCode(QOpenGLShader::Vertex,
-                                     "attribute vec4 vertices;"
-                                     "varying vec2 coords;"
-                                     "void main() {"
-                                     "    gl_Position = vec4(vertices.xy, 0.0, 1.0);"
-                                     "    coords = vertices.xy*vec2(0.5, 0.5) + vec2(0.5, 0.5);"
-                                     "}");
-
-    // brg frag-shader
-    bgrProgramm->addShaderFromSourceCode(QOpenGLShader::Fragment,
-                                     "uniform sampler2D texture0;"
-                                     "varying vec2 coords;"
-                                     "void main() {"
-                                     "    vec4 color = texture2D(texture0,coords*vec2(1.0, -1.0));"
-                                     "    gl_FragColor = vec4(color.bgr, 1.0);"
-                                     "}");
-
-    bgrProgramm->bindAttributeLocation("vertices", 0);
-    bgrProgramm->link();
-
-    // shaders
-    yuvProgramm = new QOpenGLShaderProgram;
-    yuvProgramm->addShaderFromSourceCode(QOpenGLShader::Vertex,
-                                     "attribute vec4 vertices;"
-                                     "varying vec2 coords;"
-                                     "void main() {"
-                                     "    gl_Position = vec4(vertices.xy, 0.0, 1.0);"
-                                     "    coords = vertices.xy*vec2(0.5, 0.5) + vec2(0.5, 0.5);"
-                                     "}");
-
-    // yuv frag-shader
-    yuvProgramm->addShaderFromSourceCode(QOpenGLShader::Fragment,
-                                     "uniform sampler2D texture0;"
-                                     "varying vec2 coords;"
-                                     "void main() {"
-                                     "      vec3 yuv = texture2D(texture0,coords*vec2(1.0, -1.0)).rgb - vec3(0.0, 0.5, 0.5);"
-                                     "      vec3 rgb = mat3(1.0, 1.0, 1.0, 0.0, -0.21482, 2.12798, 1.28033, -0.38059, 0.0)*yuv;"
-                                     "      gl_FragColor = vec4(rgb, 1.0);"
-                                     "}");
-
-    yuvProgramm->bindAttributeLocation("vertices", 0);
-    yuvProgramm->link();
+    renderer->setLatencyRecorder(recorder);
 }
 
-void VideoSurface::paintGL()
+void VideoSurface::paintEvent(QPaintEvent*)
 {
-    mutex.lock();
-    VideoFrame currFrame = frame;
-    frame.invalidate();
-    mutex.unlock();
-
-    if (currFrame.isValid() && res != currFrame.resolution)
-    {
-        res = currFrame.resolution;
-
-        // delete old texture
-        if (textureId != 0)
-            glDeleteTextures(1, &textureId);
-
-        // a texture used to render the pbo (has the match the pixelformat of the source)
-        glGenTextures(1,&textureId);
-        glBindTexture(GL_TEXTURE_2D, textureId);
-        glTexImage2D(GL_TEXTURE_2D,0, GL_RGB, res.width(), res.height(), 0, GL_RGB, GL_UNSIGNED_BYTE, 0);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    }
-
-    if (currFrame.isValid())
-    {
-        pboIndex = (pboIndex + 1) % 2;
-        int nextPboIndex = (pboIndex + 1) % 2;
-
-        if (pboAllocSize != currFrame.frameData.size())
-        {
-            qDebug() << "VideoSurface: Resize pbo " << currFrame.frameData.size() << "(" << currFrame.resolution << ")" << "bytes (before" << pboAllocSize << ")";
-
-            pbo[0]->bind();
-            pbo[0]->allocate(currFrame.frameData.size());
-            pbo[0]->release();
-
-            pbo[1]->bind();
-            pbo[1]->allocate(currFrame.frameData.size());
-            pbo[1]->release();
-
-            pboAllocSize = currFrame.frameData.size();
-        }
-
-
-        pbo[pboIndex]->bind();
-        glBindTexture(GL_TEXTURE_2D, textureId);
-        glTexSubImage2D(GL_TEXTURE_2D,0,0,0, res.width(), res.height(), GL_RGB, GL_UNSIGNED_BYTE, 0);
-        pbo[pboIndex]->unmap();
-        pbo[pboIndex]->release();
-
-        // transfer data
-        pbo[nextPboIndex]->bind();
-        void* ptr = pbo[nextPboIndex]->map(QOpenGLBuffer::WriteOnly);
-        if (ptr)
-            memcpy(ptr, currFrame.frameData.data(), currFrame.frameData.size());
-        pbo[nextPboIndex]->unmap();
-        pbo[nextPboIndex]->release();
-    }
+    renderer->requestPaint();
+}
 
-    // background
-    glClearColor(0, 0, 0, 1);
-    glClear(GL_COLOR_BUFFER_BIT);
+void VideoSurface::resizeEvent(QResizeEvent* event)
+{
+    renderer->resize(event->size());
+}
 
-    // keep aspect ratio
-    float aspectRatio = float(res.width()) / float(res.height());
-    if (width() < float(height()) * aspectRatio)
-    {
-        float h = float(width()) / aspectRatio;
-        glViewport(0, (height() - h)*0.5f, width(), h);
-    }
-    else
-    {
-        float w = float(height()) * float(aspectRatio);
-        glViewport((width() - w)*0.5f, 0, w, height());
-    }
+void VideoSurface::showEvent(QShowEvent* event)
+{
+    QGLWidget::showEvent(event);
 
-    QOpenGLShaderProgram* programm = nullptr;
-    switch (frame.format)
+    // The window exists now, hand the context over to the render thread for good
+    if (!renderer->isRunning())
     {
-    case VideoFrame::YUV:
-        programm = yuvProgramm;
-        break;
-    case VideoFrame::BGR:
-        programm = bgrProgramm;
-        break;
-    default:
-        break;
+        renderer->resize(size());
+        doneCurrent();
+        context()->moveToThread(renderer);
+        renderer->start();
     }
+    renderer->setVisible(true);
+}
 
-    if (programm)
-    {
-        // render pbo
-        static float values[] = {
-            -1, -1,
-            1, -1,
-            -1, 1,
-            1, 1
-        };
-
-        programm->bind();
-        programm->setAttributeArray(0, GL_FLOAT, values, 2);
-        programm->enableAttributeArray(0);
-    }
-
-    glBindTexture(GL_TEXTURE_2D, textureId);
-
-    //draw fullscreen quad
-    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-
-    glBindTexture(GL_TEXTURE_2D, 0);
-
-    if (programm)
-    {
-        programm->disableAttributeArray(0);
-        programm->release();
-    }
+void VideoSurface::hideEvent(QHideEvent* event)
+{
+    QGLWidget::hideEvent(event);
+    renderer->setVisible(false);
 }
 
 void VideoSurface::subscribe()
@@ -247,7 +132,11 @@ void VideoSurface::subscribe()
     {
         source->subscribe();
         hasSubscribed = true;
-        connect(source, &VideoSource::frameAvailable, this, &VideoSurface::onNewFrameAvailable);
+        gate = std::make_shared<FrameGate>(renderer);
+        std::shared_ptr<FrameGate> frameGate = gate;
+        frameConnection = connect(source, &VideoSource::frameAvailable, this,
+                                  [frameGate](const VideoFrame& frame){frameGate->pushFrame(frame);},
+                                  Qt::DirectConnection);
     }
 }
 
@@ -257,18 +146,10 @@ void VideoSurface::unsubscribe()
     {
         source->unsubscribe();
         hasSubscribed = false;
-        disconnect(source, &VideoSource::frameAvailable, this, &VideoSurface::onNewFrameAvailable);
-    }
-}
-
-void VideoSurface::onNewFrameAvailable(const VideoFrame& newFrame)
-{
-    mutex.lock();
-    frame = newFrame;
-    mutex.unlock();
+        disconnect(frameConnection);
 
-    updateGL();
+        // The renderer takes frames from one source at a time, and may be deleted next
+        gate->close();
+        gate.reset();
+    }
 }
-
-
-
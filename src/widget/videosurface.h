@@ -18,11 +18,18 @@
 #define SELFCAMVIEW_H
 
 #include <QGLWidget>
-#include <QMutex>
+#include <memory>
 #include "src/video/videosource.h"
 
-class QOpenGLBuffer;
-class QOpenGLShaderProgram;
+class VideoRenderer;
+class LatencyRecorder;
+
+/**
+ * Shows a video source. Drawing happens on the surface's own render thread,
+ * see VideoRenderer, the GUI thread never touches the GL context.
+ * Frames arrive straight from the source's thread through a gate shared with the connection,
+ * a source is only let go of once none of its frames is still being handed over.
+ **/
 
 class VideoSurface : public QGLWidget
 {
@@ -34,31 +41,27 @@ public:
     ~VideoSurface();
 
     void setSource(VideoSource* src); //NULL is a valid option
+    void setLatencyRecorder(LatencyRecorder* recorder); ///< Records how long frames took to be painted, NULL to stop
 
-    // QGLWidget interface
 protected:
-    virtual void initializeGL();
-    virtual void paintGL();
+    // Handled by the render thread instead of QGLWidget
+    virtual void paintEvent(QPaintEvent* event);
+    virtual void resizeEvent(QResizeEvent* event);
+    virtual void showEvent(QShowEvent* event);
+    virtual void hideEvent(QHideEvent* event);
 
     void subscribe();
     void unsubscribe();
 
-private slots:
-    void onNewFrameAvailable(const VideoFrame &newFrame);
+private:
+    struct FrameGate;
 
 private:
     VideoSource* source;
-    QOpenGLBuffer* pbo[2];
-    QOpenGLShaderProgram* bgrProgramm;
-    QOpenGLShaderProgram* yuvProgramm;
-    GLuint textureId;
-    int pboAllocSize;
-    QSize res;
+    VideoRenderer* renderer;
     bool hasSubscribed;
-
-    QMutex mutex;
-    VideoFrame frame;
-    int pboIndex;
+    QMetaObject::Connection frameConnection;
+    std::shared_ptr<FrameGate> gate; ///< Of the current source, also owned by its connection
 };
 
 #endif // SELFCAMVIEW_H
@@ -614,7 +614,10 @@ void Widget::setStatusMessage(const QString &statusMessage)
 void Widget::reloadHistory()
 {
     for (auto f : FriendList::getAllFriends())
-        f->getChatForm()->loadHistory(QDateTime::currentDateTime().addDays(-7), true);
+        f->getChatForm()->loadHistory(QDateTime::currentDateTime().addDays(-7));
+
+    for (auto g : GroupList::getAllGroups())
+        g->getChatForm()->loadHistory();
 }
 
 void Widget::addFriend(int friendId, const QString &userId)
@@ -656,6 +659,7 @@ void Widget::addFriend(int friendId, const QString &userId)
     connect(core, &Core::avMediaChange, newfriend->getChatForm(), &ChatForm::onAvMediaChange);
     connect(core, &Core::avCallFailed, newfriend->getChatForm(), &ChatForm::onAvCallFailed);
     connect(core, &Core::avRejected, newfriend->getChatForm(), &ChatForm::onAvRejected);
+    connect(core, &Core::avSelfSpeaking, newfriend->getChatForm(), &ChatForm::onAvSelfSpeaking);
     connect(core, &Core::friendAvatarChanged, newfriend->getChatForm(), &ChatForm::onAvatarChange);
     connect(core, &Core::friendAvatarChanged, newfriend->getFriendWidget(), &FriendWidget::onAvatarChange);
     connect(core, &Core::friendAvatarRemoved, newfriend->getChatForm(), &ChatForm::onAvatarRemoved);
@@ -803,33 +807,14 @@ void Widget::newMessageAlert(GenericChatroomWidget* chat)
             setWindowState(Qt::WindowActive);
     }
 
-    static QFile sndFile(":audio/notification.pcm");
-    static QByteArray sndData;
-
-    if (sndData.isEmpty())
-    {
-        sndFile.open(QIODevice::ReadOnly);
-        sndData = sndFile.readAll();
-        sndFile.close();
-    }
-
-    Audio::playMono16Sound(sndData);
+    Audio::playSound(Audio::NewMessageSound);
 }
 
 void Widget::playRingtone()
 {
     QApplication::alert(this);
 
-    static QFile sndFile1(":audio/ToxicIncomingCall.pcm"); // for whatever reason this plays slower/downshifted from what any other program plays the file as... but whatever
-    static QByteArray sndData1;
-    if (sndData1.isEmpty())
-    {
-        sndFile1.open(QIODevice::ReadOnly);
-        sndData1 = sndFile1.readAll();
-        sndFile1.close();
-    }
-
-    Audio::playMono16Sound(sndData1);
+    Audio::playSound(Audio::IncomingCallSound);
 }
 
 void Widget::onFriendRequestReceived(const QString& userId, const QString& message)
@@ -896,6 +881,8 @@ void Widget::onGroupInviteReceived(int32_t friendId, uint8_t type, QByteArray in
                 qWarning() << "Widget::onGroupInviteReceived: Unable to accept  group invite";
                 return;
             }
+
+            createGroup(groupId)->setIdentity(invite);
         }
     }
     else
@@ -912,11 +899,17 @@ void Widget::onGroupMessageReceived(int groupnumber, int peernumber, const QStri
         return;
 
     ToxID author = Core::getInstance()->getGroupPeerToxID(groupnumber, peernumber);
+    QDateTime timestamp = QDateTime::currentDateTime();
     bool targeted = !author.isMine() && (message.contains(nameMention) || message.contains(sanitizedNameMention));
     if (targeted && !isAction)
-        g->getChatForm()->addAlertMessage(author, message, QDateTime::currentDateTime());
+        g->getChatForm()->addAlertMessage(author, message, timestamp);
     else
-        g->getChatForm()->addMessage(author, message, isAction, QDateTime::currentDateTime(), true);
+        g->getChatForm()->addMessage(author, message, isAction, timestamp, true);
+
+    // Our own messages come back here too
+    if (!g->getIdentity().isEmpty())
+        HistoryKeeper::getInstance()->addGroupChatEntry(g->getIdentity(), isAction ? "/me " + message : message,
+                                                        author.publicKey, timestamp);
 
     g->setEventFlag(static_cast<GenericChatroomWidget*>(g->getGroupWidget()) != activeChatroomWidget);
 
@@ -954,6 +947,7 @@ void Widget::onGroupNamelistChanged(int groupnumber, int peernumber, uint8_t Cha
     else if (change == TOX_CHAT_CHANGE_PEER_DEL)
     {
         // g->removePeer(peernumber);
+        Core::removeGroupCallPeer(groupnumber, peernumber);
         g->regeneratePeerList();
         // g->getChatForm()->addSystemInfoMessage(tr("%1 has left the chat").arg(name), "white", QDateTime::currentDateTime());
     }
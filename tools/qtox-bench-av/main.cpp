@@ -0,0 +1,316 @@
+#include "video/videoframe.h"
+#include "video/netvideosource.h"
+#include "audiojitterbuffer.h"
+#include "audiosourcequeue.h"
+
+#include <QElapsedTimer>
+#include <QTextStream>
+#include <QVector>
+#include <tox/toxav.h>
+#include <vpx/vpx_encoder.h>
+#include <vpx/vpx_decoder.h>
+#include <vpx/vp8cx.h>
+#include <vpx/vp8dx.h>
+#include <opus/opus.h>
+#if defined(__APPLE__) && defined(__MACH__)
+ #include <OpenAL/al.h>
+ #include <OpenAL/alc.h>
+#else
+ #include <AL/al.h>
+ #include <AL/alc.h>
+ #include <AL/alext.h>
+#endif
+#include <atomic>
+#include <cmath>
+#include <ctime>
+#include <cstdlib>
+#include <cstring>
+
+// Drives a call's media paths with synthetic input, no network or devices needed:
+//   video: BGR frame -> createVpxImage -> VP8 encode -> VP8 decode -> NetVideoSource::pushVPXFrame
+//   audio: PCM frame -> Opus encode -> Opus decode -> AudioJitterBuffer -> AudioSourceQueue -> OpenAL mix
+// toxav only prepares frames inside a live call, so the codecs are set up the way toxav sets
+// them up, with av_DefaultSettings. OpenAL renders through a loopback device when it has one.
+// Usage: qtox-bench-av [frames per resolution]
+
+static std::atomic<quint64> allocations{0};
+
+// Count heap allocations: the whole malloc family where we can hook it, operator new elsewhere
+#ifdef __GLIBC__
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* ptr, size_t size);
+extern "C" void* malloc(size_t size) { allocations++; return __libc_malloc(size); }
+extern "C" void* calloc(size_t count, size_t size) { allocations++; return __libc_calloc(count, size); }
+extern "C" void* realloc(void* ptr, size_t size) { allocations++; return __libc_realloc(ptr, size); }
+#else
+void* operator new(size_t size) { allocations++; if (void* p = malloc(size)) return p; throw std::bad_alloc(); }
+void* operator new[](size_t size) { allocations++; if (void* p = malloc(size)) return p; throw std::bad_alloc(); }
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+#endif
+
+// Rates of a call, see Core::sendCallVideo and av_DefaultSettings
+static const int videoFps = 20;
+static const int sampleRate = 48000;
+
+struct Stage
+{
+    const char* name;
+    qint64 ns = 0;
+    quint64 allocs = 0;
+};
+
+/// Runs f and charges its time and allocations to the stage
+template <typename F>
+static void measure(Stage& stage, F f)
+{
+    const quint64 allocs = allocations;
+    QElapsedTimer timer;
+    timer.start();
+    f();
+    stage.ns += timer.nsecsElapsed();
+    stage.allocs += allocations - allocs;
+}
+
+static QString usPerFrame(const Stage& stage, int frames)
+{
+    return QString::number(stage.ns / 1000.0 / frames, 'f', 1);
+}
+
+static void makeVideoFrame(QByteArray& data, int w, int h, int index)
+{
+    // Color bars with a bouncing box, like SyntheticVideoSource, so every frame differs
+    uint8_t* px = reinterpret_cast<uint8_t*>(data.data());
+    for (int y = 0; y < h; ++y)
+    {
+        for (int x = 0; x < w; ++x, px += 3)
+        {
+            const int bar = (x * 8 / w + index / 10) % 8;
+            px[0] = (bar & 1) ? 255 : 0;
+            px[1] = (bar & 2) ? 255 : 0;
+            px[2] = (bar & 4) ? 255 : 0;
+        }
+    }
+
+    const int box = h / 6;
+    const int bx = (index * 7) % (w - box);
+    const int by = (index * 5) % (h - box);
+    for (int y = by; y < by + box; ++y)
+        memset(data.data() + (y * w + bx) * 3, 64 + index % 192, box * 3);
+}
+
+static void benchVideo(QTextStream& out, const char* label, int w, int h, int frames)
+{
+    vpx_codec_enc_cfg_t cfg;
+    vpx_codec_enc_config_default(vpx_codec_vp8_cx(), &cfg, 0);
+    cfg.rc_target_bitrate = av_DefaultSettings.video_bitrate;
+    cfg.g_w = w;
+    cfg.g_h = h;
+    cfg.g_pass = VPX_RC_ONE_PASS;
+    cfg.g_error_resilient = VPX_ERROR_RESILIENT_DEFAULT | VPX_ERROR_RESILIENT_PARTITIONS;
+    cfg.g_lag_in_frames = 0;
+    cfg.kf_min_dist = 0;
+    cfg.kf_max_dist = 48;
+    cfg.kf_mode = VPX_KF_AUTO;
+
+    vpx_codec_ctx_t encoder, decoder;
+    if (vpx_codec_enc_init(&encoder, vpx_codec_vp8_cx(), &cfg, 0) != VPX_CODEC_OK
+            || vpx_codec_dec_init(&decoder, vpx_codec_vp8_dx(), nullptr, 0) != VPX_CODEC_OK)
+    {
+        out << label << "\tcan't create the VP8 codecs\n";
+        return;
+    }
+    vpx_codec_control(&encoder, VP8E_SET_CPUUSED, 8);
+
+    NetVideoSource display;
+    QByteArray encoded(w * h * 4, Qt::Uninitialized);
+    VideoFrame source(QByteArray(w * h * 3, Qt::Uninitialized), QSize(w, h), VideoFrame::BGR);
+    Stage convert{"convert"}, encode{"encode"}, decode{"decode"}, unpack{"display"};
+    qint64 encodedBytes = 0;
+
+    const std::clock_t cpuStart = std::clock();
+    QElapsedTimer wall;
+    wall.start();
+    qint64 generateNs = 0;
+
+    for (int f = 0; f < frames; ++f)
+    {
+        QElapsedTimer generate;
+        generate.start();
+        makeVideoFrame(source.frameData, w, h, f);
+        generateNs += generate.nsecsElapsed();
+
+        vpx_image_t img;
+        measure(convert, [&]{img = source.createVpxImage();});
+
+        int size = 0;
+        measure(encode, [&]
+        {
+            // What toxav_prepare_video_frame does: encode, then gather the packets
+            vpx_codec_encode(&encoder, &img, f, 1, 0, VPX_DL_REALTIME);
+            vpx_codec_iter_t iter = nullptr;
+            while (const vpx_codec_cx_pkt_t* pkt = vpx_codec_get_cx_data(&encoder, &iter))
+            {
+                if (pkt->kind != VPX_CODEC_CX_FRAME_PKT || size + int(pkt->data.frame.sz) > encoded.size())
+                    continue;
+                memcpy(encoded.data() + size, pkt->data.frame.buf, pkt->data.frame.sz);
+                size += pkt->data.frame.sz;
+            }
+        });
+        vpx_img_free(&img);
+        encodedBytes += size;
+
+        vpx_image_t* decoded = nullptr;
+        measure(decode, [&]
+        {
+            vpx_codec_decode(&decoder, reinterpret_cast<const uint8_t*>(encoded.constData()), size, nullptr, 0);
+            vpx_codec_iter_t iter = nullptr;
+            decoded = vpx_codec_get_frame(&decoder, &iter);
+        });
+
+        if (decoded)
+            measure(unpack, [&]{display.pushVPXFrame(decoded);});
+    }
+
+    const double wallS = (wall.nsecsElapsed() - generateNs) / 1e9;
+    const double cpuS = double(std::clock() - cpuStart) / CLOCKS_PER_SEC - generateNs / 1e9;
+    const qint64 totalNs = convert.ns + encode.ns + decode.ns + unpack.ns;
+
+    out << label << '\t' << QString::number(frames / wallS, 'f', 1);
+    for (const Stage* stage : {&convert, &encode, &decode, &unpack})
+        out << '\t' << usPerFrame(*stage, frames);
+    out << '\t' << QString::number(double(convert.allocs + encode.allocs + decode.allocs + unpack.allocs) / frames, 'f', 1)
+        << '\t' << QString::number(totalNs / 1e9 / frames * videoFps * 100, 'f', 1)
+        << '\t' << QString::number(cpuS / wallS * 100, 'f', 0)
+        << '\t' << encodedBytes * 8 * videoFps / frames / 1000 << '\n';
+
+    vpx_codec_destroy(&encoder);
+    vpx_codec_destroy(&decoder);
+}
+
+static void benchAudio(QTextStream& out, int frames)
+{
+    const int channels = av_DefaultSettings.audio_channels;
+    const int frameSize = av_DefaultSettings.audio_frame_duration * sampleRate / 1000;
+
+    int err;
+    OpusEncoder* encoder = opus_encoder_create(sampleRate, channels, OPUS_APPLICATION_AUDIO, &err);
+    OpusDecoder* decoder = opus_decoder_create(sampleRate, channels, &err);
+    if (!encoder || !decoder)
+    {
+        out << "audio\tcan't create the Opus codecs\n";
+        return;
+    }
+    opus_encoder_ctl(encoder, OPUS_SET_BITRATE(av_DefaultSettings.audio_bitrate));
+    opus_encoder_ctl(encoder, OPUS_SET_COMPLEXITY(10));
+
+    // A loopback device lets us pull the mix ourselves instead of waiting for a sound card
+    ALCdevice* device = nullptr;
+    const ALCint* attrs = nullptr;
+#ifdef ALC_SOFT_loopback
+    auto loopbackOpen = reinterpret_cast<LPALCLOOPBACKOPENDEVICESOFT>(alcGetProcAddress(nullptr, "alcLoopbackOpenDeviceSOFT"));
+    auto renderSamples = reinterpret_cast<LPALCRENDERSAMPLESSOFT>(alcGetProcAddress(nullptr, "alcRenderSamplesSOFT"));
+    const ALCint loopbackAttrs[] = {ALC_FORMAT_CHANNELS_SOFT, ALC_STEREO_SOFT, ALC_FORMAT_TYPE_SOFT, ALC_SHORT_SOFT,
+                                    ALC_FREQUENCY, sampleRate, 0};
+    if (loopbackOpen && renderSamples)
+    {
+        device = loopbackOpen(nullptr);
+        attrs = loopbackAttrs;
+    }
+#endif
+    const bool loopback = device;
+    if (!device)
+        device = alcOpenDevice(nullptr);
+    ALCcontext* context = device ? alcCreateContext(device, attrs) : nullptr;
+    if (!context || !alcMakeContextCurrent(context))
+    {
+        out << "audio\tcan't open an OpenAL device\n";
+        return;
+    }
+
+    {
+        AudioJitterBuffer jitter;
+        AudioSourceQueue output;
+        QVector<int16_t> pcm(frameSize * channels), decoded(frameSize * channels), mixed(frameSize * 2);
+        QVector<uint8_t> packet(frameSize * 2 * channels);
+        Stage encode{"encode"}, decode{"decode"}, buffer{"jitter"}, playout{"playout"};
+
+        const std::clock_t cpuStart = std::clock();
+        QElapsedTimer wall;
+        wall.start();
+
+        for (int f = 0; f < frames; ++f)
+        {
+            for (int i = 0; i < frameSize; ++i)
+                for (int c = 0; c < channels; ++c)
+                    pcm[i * channels + c] = 8000 * std::sin(2 * M_PI * 440 * double(f * frameSize + i) / sampleRate);
+
+            int size = 0;
+            measure(encode, [&]{size = opus_encode(encoder, pcm.constData(), frameSize, packet.data(), packet.size());});
+
+            int samples = 0;
+            measure(decode, [&]{samples = opus_decode(decoder, packet.constData(), size, decoded.data(), frameSize, 0);});
+
+            const int16_t* frame = nullptr;
+            int outSamples, outRate;
+            unsigned outChannels;
+            measure(buffer, [&]
+            {
+                jitter.push(decoded.constData(), samples, channels, sampleRate);
+                frame = jitter.pop(outSamples, outChannels, outRate);
+            });
+
+            measure(playout, [&]
+            {
+                // A real device plays in real time, don't overflow its queue when running flat out
+                if (frame && output.pending() < AudioSourceQueue::bufferCount)
+                    output.queue(frame, outSamples, outChannels, outRate);
+#ifdef ALC_SOFT_loopback
+                if (loopback)
+                    renderSamples(device, mixed.data(), frameSize);
+#endif
+            });
+        }
+
+        const double wallS = wall.nsecsElapsed() / 1e9;
+        const double cpuS = double(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+        const qint64 totalNs = encode.ns + decode.ns + buffer.ns + playout.ns;
+        const int framesPerSecond = 1000 / av_DefaultSettings.audio_frame_duration;
+
+        out << (loopback ? "audio" : "audio*") << '\t' << QString::number(frames / wallS, 'f', 1);
+        for (const Stage* stage : {&encode, &decode, &buffer, &playout})
+            out << '\t' << usPerFrame(*stage, frames);
+        out << '\t' << QString::number(double(encode.allocs + decode.allocs + buffer.allocs + playout.allocs) / frames, 'f', 1)
+            << '\t' << QString::number(totalNs / 1e9 / frames * framesPerSecond * 100, 'f', 2)
+            << '\t' << QString::number(cpuS / wallS * 100, 'f', 0)
+            << '\t' << av_DefaultSettings.audio_bitrate / 1000 << '\n';
+        if (!loopback)
+            out << "(audio* means OpenAL has no loopback device, playout only queues buffers)\n";
+    }
+
+    alcMakeContextCurrent(nullptr);
+    alcDestroyContext(context);
+    alcCloseDevice(device);
+    opus_encoder_destroy(encoder);
+    opus_decoder_destroy(decoder);
+}
+
+int main(int argc, char* argv[])
+{
+    QTextStream out(stdout);
+    const int frames = argc > 1 ? QString(argv[1]).toInt() : 300;
+
+    out << "All times in us per frame. call cpu% is the time one call needs at its real frame rate,\n"
+        << "bench cpu% the CPU use of the process while running flat out.\n\n";
+
+    out << "video\tfps\tconvert\tencode\tdecode\tdisplay\tallocs\tcall%\tbench%\tkbit/s\n";
+    benchVideo(out, "360p", 640, 360, frames);
+    benchVideo(out, "720p", 1280, 720, frames);
+    benchVideo(out, "1080p", 1920, 1080, frames);
+
+    out << "\naudio\tfps\tencode\tdecode\tjitter\tplayout\tallocs\tcall%\tbench%\tkbit/s\n";
+    benchAudio(out, frames * 5);
+
+    return 0;
+}
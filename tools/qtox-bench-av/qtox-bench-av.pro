@@ -0,0 +1,30 @@
+TEMPLATE = app
+CONFIG += console c++11
+QT += core
+QT -= gui
+
+INCLUDEPATH += ../../src ../../libs/include
+
+SOURCES += main.cpp \
+    ../../src/video/videoframe.cpp \
+    ../../src/video/netvideosource.cpp \
+    ../../src/audiojitterbuffer.cpp \
+    ../../src/audiosourcequeue.cpp \
+    ../../src/latencyrecorder.cpp
+
+HEADERS += ../../src/video/videoframe.h \
+    ../../src/video/videosource.h \
+    ../../src/video/netvideosource.h \
+    ../../src/audiojitterbuffer.h \
+    ../../src/audiosourcequeue.h \
+    ../../src/latencyrecorder.h
+
+LIBS += -L../../libs/lib -ltoxav -ltoxcore -lsodium -lvpx -lopus
+
+macx {
+    LIBS += -framework OpenAL
+} else:win32 {
+    LIBS += -lOpenAL32
+} else {
+    LIBS += -lopenal -lpthread
+}
@@ -0,0 +1,172 @@
+#include "misc/db/legacylogreader.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QTextStream>
+#include <QTemporaryDir>
+#include <QThreadPool>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QFile>
+#include <QDir>
+#include <QDateTime>
+#include <tox/toxencryptsave.h>
+#include <vector>
+#include <cstdlib>
+
+// Times loading the encrypted history log of older versions, the way EncryptedDb migrates it:
+// decrypt the 4 KiB chunks, split the base64'd statements and replay them into SQLite.
+// Logs are generated with the statements HistoryKeeper used to write, and read back
+// with a single decryption thread and with the whole pool.
+// Usage: qtox-bench-history [log sizes in MB...]
+
+static std::vector<uint8_t> key;
+
+static QByteArray encrypt(const QByteArray& plain)
+{
+    QByteArray out(plain.size() + tox_pass_encryption_extra_length(), Qt::Uninitialized);
+    tox_pass_key_encrypt(reinterpret_cast<const uint8_t*>(plain.constData()), plain.size(), key.data(),
+                         reinterpret_cast<uint8_t*>(out.data()));
+    return out;
+}
+
+static QByteArray decrypt(const QByteArray& data)
+{
+    const int size = data.size() - tox_pass_encryption_extra_length();
+    if (size <= 0)
+        return QByteArray();
+
+    QByteArray out(size, Qt::Uninitialized);
+    if (tox_pass_key_decrypt(reinterpret_cast<const uint8_t*>(data.constData()), data.size(), key.data(),
+                             reinterpret_cast<uint8_t*>(out.data())) != size)
+        return QByteArray();
+    return out;
+}
+
+/// Writes a log of about megabytes MB, returns the number of statements in it
+static int generateLog(const QString& path, int megabytes)
+{
+    QFile file(path);
+    file.open(QIODevice::WriteOnly);
+
+    const QByteArray words = "lorem ipsum dolor sit amet consectetur adipiscing elit sed do eiusmod tempor ";
+    QByteArray buffer;
+    qint64 written = 0;
+    int statements = 0;
+    qint64 timestamp = QDateTime::currentMSecsSinceEpoch();
+    while (written < megabytes * qint64(1024 * 1024))
+    {
+        const QByteArray message = words.left(8 + rand() % (words.size() - 8)).repeated(1 + rand() % 3);
+        const QByteArray sql = QString("INSERT INTO history (timestamp, chat_id, sender, message) VALUES (%1, %2, %3, '%4');")
+                .arg(timestamp += rand() % 60000).arg(1 + rand() % 20).arg(1 + rand() % 21)
+                .arg(QString(message)).toUtf8();
+        buffer += sql.toBase64() + "\n";
+        buffer += QByteArray("INSERT INTO sent_status (status) VALUES (1);").toBase64() + "\n";
+        statements += 2;
+
+        while (buffer.size() >= LegacyLogReader::plainChunkSize())
+        {
+            QByteArray chunk = encrypt(buffer.left(LegacyLogReader::plainChunkSize()));
+            file.write(chunk);
+            written += chunk.size();
+            buffer.remove(0, LegacyLogReader::plainChunkSize());
+        }
+    }
+    file.write(encrypt(buffer));
+    return statements;
+}
+
+struct Result
+{
+    qint64 decryptMs = 0;
+    qint64 loadMs = 0;
+    int statements = 0;
+};
+
+static Result load(const QString& path, QThreadPool* pool)
+{
+    Result result;
+    QString statement;
+
+    {
+        QElapsedTimer timer;
+        timer.start();
+        LegacyLogReader log(path, decrypt, pool);
+        log.start();
+        while (log.next(statement))
+            result.statements++;
+        result.decryptMs = timer.elapsed();
+    }
+
+    QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", "bench");
+    db.setDatabaseName(":memory:");
+    db.open();
+    db.exec("CREATE TABLE history (id INTEGER PRIMARY KEY AUTOINCREMENT, timestamp INTEGER NOT NULL, "
+            "chat_id INTEGER NOT NULL, sender INTEGER NOT NULL, message TEXT NOT NULL);");
+    db.exec("CREATE TABLE sent_status (id INTEGER PRIMARY KEY AUTOINCREMENT, status INTEGER NOT NULL DEFAULT 0);");
+
+    {
+        QElapsedTimer timer;
+        timer.start();
+        LegacyLogReader log(path, decrypt, pool);
+        log.start();
+        db.exec("BEGIN TRANSACTION;");
+        while (log.next(statement))
+            db.exec(statement);
+        db.exec("COMMIT TRANSACTION;");
+        result.loadMs = timer.elapsed();
+    }
+
+    db.close();
+    db = QSqlDatabase();
+    QSqlDatabase::removeDatabase("bench");
+    return result;
+}
+
+int main(int argc, char* argv[])
+{
+    QCoreApplication app(argc, argv);
+    QTextStream out(stdout);
+
+    QList<int> sizes;
+    for (int i = 1; i < argc; ++i)
+        sizes << QString(argv[i]).toInt();
+    if (sizes.isEmpty())
+        sizes << 10 << 50 << 100;
+
+    key.resize(tox_pass_key_length());
+    QByteArray password = "qtox-bench-history";
+    tox_derive_key_from_pass(reinterpret_cast<uint8_t*>(password.data()), password.size(), key.data());
+
+    QTemporaryDir dir;
+    QThreadPool single;
+    single.setMaxThreadCount(1);
+    QThreadPool* all = QThreadPool::globalInstance();
+
+    out << "decrypt is reading every statement, load also replays them into SQLite, in ms.\n"
+        << "1 thread decrypts chunk after chunk like older versions, " << all->maxThreadCount() << " threads is the default.\n\n";
+    out << "MB\tstatements\tdecrypt 1\tload 1\tdecrypt " << all->maxThreadCount() << "\tload " << all->maxThreadCount() << "\tspeedup\n";
+    out.flush();
+
+    for (int megabytes : sizes)
+    {
+        const QString path = QDir(dir.path()).filePath(QString("history-%1.encrypted").arg(megabytes));
+        const int statements = generateLog(path, megabytes);
+
+        Result sequential = load(path, &single);
+        Result parallel = load(path, all);
+        if (sequential.statements < statements || parallel.statements < statements)
+            out << "warning: only read " << qMin(sequential.statements, parallel.statements)
+                << " of " << statements << " statements\n";
+
+        out << megabytes << "\t" << statements << "\t\t"
+            << sequential.decryptMs << "\t\t" << sequential.loadMs << "\t"
+            << parallel.decryptMs << "\t\t" << parallel.loadMs << "\t"
+            << QString::number(double(sequential.loadMs) / qMax<qint64>(1, parallel.loadMs), 'f', 2) << "x\n";
+        out.flush();
+
+        QFile::remove(path);
+    }
+
+    return 0;
+}
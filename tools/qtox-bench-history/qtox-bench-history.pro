@@ -0,0 +1,17 @@
+TEMPLATE = app
+CONFIG += console c++11
+QT += core sql
+QT -= gui
+
+INCLUDEPATH += ../../src ../../libs/include
+
+SOURCES += main.cpp \
+    ../../src/misc/db/legacylogreader.cpp
+
+HEADERS += ../../src/misc/db/legacylogreader.h
+
+LIBS += -L../../libs/lib -ltoxencryptsave -ltoxcore -lsodium
+
+!win32 {
+    LIBS += -lpthread
+}
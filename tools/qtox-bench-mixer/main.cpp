@@ -0,0 +1,69 @@
+#include "groupaudiomixer.h"
+
+#include <QElapsedTimer>
+#include <QTextStream>
+#include <QVector>
+#include <cmath>
+
+// Mixes synthetic group call peers the way Audio::mixGroupAudio does,
+// and reports the time spent per 20ms output frame.
+// Usage: qtox-bench-mixer [frames]
+
+static const int sampleRate = 48000;
+static const int frameSize = sampleRate / 50;
+
+static void makeTone(QVector<int16_t>& frame, int peer, int index)
+{
+    // Every peer hums its own note, and talks one second out of three
+    const bool talking = (index / 50 + peer) % 3 == 0;
+    const double freq = 110.0 * (1 + peer % 12);
+    for (int i = 0; i < frameSize; ++i)
+    {
+        const double t = double(index * frameSize + i) / sampleRate;
+        frame[i] = talking ? static_cast<int16_t>(12000 * std::sin(2 * M_PI * freq * t)) : 0;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    QTextStream out(stdout);
+    const int frames = argc > 1 ? QString(argv[1]).toInt() : 5000;
+    const int peerCounts[] = {2, 8, 32, 64};
+
+    out << "peers\tframes\tus/frame\tclipped%\n";
+    for (int peers : peerCounts)
+    {
+        GroupAudioMixer mixer(frameSize, 1, sampleRate);
+        for (int p = 0; p < peers; p += 4)
+            mixer.setPeerGain(p, 0.5f);
+
+        QVector<QVector<int16_t>> input(peers, QVector<int16_t>(frameSize));
+        QVector<int16_t> mixed(frameSize);
+        qint64 mixNs = 0;
+        qint64 clipped = 0;
+        QElapsedTimer timer;
+
+        for (int f = 0; f < frames; ++f)
+        {
+            for (int p = 0; p < peers; ++p)
+            {
+                makeTone(input[p], p, f);
+                mixer.pushPeerAudio(p, input[p].constData(), frameSize, 1, sampleRate);
+            }
+
+            timer.start();
+            const bool ok = mixer.mix(mixed.data());
+            mixNs += timer.nsecsElapsed();
+
+            if (ok)
+                for (int16_t sample : mixed)
+                    clipped += sample == 32767 || sample == -32768;
+        }
+
+        out << peers << '\t' << frames << '\t'
+            << QString::number(mixNs / 1000.0 / frames, 'f', 2) << '\t'
+            << QString::number(100.0 * clipped / (qint64(frames) * frameSize), 'f', 2) << '\n';
+    }
+
+    return 0;
+}
@@ -0,0 +1,11 @@
+TEMPLATE = app
+CONFIG += console c++11
+QT += core
+QT -= gui
+
+INCLUDEPATH += ../../src
+
+SOURCES += main.cpp \
+    ../../src/groupaudiomixer.cpp
+
+HEADERS += ../../src/groupaudiomixer.h